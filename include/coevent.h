@@ -16,6 +16,7 @@
 #include <vector>
 
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/un.h>
@@ -27,6 +28,11 @@ class Base;
 class Event;
 class Server;
 class Client;
+class ConnectionPool;
+class DNSCache;
+class DatagramPool;
+class UDPTransactor;
+class SessionReaper;
 
 class UDPServer;
 class UDPClient;
@@ -37,6 +43,8 @@ class TCPServer;
 class TCPSession;
 class TCPClient;
 
+class TLSContext;
+
 
 // network type
 typedef enum {
@@ -88,6 +96,11 @@ private:
     struct event_base   *_event_base;
     std::string         _identifier;
     std::set<Event *>   _events_under_control;  // User may put server event into a base, it will be deallocated automatically when this is not needed anymore.
+    ConnectionPool      *_connection_pool;      // created on first use
+    DNSCache            *_dns_cache;            // created on first use
+    DatagramPool        *_datagram_pool;        // created on first use
+    UDPTransactor       *_udp_transactor_ipv4;  // created on first use
+    UDPTransactor       *_udp_transactor_ipv6;  // created on first use
 
     // constructor and destructors
 public:
@@ -99,6 +112,10 @@ public:
     const std::string &identifier();
     void put_event_under_control(Event *event);
     void delete_event_under_control(Event *event);
+    ConnectionPool *connection_pool();
+    DNSCache *dns_cache();
+    DatagramPool *datagram_pool();
+    UDPTransactor *udp_transactor(NetType_t network_type = NetIPv4);     // NetIPv4 or NetIPv6
 };
 
 
@@ -141,8 +158,20 @@ public:
     UDPClient *new_UDP_client(NetType_t network_type, void *user_arg = NULL);
     DNSClient *new_DNS_client(NetType_t network_type, void *user_arg = NULL);
     TCPClient *new_TCP_client(NetType_t network_type, void *user_arg = NULL);
+
+    // connected TCP clients shared through the connection pool of owner base. Returns NULL if failed, reason is in status()
+    TCPClient *borrow_TCP_client(const struct sockaddr *addr, socklen_t addr_len, double timeout_seconds = 0, void *user_arg = NULL);
+    // host name is looked up and its addresses are tried in turn, lookups and connects all within timeout_seconds
+    TCPClient *borrow_TCP_client(const std::string &target_address, unsigned target_port, double timeout_seconds = 0, void *user_arg = NULL);
+    struct Error return_TCP_client(TCPClient *client, BOOL reusable = TRUE);      // client should NOT be used after returned
+
+    // switch into coroutine of this procedure from callbacks of clients, procedure is deleted if coroutine ends
+    virtual void resume_coroutine(struct stCoRoutine_t *coroutine);             // actually protected
+    struct stCoRoutine_t *coroutine();      // actually protected, the running one of this procedure
 protected:
     virtual struct stCoRoutine_t *_coroutine();
+private:
+    BOOL _remaining_time(double deadline, double *timeout_seconds);
 };
 
 
@@ -194,6 +223,24 @@ public:
 
 
 // ====================
+// how datagrams are distributed among UDP servers sharing one port by SO_REUSEPORT
+typedef enum {
+    ReusePortKernel = 0,    // kernel default hash, changes when servers join or leave
+    ReusePortFlowHash,      // CBPF hash of source and destination address and port, stable for group size
+    ReusePortCPU,           // CBPF by receiving CPU, server of index i gets datagrams handled on CPU i % group_size
+} ReusePortPolicy_t;
+
+
+// one datagram in batch I/O of UDPServer
+struct UDPMessage {
+    void            *data;          // buffer provided by caller
+    size_t          data_len;       // recv_batch: buffer size in, datagram length out. send_batch: data length
+    struct sockaddr_storage addr;   // recv_batch: source address. send_batch: destination address
+    socklen_t       addr_len;
+    BOOL            is_truncated;   // recv_batch: datagram is larger than buffer
+    size_t          segment_size;   // recv_batch: size of each datagram coalesced by GRO, equals data_len if not coalesced
+};
+
 // UDP server
 class UDPServer : public Server {
 protected:
@@ -213,7 +260,22 @@ protected:
     struct sockaddr_un  _remote_addr_unix;
     socklen_t           _remote_addr_unix_len;
 
-    std::map<std::string, UDPSession *> _session_collection;
+    void            *_session_table;        // UDPPeerTable, sessions keyed by remote address
+
+    double          _idle_timeout;
+    double          _max_session_lifetime;
+    SessionReaper   *_session_reaper;       // created on first session
+    size_t          _session_inbound_limit;
+
+    BOOL            _is_gro;
+    size_t          _last_segment_size;     // of last datagram received
+
+    unsigned            _reuseport_group_size;
+    ReusePortPolicy_t   _reuseport_policy;
+
+    BOOL            _is_dual_stack;
+
+    unsigned        _worker_count;
 
 public:
     UDPServer();
@@ -229,6 +291,23 @@ public:
     struct Error init_session_mode(Base *base, WorkerFunc session_func, NetType_t network_type, int bind_port = 0, void *user_arg = NULL, BOOL auto_free = TRUE);
     struct Error quit_session_mode_server();
     struct Error notify_session_ends(UDPSession *session);      // actually protected
+    void resume_coroutine(struct stCoRoutine_t *coroutine);     // actually protected
+
+    // server-wide idle timeout and max lifetime of sessions, checked once a second. 0 means never. May be set at any
+    // time, live sessions are covered from then on. Session being reaped is disconnected, its pending recv() returns
+    // ERR_SESSION_REAPED
+    void set_idle_timeout(double seconds);
+    double idle_timeout();
+    void set_max_session_lifetime(double seconds);
+    double max_session_lifetime();
+    uint64_t reaped_count();
+    SessionReaper *session_reaper();                        // actually protected
+
+    // datagrams queued in each session before it reads them, default 256, 0 means unlimited.
+    // Datagrams beyond that are dropped and counted
+    void set_session_inbound_limit(size_t max_datagrams);
+    size_t session_inbound_limit();
+    uint64_t inbound_drop_count();
 
     NetType_t network_type();
     const char *c_socket_path();    // valid in local type
@@ -246,6 +325,41 @@ public:
     struct Error send(const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL, const std::string &target_address = "", unsigned port = 80);
     struct Error reply(const void *data, const size_t data_len, size_t *reply_len_out = NULL);
 
+    // batch I/O by recvmmsg() and sendmmsg(). recv_batch() waits like recv() until datagrams arrive, then returns
+    // as many as available up to msg_count. Afterward client_addr() and reply() refer to the last one.
+    // send_batch() sends to address of each message, or to client_addr() if addr_len is 0
+    struct Error recv_batch(struct UDPMessage *msgs, size_t msg_count, size_t *recv_count_out, double timeout_seconds = 0);
+    struct Error recv_batch_in_timeval(struct UDPMessage *msgs, size_t msg_count, size_t *recv_count_out, const struct timeval &timeout);
+    struct Error send_batch(const struct UDPMessage *msgs, size_t msg_count, size_t *send_count_out_nullable = NULL);
+
+    // UDP GSO and GRO. send_segmented() lets kernel split data into datagrams of segment_size, to client_addr()
+    // if addr is NULL. After GRO enabled, recv() may return several coalesced datagrams of the same size, which
+    // is reported by recv_segmented(), and by segment_size of each UDPMessage in recv_batch().
+    // GRO is not available in session mode
+    struct Error send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out_nullable = NULL, const struct sockaddr *addr_nullable = NULL);
+    struct Error set_gro(BOOL enable);
+    BOOL gro();
+    struct Error recv_segmented(void *data_out, const size_t len_limit, size_t *len_out_nullable, size_t *segment_size_out, double timeout_seconds = 0);
+
+    // Join a SO_REUSEPORT group of group_size servers bound to the same address, normally one in each Base and thread.
+    // Should be called before init() or init_session_mode(). Group index of a server is the order of init(), so a
+    // peer keeps hitting the same server and session table as long as all members are alive
+    struct Error set_reuseport_group(unsigned group_size, ReusePortPolicy_t policy = ReusePortFlowHash);
+    unsigned reuseport_group_size();
+    ReusePortPolicy_t reuseport_policy();
+
+    // Dual-stack: the IPv6 socket also serves IPv4 peers with IPV6_V6ONLY off, so both families share one worker and
+    // one session table. IPv4 peers appear as v4-mapped addresses like "::ffff:192.0.2.1", and IPv4 targets of send
+    // functions are mapped likewise. Should be called before init() or init_session_mode() with NetIPv6 or AF_INET6
+    struct Error set_dual_stack(BOOL enable);
+    BOOL dual_stack();
+
+    // Run worker_count coroutines of the same WorkerFunc on this server, so that a worker blocked by client I/O does
+    // not stop the socket. Each readable event is handed to one idle worker, and client_addr(), reply() and
+    // new_*_client() refer to the calling worker. Should be called before init(), not available in session mode
+    struct Error set_worker_count(unsigned worker_count);
+    unsigned worker_count();
+
     std::string client_addr();      // valid in IPv4 or IPv6 type
     unsigned client_port();         // valid in IPv4 or IPv6 type
     void copy_client_addr(struct sockaddr *addr_out, socklen_t addr_len);
@@ -258,6 +372,15 @@ private:
     int _fd();
     struct sockaddr *_remote_sock_addr();
     socklen_t *_remote_sock_addr_len();
+    int _recv_batch_nonblock(struct UDPMessage *msgs, size_t msg_count);
+    ssize_t _recv_datagram(void *data_out, size_t len_limit);
+    struct Error _join_reuseport_group(int fd);
+    struct Error _attach_reuseport_program(int fd);
+    const struct sockaddr *_send_addr(const struct sockaddr *addr, socklen_t *addr_len, struct sockaddr_in6 *mapped_buff);
+    void *_worker_arg();
+    void _wait(void *worker_arg, struct timeval *timeout, BOOL is_reading);
+    struct Error _start_workers(Base *base, void *first_arg);
+    void _stop_workers();
 protected:
     struct stCoRoutine_t *_coroutine();
 };
@@ -276,6 +399,13 @@ public:
     virtual struct Error recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out_nullable, const struct timeval &timeout) = 0;
     virtual struct Error recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out_nullable, unsigned timeout_milisecs) = 0;
 
+    // read-only view of next datagram without copying. Valid until next recv() or recv_view() of this session
+    virtual struct Error recv_view(const void **data_out, size_t *len_out, double timeout_seconds = 0) = 0;
+    virtual struct Error recv_view_in_timeval(const void **data_out, size_t *len_out, const struct timeval &timeout) = 0;
+
+    // UDP GSO, reply data as datagrams of segment_size split by kernel
+    virtual struct Error send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out_nullable = NULL) = 0;
+
     virtual struct Error sleep(double seconds) = 0;
     virtual struct Error sleep(struct timeval &sleep_time) = 0;
     virtual struct Error sleep_milisecs(unsigned mili_secs) = 0;
@@ -303,6 +433,19 @@ public:
     virtual struct Error recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out_nullable, const struct timeval &timeout) = 0;
     virtual struct Error recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out_nullable, unsigned timeout_milisecs) = 0;
 
+    // connected mode: kernel drops datagrams from other peers, and skips route lookup on every send.
+    // After connected, send() with empty target address goes to the connected peer.
+    virtual struct Error connect(const struct sockaddr *addr, socklen_t addr_len) = 0;
+    virtual struct Error connect(const std::string &target_address, unsigned target_port = 80) = 0;
+    virtual struct Error disconnect(void) = 0;
+    virtual BOOL is_connected() = 0;
+
+    // UDP GSO and GRO, see UDPServer. send_segmented() sends to connected peer if addr is NULL
+    virtual struct Error send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out_nullable = NULL, const struct sockaddr *addr_nullable = NULL, socklen_t addr_len = 0) = 0;
+    virtual struct Error set_gro(BOOL enable) = 0;
+    virtual BOOL gro() = 0;
+    virtual struct Error recv_segmented(void *data_out, const size_t len_limit, size_t *len_out_nullable, size_t *segment_size_out, double timeout_seconds = 0) = 0;
+
     virtual std::string remote_addr() = 0;    // valid in IPv4 or IPv6 type
     virtual unsigned remote_port() = 0;       // valid in IPv4 or IPv6 type
     virtual void copy_remote_addr(struct sockaddr *addr_out, socklen_t addr_len) = 0;
@@ -388,14 +531,48 @@ public:
 
 // ====================
 // TCPServer
+
+// per-connection information of TCPServer, indexed by file descriptor
+struct TCPSessionStat {
+    TCPSession      *session;       // NULL if file descriptor is not used by a session
+    struct timeval  accept_time;    // sys up time
+    struct timeval  last_active;    // sys up time
+    uint64_t        bytes_in;
+    uint64_t        bytes_out;
+};
+
 class TCPServer : public Server {
 private:
     void                        *_event_arg;
     int                         _fd;
     struct sockaddr_storage     _sock_addr;
     socklen_t                   _sock_addr_len;
-    std::map<int, TCPSession *> _sessions;
+    std::vector<struct TCPSessionStat> _sessions;
+    size_t                      _session_count;
     unsigned                    _port;
+    int                         _listen_backlog;
+    unsigned                    _accept_budget;
+    int                         _fast_open_queue;
+
+    // admission control and overload shedding
+    size_t                      _max_sessions;
+    double                      _overload_target;
+    double                      _overload_interval;
+    double                      _first_above_time;
+    double                      _drop_next;
+    unsigned                    _drop_count;
+    BOOL                        _is_dropping;
+    double                      _last_queueing_delay;
+    std::string                 _shed_reply;
+    uint64_t                    _shed_by_limit;
+    uint64_t                    _shed_by_delay;
+
+    double                      _idle_timeout;
+    double                      _max_session_lifetime;
+    SessionReaper               *_session_reaper;       // created on first session
+
+    TLSContext                  *_tls_context;          // not owned
+    double                      _tls_handshake_timeout;
 public:
     TCPServer();
     virtual ~TCPServer();
@@ -406,16 +583,83 @@ public:
     struct Error init_session_mode(Base *base, WorkerFunc session_func, std::string &bind_path, void *user_arg = NULL, BOOL auto_free = TRUE);
     struct Error quit_session_mode_server();
     struct Error notify_session_ends(TCPSession *session);      // actually protected
+    void notify_session_accepted(int fd, TCPSession *session);  // actually protected
+    void notify_session_io(int fd, size_t bytes_in, size_t bytes_out);     // actually protected
+
+    const struct TCPSessionStat *session_stat(int fd);      // NULL if no session on this fd
 
     NetType_t network_type();
     const char *c_socket_path();    // valid in local type
     int port();                     // valid in IPv4 or IPv6 type
+
+    // should be set before init_session_mode(). Backlog <= 0 means SOMAXCONN
+    void set_listen_backlog(int backlog);
+    int listen_backlog();
+    // max connections accepted in one readable event, 0 means accept until EAGAIN
+    void set_accept_budget(unsigned max_accepts_per_event);
+    unsigned accept_budget();
+    // TCP fast open (TFO) pending request queue length, should be set before init_session_mode(). 0 disables TFO
+    void set_fast_open_queue(int queue_len);
+    int fast_open_queue();
+
+    // admission control. Connections over max sessions are shed at once, 0 means unlimited
+    void set_max_sessions(size_t max_sessions);
+    size_t max_sessions();
+    size_t session_count();
+    // CoDel-style shedding: when queueing delay (accept to first run of session) stays above target
+    // for an interval, incoming connections are shed at an increasing rate. Target 0 disables it
+    void set_overload_control(double target_delay_seconds, double interval_seconds = 0.1);
+    double overload_target_delay();
+    double last_queueing_delay();
+    // reply sent to shed connections before closing, empty means close only
+    void set_shed_reply(const void *data, size_t data_len);
+    uint64_t shed_count();
+    uint64_t shed_count_by_limit();
+    uint64_t shed_count_by_delay();
+
+    // server-wide idle timeout and max lifetime of sessions, checked once a second. 0 means never. May be set at any
+    // time, live sessions are covered from then on. Session being reaped is disconnected, its pending recv() returns
+    // ERR_SESSION_REAPED
+    void set_idle_timeout(double seconds);
+    double idle_timeout();
+    void set_max_session_lifetime(double seconds);
+    double max_session_lifetime();
+    uint64_t reaped_count();
+    SessionReaper *session_reaper();                        // actually protected
+
+    // TLS for all sessions, handshake is done before session function is called. Context is not owned by server
+    void set_tls_context(TLSContext *context, double handshake_timeout_seconds = 10.0);
+    TLSContext *tls_context();
+    double tls_handshake_timeout();
+
+    BOOL shed_if_overloaded(int client_fd);                 // actually protected
+    void notify_queueing_delay(double delay_seconds);       // actually protected
 private:
     void _clear();
 };
 
 
 // TCPSession
+
+// options and result of TCPSession::relay()
+struct RelayOptions {
+    double          idle_timeout;   // no data in both directions, 0 means forever
+    double          total_timeout;  // 0 means forever
+    size_t          buffer_size;    // pipe or buffer size of each direction
+    BOOL            use_splice;     // zero-copy through pipe, fallback to copying if not supported
+
+    RelayOptions():
+        idle_timeout(0), total_timeout(0), buffer_size(64 * 1024), use_splice(TRUE)
+    {}
+};
+
+struct RelayStats {
+    uint64_t        bytes_to_client;    // from session to client
+    uint64_t        bytes_to_session;   // from client to session
+    double          duration;
+    BOOL            is_spliced;         // both directions went through splice()
+};
+
 class TCPSession : public Session {
 public:
     TCPSession(){};
@@ -430,6 +674,31 @@ public:
 
     virtual struct Error disconnect(void) = 0;
 
+    // full-duplex mode: a companion writer coroutine sends queued data on EV_WRITE, so the session coroutine
+    // may stay blocked in recv(). After writer started, reply() works as reply_async().
+    // Queued data is still sent after session coroutine returns.
+    virtual struct Error start_writer(void) = 0;
+    virtual struct Error post(const void *data, const size_t data_len) = 0;     // never blocks, ERR_OUTBOUND_FULL if queue is above high watermark
+    virtual struct Error reply_async(const void *data, const size_t data_len) = 0;  // queue data, session coroutine is suspended above high watermark until below low watermark
+    virtual size_t outbound_bytes() = 0;
+
+    // queue limit of writer, high watermark 0 means unlimited
+    virtual void set_write_watermarks(size_t high_watermark, size_t low_watermark) = 0;
+    virtual size_t write_high_watermark() = 0;
+    virtual size_t write_low_watermark() = 0;
+
+    // pump data between this session and a connected client in both directions, until both sides close or timeout.
+    // Client should be created by this session. Neither of them is closed by relay().
+    virtual struct Error relay(TCPClient *client, const struct RelayOptions &options, struct RelayStats *stats_out = NULL) = 0;
+
+    // TLS server handshake on this connection, then reply() and recv() are encrypted. Relay is not available on TLS
+    virtual struct Error start_tls(TLSContext *context, double timeout_seconds = 0) = 0;
+    virtual BOOL is_tls() = 0;
+    virtual BOOL is_ktls() = 0;         // records are sent by kernel TLS
+
+    // send file content by sendfile(), zero-copy also under kernel TLS
+    virtual struct Error send_file(int file_fd, off_t offset, size_t length, size_t *send_len_out_nullable = NULL) = 0;
+
     virtual struct Error sleep(double seconds) = 0;
     virtual struct Error sleep(struct timeval &sleep_time) = 0;
     virtual struct Error sleep_milisecs(unsigned mili_secs) = 0;
@@ -460,8 +729,17 @@ public:
     virtual struct Error connect_in_mimlisecs(const std::string &target_address, unsigned target_port, unsigned timeout_milisecs) = 0;
     virtual struct Error connect_in_mimlisecs(const char *target_address, unsigned target_port, unsigned timeout_milisecs) = 0;
 
+    // happy eyeballs (RFC 8305): IPv4 and IPv6 candidates are tried in parallel, each new attempt starts after
+    // attempt delay or when previous one fails. First established connection wins and network type follows it
+    virtual struct Error connect_any(const std::vector<struct sockaddr_storage> &addresses, double timeout_seconds = 0, double attempt_delay_seconds = 0.25) = 0;
+    virtual struct Error connect_any(const std::vector<std::string> &target_addresses, unsigned target_port, double timeout_seconds = 0, double attempt_delay_seconds = 0.25) = 0;
+
     virtual struct Error send(const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL) = 0;
 
+    // connect with TCP fast open, data is carried in SYN if server cookie is cached. Falls back to connect() and send() if not supported
+    virtual struct Error connect_and_send(const struct sockaddr *addr, socklen_t addr_len, const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL, double timeout_seconds = 0) = 0;
+    virtual struct Error connect_and_send(const std::string &target_address, unsigned target_port, const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL, double timeout_seconds = 0) = 0;
+
     virtual struct Error recv(void *data_out, const size_t len_limit, size_t *len_out_nullable, double timeout_seconds) = 0;
     virtual struct Error recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out_nullable, const struct timeval &timeout) = 0;
     virtual struct Error recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out_nullable, unsigned timeout_milisecs) = 0;
@@ -471,6 +749,112 @@ public:
     virtual void copy_remote_addr(struct sockaddr *addr_out, socklen_t addr_len) = 0;
 
     virtual Procedure *owner_server() = 0;
+
+    // TLS client handshake after connected. Server name is used for SNI and certificate verification
+    virtual struct Error start_tls(TLSContext *context, const std::string &server_name = "", double timeout_seconds = 0) = 0;
+    virtual BOOL is_tls() = 0;
+    virtual BOOL is_ktls() = 0;
+};
+
+
+// ====================
+// ConnectionPool, one per Base, see Base::connection_pool()
+class ConnectionPool {
+public:
+    ConnectionPool(){};
+    virtual ~ConnectionPool(){};
+
+    virtual void set_max_idle_per_remote(size_t count) = 0;         // 0 means no idle connection is kept
+    virtual size_t max_idle_per_remote() = 0;
+    virtual void set_max_active_per_remote(size_t count) = 0;       // 0 means unlimited
+    virtual size_t max_active_per_remote() = 0;
+    virtual void set_idle_timeout(double seconds) = 0;              // 0 means never expire
+    virtual double idle_timeout() = 0;
+
+    virtual size_t idle_count() = 0;
+    virtual size_t active_count() = 0;
+    virtual void purge_idle() = 0;      // close all idle connections
+};
+
+
+// ====================
+// DNSCache, one per Base, see Base::dns_cache(). Host names passed to TCPClient::connect_to_server() and
+// UDPClient::send() are resolved here. Records are kept for their TTL and handed out in round robin
+class DNSCache {
+public:
+    DNSCache(){};
+    virtual ~DNSCache(){};
+
+    // IPv4 or IPv6 server, A and AAAA records are both asked over it. Empty means system default
+    virtual void set_dns_server(const std::string &dns_server_ip) = 0;
+    virtual const std::string &dns_server() = 0;
+    virtual void set_max_ttl(time_t seconds) = 0;       // 0 means TTL of records
+    virtual time_t max_ttl() = 0;
+    virtual void set_negative_ttl(time_t seconds) = 0;  // how long a failed lookup is remembered, 0 means not at all
+    virtual time_t negative_ttl() = 0;
+
+    virtual size_t entry_count() = 0;
+    virtual uint64_t hit_count() = 0;
+    virtual uint64_t miss_count() = 0;
+    virtual void purge() = 0;
+};
+
+
+// ====================
+// DatagramPool
+// Reusable receive buffers of one Base. UDP session mode servers receive datagrams into them and hand them over
+// to sessions without copying, so no large buffer is placed on coroutine stacks
+class DatagramPool {
+public:
+    DatagramPool(){};
+    virtual ~DatagramPool(){};
+
+    // size of each buffer, default 65536. Longer datagrams are truncated. Datagrams shorter than 2048 bytes queued
+    // in UDP sessions are copied into buffers of that size
+    virtual void set_max_datagram_size(size_t size) = 0;
+    virtual size_t max_datagram_size() = 0;
+    virtual void set_max_idle_buffers(size_t count) = 0;  // released buffers kept for reuse, default 64
+    virtual size_t max_idle_buffers() = 0;
+
+    virtual size_t idle_count() = 0;
+    virtual size_t in_use_count() = 0;
+};
+
+
+// ====================
+// UDPTransactor, one per Base and network type, see Base::udp_transactor(). Request/response exchanges of all
+// coroutines in the Base share one UDP socket. Replies are routed to waiting coroutines by remote address and
+// transaction id, which is read from datagrams by a user function. Requests are retransmitted with exponential backoff
+
+// Returns FALSE if datagram carries no transaction id. Applied to both requests and replies
+typedef BOOL (*UDPTransactionIdFunc)(const void *data, size_t data_len, uint64_t *id_out, void *user_arg);
+
+class UDPTransactor {
+public:
+    UDPTransactor(){};
+    virtual ~UDPTransactor(){};
+
+    virtual void set_transaction_id_func(UDPTransactionIdFunc func, void *user_arg = NULL) = 0;    // required
+
+    // first retransmission after initial_rto seconds, doubled each time up to max_rto. Default 0.5, 4.0 and 5 times.
+    // 0 max_retransmits means requests are sent only once
+    virtual void set_retransmission(double initial_rto, double max_rto, unsigned max_retransmits) = 0;
+    virtual double initial_rto() = 0;
+    virtual double max_rto() = 0;
+    virtual unsigned max_retransmits() = 0;
+
+    // Send request and wait for reply with the same transaction id from target, can ONLY be invoked inside coroutine
+    // of procedure. Returns ERR_TIMEOUT if no reply in timeout_seconds, longer reply is truncated to reply_limit
+    virtual struct Error transact(Procedure *procedure, const struct sockaddr *addr, socklen_t addr_len,
+                                const void *request, size_t request_len,
+                                void *reply_out, size_t reply_limit, size_t *reply_len_out_nullable, double timeout_seconds) = 0;
+    virtual struct Error transact(Procedure *procedure, const std::string &target_address, unsigned target_port,
+                                const void *request, size_t request_len,
+                                void *reply_out, size_t reply_limit, size_t *reply_len_out_nullable, double timeout_seconds) = 0;
+
+    virtual size_t pending_count() = 0;
+    virtual uint64_t retransmit_count() = 0;
+    virtual uint64_t unmatched_count() = 0;     // replies with no waiting request, e.g. duplicated or too late
 };
 
 
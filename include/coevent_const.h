@@ -48,6 +48,23 @@ typedef enum {
 
     ERR_DNS_SERVER_IP_NOT_FOUND,
 
+    ERR_POOL_EXHAUSTED,
+    ERR_SESSION_REAPED,
+
+    ERR_FRAME_TOO_LARGE,
+    ERR_FRAME_CHECKSUM,
+
+    ERR_OUTBOUND_FULL,
+
+    ERR_TLS_NOT_SUPPORTED,
+    ERR_TLS_HANDSHAKE,
+    ERR_TLS_IO,
+
+    ERR_DNS_HOST_NOT_FOUND,
+    ERR_DNS_SERVER_FAILURE,
+
+    ERR_INBOUND_FULL,
+
     ERR_UNKNOWN     // should place at last
 } ErrCode_t;
 
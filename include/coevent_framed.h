@@ -0,0 +1,303 @@
+// file encoding: UTF-8
+
+#ifndef __CO_EVENT_FRAMED_H__
+#define __CO_EVENT_FRAMED_H__
+
+#include "coevent.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace andrewmc {
+namespace libcoevent {
+
+// ====================
+// CRC32C (Castagnoli), computed by SSE4.2 instruction if CPU supports
+uint32_t crc32c(const void *data, size_t length, uint32_t crc = 0);
+
+
+// ====================
+// length prefix codec. Frame layout:
+//   [length header, HeaderBytes] [payload, length bytes] [CRC32C of payload, 4 bytes, optional]
+// CRC32C uses the same byte order as length header
+
+typedef enum {
+    FrameBigEndian = 0,
+    FrameLittleEndian,
+} FrameByteOrder_t;
+
+// only 1, 2, 4 and 8 bytes length headers are supported
+template <size_t HeaderBytes> struct FrameHeaderSupported;
+template <> struct FrameHeaderSupported<1> { enum { value = 1 }; };
+template <> struct FrameHeaderSupported<2> { enum { value = 1 }; };
+template <> struct FrameHeaderSupported<4> { enum { value = 1 }; };
+template <> struct FrameHeaderSupported<8> { enum { value = 1 }; };
+
+
+template <size_t HeaderBytes, FrameByteOrder_t ByteOrder = FrameBigEndian, uint64_t MaxFrameSize = 1048576, BOOL WithCRC32C = FALSE>
+class LengthPrefixCodec {
+public:
+    enum {
+        header_size = HeaderBytes,
+        trailer_size = WithCRC32C ? 4 : 0,
+        _header_check = FrameHeaderSupported<HeaderBytes>::value
+    };
+
+    static uint64_t max_frame_size() {
+        return MaxFrameSize;
+    }
+
+    static uint64_t decode(const uint8_t *bytes, size_t size) {
+        uint64_t value = 0;
+        for (size_t index = 0; index < size; index ++) {
+            if (FrameBigEndian == ByteOrder) {
+                value = (value << 8) | bytes[index];
+            } else {
+                value |= ((uint64_t)bytes[index]) << (8 * index);
+            }
+        }
+        return value;
+    }
+
+    static void encode(uint64_t value, uint8_t *bytes_out, size_t size) {
+        for (size_t index = 0; index < size; index ++) {
+            if (FrameBigEndian == ByteOrder) {
+                bytes_out[size - 1 - index] = (uint8_t)(value >> (8 * index));
+            } else {
+                bytes_out[index] = (uint8_t)(value >> (8 * index));
+            }
+        }
+        return;
+    }
+
+    static uint64_t decode_length(const uint8_t *header) {
+        return decode(header, HeaderBytes);
+    }
+
+    static void encode_length(uint64_t length, uint8_t *header_out) {
+        encode(length, header_out, HeaderBytes);
+        return;
+    }
+
+    static BOOL check_payload(const uint8_t *payload, size_t length) {
+        if (WithCRC32C) {
+            return (decode(payload + length, 4) == (uint64_t)crc32c(payload, length)) ? TRUE : FALSE;
+        }
+        return TRUE;
+    }
+
+    static void sign_payload(const uint8_t *payload, size_t length, uint8_t *trailer_out) {
+        if (WithCRC32C) {
+            encode(crc32c(payload, length), trailer_out, 4);
+        }
+        return;
+    }
+};
+
+
+// ====================
+// frame received, pointing into read buffer of the framed connection. Valid until next recv_frame()
+struct FrameView {
+    const void  *data;
+    size_t      length;
+};
+
+
+// write a whole buffer to the connection
+inline struct Error framed_write_all(TCPSession *session, const void *data, size_t length)
+{
+    size_t total_sent = 0;
+    struct Error status;
+    while (total_sent < length) {
+        size_t sent = 0;
+        status = session->reply((const uint8_t *)data + total_sent, length - total_sent, &sent);
+        if (status.is_error()) {
+            break;
+        }
+        total_sent += sent;
+    }
+    return status;
+}
+
+inline struct Error framed_write_all(TCPClient *client, const void *data, size_t length)
+{
+    return client->send(data, length);
+}
+
+
+// framed connection over TCPSession or TCPClient. Connection is NOT owned by this object
+template <class Codec, class Connection>
+class FramedConnection {
+protected:
+    Connection  *_connection;
+    struct Error _status;
+
+    uint8_t     *_read_buff;
+    size_t      _read_buff_size;
+    size_t      _data_start;        // first unconsumed byte
+    size_t      _data_end;
+    size_t      _frame_to_consume;  // bytes of frame returned by last recv_frame()
+
+    uint8_t     *_send_buff;
+    size_t      _send_buff_size;
+
+public:
+    FramedConnection(Connection *connection):
+        _connection(connection),
+        _read_buff(NULL), _read_buff_size(0), _data_start(0), _data_end(0), _frame_to_consume(0),
+        _send_buff(NULL), _send_buff_size(0)
+    {}
+
+    virtual ~FramedConnection() {
+        free(_read_buff);
+        free(_send_buff);
+    }
+
+    Connection *connection() {
+        return _connection;
+    }
+
+    struct Error status() {
+        return _status;
+    }
+
+    // read a whole frame. Timeout applies to each read from the connection. ERR_NOT_CONNECTED if remote closed
+    struct Error recv_frame(struct FrameView *frame_out, double timeout_seconds = 0)
+    {
+        if (NULL == frame_out) {
+            _status.set_app_errno(ERR_PARA_NULL);
+            return _status;
+        }
+        frame_out->data = NULL;
+        frame_out->length = 0;
+
+        // release frame returned last time
+        _data_start += _frame_to_consume;
+        _frame_to_consume = 0;
+        if (_data_start == _data_end) {
+            _data_start = 0;
+            _data_end = 0;
+        }
+
+        while (1)
+        {
+            size_t frame_size = Codec::header_size;
+            size_t available = _data_end - _data_start;
+
+            if (available >= (size_t)Codec::header_size)
+            {
+                uint64_t length = Codec::decode_length(_read_buff + _data_start);
+                if (length > Codec::max_frame_size()) {
+                    _status.set_app_errno(ERR_FRAME_TOO_LARGE);
+                    return _status;
+                }
+
+                frame_size = Codec::header_size + (size_t)length + Codec::trailer_size;
+                if (available >= frame_size)
+                {
+                    const uint8_t *payload = _read_buff + _data_start + Codec::header_size;
+                    _frame_to_consume = frame_size;
+                    if (FALSE == Codec::check_payload(payload, (size_t)length)) {
+                        _status.set_app_errno(ERR_FRAME_CHECKSUM);
+                        return _status;
+                    }
+
+                    frame_out->data = payload;
+                    frame_out->length = (size_t)length;
+                    _status.clear_err();
+                    return _status;
+                }
+            }
+
+            // need more data, make room for the whole frame
+            if (_data_start + frame_size > _read_buff_size)
+            {
+                if (_data_start > 0) {
+                    memmove(_read_buff, _read_buff + _data_start, available);
+                    _data_start = 0;
+                    _data_end = available;
+                }
+                if (frame_size > _read_buff_size) {
+                    size_t new_size = _read_buff_size ? _read_buff_size * 2 : 4096;
+                    while (new_size < frame_size) {
+                        new_size *= 2;
+                    }
+                    uint8_t *new_buff = (uint8_t *)realloc(_read_buff, new_size);
+                    if (NULL == new_buff) {
+                        throw std::bad_alloc();
+                    }
+                    _read_buff = new_buff;
+                    _read_buff_size = new_size;
+                }
+            }
+
+            size_t recv_len = 0;
+            _status = _connection->recv(_read_buff + _data_end, _read_buff_size - _data_end, &recv_len, timeout_seconds);
+            if (_status.is_error()) {
+                return _status;
+            }
+            if (0 == recv_len) {
+                _status.set_app_errno(ERR_NOT_CONNECTED);
+                return _status;
+            }
+            _data_end += recv_len;
+        }
+    }
+
+    // send payload as one frame
+    struct Error send_frame(const void *data, size_t length)
+    {
+        if (NULL == data && length > 0) {
+            _status.set_app_errno(ERR_PARA_NULL);
+            return _status;
+        }
+        if ((uint64_t)length > Codec::max_frame_size()) {
+            _status.set_app_errno(ERR_FRAME_TOO_LARGE);
+            return _status;
+        }
+
+        // header, payload and trailer are written in one call
+        size_t frame_size = Codec::header_size + length + Codec::trailer_size;
+        if (frame_size > _send_buff_size) {
+            uint8_t *new_buff = (uint8_t *)realloc(_send_buff, frame_size);
+            if (NULL == new_buff) {
+                throw std::bad_alloc();
+            }
+            _send_buff = new_buff;
+            _send_buff_size = frame_size;
+        }
+
+        Codec::encode_length((uint64_t)length, _send_buff);
+        if (length > 0) {
+            memcpy(_send_buff + Codec::header_size, data, length);
+        }
+        Codec::sign_payload(_send_buff + Codec::header_size, length, _send_buff + Codec::header_size + length);
+
+        _status = framed_write_all(_connection, _send_buff, frame_size);
+        return _status;
+    }
+};
+
+
+template <class Codec>
+class FramedSession : public FramedConnection<Codec, TCPSession> {
+public:
+    FramedSession(TCPSession *session): FramedConnection<Codec, TCPSession>(session) {}
+    virtual ~FramedSession() {}
+};
+
+
+template <class Codec>
+class FramedClient : public FramedConnection<Codec, TCPClient> {
+public:
+    FramedClient(TCPClient *client): FramedConnection<Codec, TCPClient>(client) {}
+    virtual ~FramedClient() {}
+};
+
+
+}   // end of namespace libcoevent
+}   // end of namespace andrewmc
+
+#endif  // EOF
@@ -0,0 +1,172 @@
+// file encoding: UTF-8
+
+#ifndef __CO_EVENT_HTTP_H__
+#define __CO_EVENT_HTTP_H__
+
+#include "coevent.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace andrewmc {
+namespace libcoevent {
+
+class HTTPRequest;
+class HTTPResponse;
+class HTTPServer;
+
+// ====================
+// string view into connection read buffer, valid only inside request handler
+struct HTTPStringView {
+    const char  *data;
+    size_t      length;
+
+    HTTPStringView(): data(NULL), length(0) {}
+    std::string str() const;
+    BOOL equals(const char *c_str) const;
+    BOOL equals_ignore_case(const char *c_str) const;
+};
+
+
+struct HTTPHeader {
+    HTTPStringView  name;
+    HTTPStringView  value;
+};
+
+
+// request handler
+typedef void (*HTTPHandler)(HTTPRequest &request, HTTPResponse &response, void *user_arg);
+
+
+// ====================
+// HTTPRequest, parsed in place without copying
+class HTTPRequest {
+    friend class HTTPServer;        // which parses requests
+protected:
+    HTTPStringView  _method;
+    HTTPStringView  _target;        // path and query
+    HTTPStringView  _path;
+    HTTPStringView  _query;         // without '?'
+    unsigned        _version_minor; // HTTP/1.x
+    std::vector<HTTPHeader> _headers;
+    HTTPStringView  _body;          // chunked body is decoded in place
+    BOOL            _keep_alive;
+    BOOL            _is_chunked;
+    uint64_t        _content_length;
+    TCPSession      *_session;
+public:
+    HTTPRequest();
+    void clear();
+
+    const HTTPStringView &method() const;
+    const HTTPStringView &target() const;
+    const HTTPStringView &path() const;
+    const HTTPStringView &query() const;
+    unsigned version_minor() const;
+    BOOL keep_alive() const;
+
+    size_t header_count() const;
+    const HTTPHeader &header(size_t index) const;
+    const HTTPStringView *header(const char *name) const;      // case insensitive, NULL if not found
+
+    const void *body() const;
+    size_t body_length() const;
+
+    TCPSession *session() const;
+};
+
+
+// ====================
+// HTTPResponse, buffered by default. Use write_chunk() for streaming in chunked encoding
+class HTTPResponse {
+protected:
+    int             _status_code;
+    std::string     _reason;
+    std::string     _headers;       // "Name: value\r\n" lines
+    std::string     _body;
+    BOOL            _keep_alive;
+    BOOL            _is_chunked;    // head already sent, body is streaming
+    BOOL            _is_head;       // response to HEAD, body is not sent
+    unsigned        _version_minor; // of request
+    std::string     *_out;          // connection output buffer
+    TCPSession      *_session;
+    struct Error    _status;
+public:
+    HTTPResponse();
+    void reset(TCPSession *session, std::string *out, BOOL keep_alive, unsigned version_minor = 1, BOOL is_head = FALSE);
+
+    void set_status(int status_code, const std::string &reason = "");
+    void add_header(const std::string &name, const std::string &value);
+    void set_body(const void *data, size_t length);
+    void set_body(const std::string &body);
+    void append_body(const void *data, size_t length);
+    void set_keep_alive(BOOL keep_alive);   // force closing connection after this response by FALSE
+
+    // send head with "Transfer-Encoding: chunked" on first call, then chunks. Response ends when handler returns.
+    // For HTTP/1.0 requests, data is appended to body instead
+    struct Error write_chunk(const void *data, size_t length);
+
+    int status_code() const;
+    BOOL keep_alive() const;
+
+    void finish();                  // actually protected
+    struct Error flush();           // actually protected
+private:
+    void _append_head(BOOL chunked);
+};
+
+
+// ====================
+// HTTP/1.1 server, based on TCPServer session mode. Supports keep-alive, pipelining and chunked encoding
+class HTTPServer : public TCPServer {
+protected:
+    struct _Route {
+        std::string     method;     // empty for all methods
+        std::string     path;
+        BOOL            is_prefix;
+        HTTPHandler     handler;
+        void            *user_arg;
+    };
+
+    std::vector<_Route> _routes;
+    HTTPHandler     _not_found_handler;
+    void            *_not_found_user_arg;
+    size_t          _max_header_size;
+    uint64_t        _max_body_size;
+    double          _keep_alive_timeout;
+    unsigned        _max_requests_per_connection;
+    uint64_t        _request_count;
+
+public:
+    HTTPServer();
+    virtual ~HTTPServer();
+
+    struct Error init(Base *base, const struct sockaddr *addr, socklen_t addr_len, BOOL auto_free = TRUE);
+    struct Error init(Base *base, NetType_t network_type, int bind_port = 80, BOOL auto_free = TRUE);
+
+    // path ending with '*' matches prefix, method "" matches all methods. Routes are matched in adding order. "GET" routes also match "HEAD"
+    void add_route(const std::string &method, const std::string &path, HTTPHandler handler, void *user_arg = NULL);
+    void set_not_found_handler(HTTPHandler handler, void *user_arg = NULL);
+
+    void set_max_header_size(size_t size);
+    size_t max_header_size();
+    void set_max_body_size(uint64_t size);
+    uint64_t max_body_size();
+    void set_keep_alive_timeout(double seconds);      // also timeout of reading a request
+    double keep_alive_timeout();
+    void set_max_requests_per_connection(unsigned count);     // 0 means unlimited
+    unsigned max_requests_per_connection();
+    uint64_t request_count();
+
+    void serve_session(TCPSession *session);        // actually protected
+private:
+    BOOL _dispatch(HTTPRequest &request, HTTPResponse &response);
+    static int _parse_head(const char *data, size_t head_len, HTTPRequest *request, BOOL *expect_continue);
+};
+
+
+}   // end of namespace libcoevent
+}   // end of namespace andrewmc
+
+#endif  // EOF
@@ -0,0 +1,58 @@
+// file encoding: UTF-8
+
+#ifndef __CO_EVENT_TLS_H__
+#define __CO_EVENT_TLS_H__
+
+#include "coevent.h"
+
+#include <pthread.h>
+#include <string>
+#include <map>
+
+namespace andrewmc {
+namespace libcoevent {
+
+// ====================
+// TLS configuration based on OpenSSL, available when libcoevent is built with TLS_FLAG.
+// One TLSContext can be shared by servers and clients in different Bases and threads, so that
+// session tickets issued by one of them are accepted by all.
+class TLSContext {
+protected:
+    void            *_ssl_ctx;          // SSL_CTX
+    BOOL            _is_server;
+    BOOL            _is_ktls_enabled;
+    BOOL            _is_verify_peer;
+    struct Error    _status;
+
+    // client side session resumption, keyed by server name and address
+    pthread_mutex_t _session_lock;
+    std::map<std::string, void *> _client_sessions;     // SSL_SESSION
+
+public:
+    TLSContext();
+    virtual ~TLSContext();
+
+    struct Error init_server(const std::string &cert_chain_file, const std::string &private_key_file);
+    struct Error init_client(const std::string &ca_file = "", BOOL verify_peer = TRUE);
+    BOOL is_server();
+    BOOL is_verify_peer();
+
+    // kernel TLS offload after handshake, enabled by default. Should be set before any connection.
+    // Userspace OpenSSL is used if kernel or cipher does not support kTLS
+    void set_ktls(BOOL enable);
+    BOOL ktls();
+
+    // server side, share ticket keys among processes. Length is required by OpenSSL, normally 80 bytes
+    struct Error set_ticket_keys(const void *keys, size_t keys_len);
+
+    void *native_handle();              // SSL_CTX *
+
+    void save_session(const std::string &key, void *ssl_session);   // actually protected
+    void *take_session(const std::string &key);                     // actually protected, reference is held for caller
+};
+
+
+}   // end of namespace libcoevent
+}   // end of namespace andrewmc
+
+#endif  // EOF
@@ -14,6 +14,11 @@ using namespace andrewmc::libcoevent;
 Base::Base()
 {
     _event_base = event_base_new();
+    _connection_pool = NULL;
+    _dns_cache = NULL;
+    _datagram_pool = NULL;
+    _udp_transactor_ipv4 = NULL;
+    _udp_transactor_ipv6 = NULL;
 
     char identifier[64];
     sprintf(identifier, "licoevent base %p", this);
@@ -25,6 +30,24 @@ Base::Base()
 
 Base::~Base()
 {
+    // free connection pool. Pooled clients are also under control and are freed below
+    if (_connection_pool) {
+        delete _connection_pool;
+        _connection_pool = NULL;
+    }
+    if (_dns_cache) {
+        delete _dns_cache;
+        _dns_cache = NULL;
+    }
+    if (_udp_transactor_ipv4) {
+        delete _udp_transactor_ipv4;
+        _udp_transactor_ipv4 = NULL;
+    }
+    if (_udp_transactor_ipv6) {
+        delete _udp_transactor_ipv6;
+        _udp_transactor_ipv6 = NULL;
+    }
+
     // free event base
     if (_event_base) {
         event_base_free(_event_base);
@@ -40,6 +63,11 @@ Base::~Base()
     }
     _events_under_control.clear();
 
+    // buffers are released by events above
+    if (_datagram_pool) {
+        delete _datagram_pool;
+        _datagram_pool = NULL;
+    }
     return;
 }
 
@@ -111,5 +139,52 @@ void Base::delete_event_under_control(Event *event)
 }
 
 
+ConnectionPool *Base::connection_pool()
+{
+    if (NULL == _connection_pool) {
+        _connection_pool = new ConnectionItnlPool(this);
+    }
+    return _connection_pool;
+}
+
+
+DNSCache *Base::dns_cache()
+{
+    if (NULL == _dns_cache) {
+        _dns_cache = new DNSItnlCache(this);
+    }
+    return _dns_cache;
+}
+
+
+DatagramPool *Base::datagram_pool()
+{
+    if (NULL == _datagram_pool) {
+        _datagram_pool = new DatagramItnlPool();
+    }
+    return _datagram_pool;
+}
+
+
+UDPTransactor *Base::udp_transactor(NetType_t network_type)
+{
+    if (NetIPv6 == network_type) {
+        if (NULL == _udp_transactor_ipv6) {
+            _udp_transactor_ipv6 = new UDPItnlTransactor(this, NetIPv6);
+        }
+        return _udp_transactor_ipv6;
+    }
+    else if (NetIPv4 == network_type) {
+        if (NULL == _udp_transactor_ipv4) {
+            _udp_transactor_ipv4 = new UDPItnlTransactor(this, NetIPv4);
+        }
+        return _udp_transactor_ipv4;
+    }
+    else {
+        return NULL;
+    }
+}
+
+
 #endif  // end of libcoevent::Base
 
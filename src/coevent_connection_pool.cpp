@@ -0,0 +1,307 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include "cpp_tools.h"
+#include <string.h>
+#include <string>
+#include <list>
+#include <map>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+using namespace andrewmc::libcoevent;
+
+#define _DEFAULT_MAX_IDLE_PER_REMOTE    (16)
+#define _DEFAULT_MAX_ACTIVE_PER_REMOTE  (0)
+#define _DEFAULT_IDLE_TIMEOUT           (60)
+
+// ==========
+#define __CONSTRUCT_AND_DESTRUCT
+#ifdef __CONSTRUCT_AND_DESTRUCT
+
+ConnectionItnlPool::ConnectionItnlPool(Base *base)
+{
+    _owner_base = base;
+    _max_idle_per_remote = _DEFAULT_MAX_IDLE_PER_REMOTE;
+    _max_active_per_remote = _DEFAULT_MAX_ACTIVE_PER_REMOTE;
+    _idle_timeout = _DEFAULT_IDLE_TIMEOUT;
+    _idle_count = 0;
+    _active_count = 0;
+    return;
+}
+
+
+ConnectionItnlPool::~ConnectionItnlPool()
+{
+    // clients are under control of owner base, only unlink them here
+    for (std::map<TCPItnlClient *, _ClientState>::iterator each_client = _clients.begin();
+        each_client != _clients.end();
+        each_client ++)
+    {
+        each_client->first->set_connection_pool(NULL);
+    }
+    _clients.clear();
+    _remotes.clear();
+    return;
+}
+
+
+#endif  // end of __CONSTRUCT_AND_DESTRUCT
+
+
+// ==========
+#define __PARAMETERS_AND_STATISTICS
+#ifdef __PARAMETERS_AND_STATISTICS
+
+void ConnectionItnlPool::set_max_idle_per_remote(size_t count)
+{
+    _max_idle_per_remote = count;
+    return;
+}
+
+
+size_t ConnectionItnlPool::max_idle_per_remote()
+{
+    return _max_idle_per_remote;
+}
+
+
+void ConnectionItnlPool::set_max_active_per_remote(size_t count)
+{
+    _max_active_per_remote = count;
+    return;
+}
+
+
+size_t ConnectionItnlPool::max_active_per_remote()
+{
+    return _max_active_per_remote;
+}
+
+
+void ConnectionItnlPool::set_idle_timeout(double seconds)
+{
+    _idle_timeout = (seconds > 0) ? (time_t)seconds : 0;
+    if (seconds > 0 && 0 == _idle_timeout) {
+        _idle_timeout = 1;      // sys up time is counted in seconds
+    }
+    return;
+}
+
+
+double ConnectionItnlPool::idle_timeout()
+{
+    return (double)_idle_timeout;
+}
+
+
+size_t ConnectionItnlPool::idle_count()
+{
+    return _idle_count;
+}
+
+
+size_t ConnectionItnlPool::active_count()
+{
+    return _active_count;
+}
+
+
+void ConnectionItnlPool::purge_idle()
+{
+    for (std::map<std::string, _Remote>::iterator each_remote = _remotes.begin();
+        each_remote != _remotes.end();
+        each_remote ++)
+    {
+        std::list<_IdleClient> &idle = each_remote->second.idle;
+        while (FALSE == idle.empty()) {
+            TCPItnlClient *client = idle.front().client;
+            idle.pop_front();
+            _idle_count --;
+            _destroy_client(client);
+        }
+    }
+    return;
+}
+
+
+#endif  // end of __PARAMETERS_AND_STATISTICS
+
+
+// ==========
+#define __BORROW_AND_RETURN
+#ifdef __BORROW_AND_RETURN
+
+void ConnectionItnlPool::_purge_expired(_Remote &remote, time_t now)
+{
+    if (0 == _idle_timeout) {
+        return;
+    }
+
+    // oldest ones are at front
+    while (FALSE == remote.idle.empty())
+    {
+        _IdleClient &oldest = remote.idle.front();
+        if (now - oldest.idle_since < _idle_timeout) {
+            break;
+        }
+
+        TCPItnlClient *client = oldest.client;
+        DEBUG("%s idle expired", client->identifier().c_str());
+        remote.idle.pop_front();
+        _idle_count --;
+        _destroy_client(client);
+    }
+    return;
+}
+
+
+void ConnectionItnlPool::_destroy_client(TCPItnlClient *client)
+{
+    _clients.erase(client);
+    client->set_connection_pool(NULL);
+    _owner_base->delete_event_under_control(client);
+    return;
+}
+
+
+TCPItnlClient *ConnectionItnlPool::take_idle_client(const struct sockaddr *addr)
+{
+    std::map<std::string, _Remote>::iterator remote_iter = _remotes.find(sockaddr_to_key(addr));
+    if (_remotes.end() == remote_iter) {
+        return NULL;
+    }
+
+    _Remote &remote = remote_iter->second;
+    _purge_expired(remote, ::andrewmc::cpptools::sys_up_time());
+
+    // most recently returned one is warmest
+    while (FALSE == remote.idle.empty())
+    {
+        TCPItnlClient *client = remote.idle.back().client;
+        remote.idle.pop_back();
+        _idle_count --;
+
+        if (client->is_alive()) {
+            _clients[client].is_idle = FALSE;
+            remote.active ++;
+            _active_count ++;
+            return client;
+        }
+        _destroy_client(client);
+    }
+    return NULL;
+}
+
+
+BOOL ConnectionItnlPool::can_open(const struct sockaddr *addr)
+{
+    if (0 == _max_active_per_remote) {
+        return TRUE;
+    }
+
+    std::map<std::string, _Remote>::iterator remote_iter = _remotes.find(sockaddr_to_key(addr));
+    if (_remotes.end() == remote_iter) {
+        return TRUE;
+    }
+    return (remote_iter->second.active < _max_active_per_remote) ? TRUE : FALSE;
+}
+
+
+void ConnectionItnlPool::track_active_client(TCPItnlClient *client, const struct sockaddr *addr)
+{
+    _ClientState &state = _clients[client];
+    state.key = sockaddr_to_key(addr);
+    state.is_idle = FALSE;
+
+    _remotes[state.key].active ++;
+    _active_count ++;
+    client->set_connection_pool(this);
+    return;
+}
+
+
+void ConnectionItnlPool::put_back(TCPItnlClient *client, BOOL reusable)
+{
+    std::map<TCPItnlClient *, _ClientState>::iterator state_iter = _clients.find(client);
+    if (_clients.end() == state_iter)
+    {
+        // client from Procedure::new_TCP_client(), adopt it
+        struct sockaddr_storage addr;
+        client->copy_remote_addr((struct sockaddr *)&addr, sizeof(addr));
+        _ClientState &state = _clients[client];
+        state.key = sockaddr_to_key((struct sockaddr *)&addr);
+        state.is_idle = FALSE;
+        client->set_connection_pool(this);
+        _remotes[state.key].active ++;
+        _active_count ++;
+        state_iter = _clients.find(client);
+    }
+
+    _ClientState &state = state_iter->second;
+    _Remote &remote = _remotes[state.key];
+    remote.active --;
+    _active_count --;
+
+    client->detach();
+    if (FALSE == reusable || 0 == _max_idle_per_remote || FALSE == client->is_alive()) {
+        _destroy_client(client);
+        return;
+    }
+
+    // expired and overflowed ones are closed first
+    time_t now = ::andrewmc::cpptools::sys_up_time();
+    _purge_expired(remote, now);
+    while (remote.idle.size() >= _max_idle_per_remote) {
+        TCPItnlClient *oldest = remote.idle.front().client;
+        remote.idle.pop_front();
+        _idle_count --;
+        _destroy_client(oldest);
+    }
+
+    _IdleClient idle_client;
+    idle_client.client = client;
+    idle_client.idle_since = now;
+    remote.idle.push_back(idle_client);
+    state.is_idle = TRUE;
+    _idle_count ++;
+    DEBUG("%s returned to pool, %u idle", client->identifier().c_str(), (unsigned)remote.idle.size());
+    return;
+}
+
+
+void ConnectionItnlPool::forget_client(TCPItnlClient *client)
+{
+    std::map<TCPItnlClient *, _ClientState>::iterator state_iter = _clients.find(client);
+    if (_clients.end() == state_iter) {
+        return;
+    }
+
+    _Remote &remote = _remotes[state_iter->second.key];
+    if (state_iter->second.is_idle)
+    {
+        for (std::list<_IdleClient>::iterator each_idle = remote.idle.begin();
+            each_idle != remote.idle.end();
+            each_idle ++)
+        {
+            if (each_idle->client == client) {
+                remote.idle.erase(each_idle);
+                _idle_count --;
+                break;
+            }
+        }
+    }
+    else {
+        remote.active --;
+        _active_count --;
+    }
+
+    _clients.erase(state_iter);
+    return;
+}
+
+
+#endif  // end of __BORROW_AND_RETURN
+
+
+// end of file
@@ -0,0 +1,127 @@
+#include "coevent.h"
+#include "coevent_framed.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define _CRC32C_SSE42_AVAILABLE     1
+#endif
+
+using namespace andrewmc::libcoevent;
+
+#define _CRC32C_POLY_REVERSED       (0x82F63B78)
+
+// ==========
+// reference: [RFC 3720, B.4 CRC Examples](https://tools.ietf.org/html/rfc3720#appendix-B.4)
+#define __SOFTWARE_CRC32C
+#ifdef __SOFTWARE_CRC32C
+
+static uint32_t _crc32c_table[256];
+static BOOL _crc32c_table_ready = FALSE;
+
+static void _init_crc32c_table()
+{
+    for (uint32_t index = 0; index < 256; index ++)
+    {
+        uint32_t crc = index;
+        for (unsigned bit = 0; bit < 8; bit ++) {
+            crc = (crc & 1) ? ((crc >> 1) ^ _CRC32C_POLY_REVERSED) : (crc >> 1);
+        }
+        _crc32c_table[index] = crc;
+    }
+    _crc32c_table_ready = TRUE;
+    return;
+}
+
+
+static uint32_t _crc32c_software(const uint8_t *data, size_t length, uint32_t crc)
+{
+    if (FALSE == _crc32c_table_ready) {
+        _init_crc32c_table();
+    }
+
+    for (size_t index = 0; index < length; index ++) {
+        crc = _crc32c_table[(crc ^ data[index]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#endif  // end of __SOFTWARE_CRC32C
+
+
+// ==========
+#define __SSE42_CRC32C
+#ifdef __SSE42_CRC32C
+#ifdef _CRC32C_SSE42_AVAILABLE
+
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_sse42(const uint8_t *data, size_t length, uint32_t crc)
+{
+    // byte by byte until 8-byte aligned
+    while (length > 0 && ((uintptr_t)data & 7)) {
+        crc = _mm_crc32_u8(crc, *data);
+        data ++;
+        length --;
+    }
+
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+
+    while (length > 0) {
+        crc = _mm_crc32_u8(crc, *data);
+        data ++;
+        length --;
+    }
+    return crc;
+}
+
+#endif  // end of _CRC32C_SSE42_AVAILABLE
+#endif  // end of __SSE42_CRC32C
+
+
+// ==========
+#define __PUBLIC_FUNCTIONS
+#ifdef __PUBLIC_FUNCTIONS
+
+uint32_t andrewmc::libcoevent::crc32c(const void *data, size_t length, uint32_t crc)
+{
+    if (NULL == data || 0 == length) {
+        return crc;
+    }
+
+    crc = ~crc;
+#ifdef _CRC32C_SSE42_AVAILABLE
+    static int sse42_supported = -1;
+    if (sse42_supported < 0) {
+        __builtin_cpu_init();
+        sse42_supported = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    if (sse42_supported) {
+        return ~_crc32c_sse42((const uint8_t *)data, length, crc);
+    }
+#endif
+    return ~_crc32c_software((const uint8_t *)data, length, crc);
+}
+
+#endif  // end of __PUBLIC_FUNCTIONS
+
+
+// end of file
@@ -0,0 +1,195 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include <stdlib.h>
+#include <vector>
+
+using namespace andrewmc::libcoevent;
+
+#define _DEFAULT_MAX_DATAGRAM_SIZE  (65536)     // any UDP payload fits
+#define _DEFAULT_MAX_IDLE_BUFFERS   (64)
+#define _MIN_DATAGRAM_SIZE          (512)
+#define _SMALL_DATAGRAM_SIZE        (2048)      // size class for short datagrams queued in sessions
+
+// ==========
+#define __CONSTRUCT_AND_DESTRUCT
+#ifdef __CONSTRUCT_AND_DESTRUCT
+
+DatagramItnlPool::DatagramItnlPool()
+{
+    _max_datagram_size = _DEFAULT_MAX_DATAGRAM_SIZE;
+    _max_idle_buffers = _DEFAULT_MAX_IDLE_BUFFERS;
+    _in_use_count = 0;
+    return;
+}
+
+
+DatagramItnlPool::~DatagramItnlPool()
+{
+    if (_in_use_count > 0) {
+        DEBUG("%u datagram buffers are not released", (unsigned)_in_use_count);
+    }
+    for (size_t index = 0; index < _idle_buffers.size(); index ++) {
+        free(_idle_buffers[index]);
+    }
+    _idle_buffers.clear();
+    for (size_t index = 0; index < _idle_small_buffers.size(); index ++) {
+        free(_idle_small_buffers[index]);
+    }
+    _idle_small_buffers.clear();
+    return;
+}
+
+
+#endif  // end of __CONSTRUCT_AND_DESTRUCT
+
+
+// ==========
+#define __SETTINGS
+#ifdef __SETTINGS
+
+void DatagramItnlPool::set_max_datagram_size(size_t size)
+{
+    if (size < _MIN_DATAGRAM_SIZE) {
+        size = _MIN_DATAGRAM_SIZE;
+    }
+    if (size == _max_datagram_size) {
+        return;
+    }
+
+    // idle buffers of old size are useless now, buffers in use are freed when released
+    _max_datagram_size = size;
+    for (size_t index = 0; index < _idle_buffers.size(); index ++) {
+        free(_idle_buffers[index]);
+    }
+    _idle_buffers.clear();
+    for (size_t index = 0; index < _idle_small_buffers.size(); index ++) {
+        free(_idle_small_buffers[index]);
+    }
+    _idle_small_buffers.clear();
+    return;
+}
+
+
+size_t DatagramItnlPool::max_datagram_size()
+{
+    return _max_datagram_size;
+}
+
+
+void DatagramItnlPool::set_max_idle_buffers(size_t count)
+{
+    _max_idle_buffers = count;
+    while (_idle_buffers.size() > _max_idle_buffers) {
+        free(_idle_buffers.back());
+        _idle_buffers.pop_back();
+    }
+    while (_idle_small_buffers.size() > _max_idle_buffers) {
+        free(_idle_small_buffers.back());
+        _idle_small_buffers.pop_back();
+    }
+    return;
+}
+
+
+size_t DatagramItnlPool::max_idle_buffers()
+{
+    return _max_idle_buffers;
+}
+
+
+size_t DatagramItnlPool::small_datagram_size()
+{
+    return (_max_datagram_size < _SMALL_DATAGRAM_SIZE) ? _max_datagram_size : _SMALL_DATAGRAM_SIZE;
+}
+
+
+size_t DatagramItnlPool::idle_count()
+{
+    return _idle_buffers.size() + _idle_small_buffers.size();
+}
+
+
+size_t DatagramItnlPool::in_use_count()
+{
+    return _in_use_count;
+}
+
+
+#endif  // end of __SETTINGS
+
+
+// ==========
+#define __BUFFER_FUNCTIONS
+#ifdef __BUFFER_FUNCTIONS
+
+static struct DatagramBuffer *_acquire_from(std::vector<struct DatagramBuffer *> &idle_buffers, size_t capacity)
+{
+    struct DatagramBuffer *buffer = NULL;
+
+    if (idle_buffers.empty())
+    {
+        buffer = (struct DatagramBuffer *)malloc(sizeof(*buffer) + capacity);
+        if (NULL == buffer) {
+            return NULL;
+        }
+        buffer->data = (uint8_t *)(buffer + 1);
+        buffer->capacity = capacity;
+    }
+    else {
+        buffer = idle_buffers.back();
+        idle_buffers.pop_back();
+    }
+
+    buffer->length = 0;
+    return buffer;
+}
+
+
+struct DatagramBuffer *DatagramItnlPool::acquire()
+{
+    struct DatagramBuffer *buffer = _acquire_from(_idle_buffers, _max_datagram_size);
+    if (buffer) {
+        _in_use_count ++;
+    }
+    return buffer;
+}
+
+
+struct DatagramBuffer *DatagramItnlPool::acquire_small()
+{
+    if (small_datagram_size() >= _max_datagram_size) {
+        return acquire();
+    }
+
+    struct DatagramBuffer *buffer = _acquire_from(_idle_small_buffers, small_datagram_size());
+    if (buffer) {
+        _in_use_count ++;
+    }
+    return buffer;
+}
+
+
+void DatagramItnlPool::release(struct DatagramBuffer *buffer)
+{
+    if (NULL == buffer) {
+        return;
+    }
+
+    _in_use_count --;
+    if (buffer->capacity == _max_datagram_size && _idle_buffers.size() < _max_idle_buffers) {
+        _idle_buffers.push_back(buffer);
+    }
+    else if (buffer->capacity == small_datagram_size() && _idle_small_buffers.size() < _max_idle_buffers) {
+        _idle_small_buffers.push_back(buffer);
+    }
+    else {
+        free(buffer);
+    }
+    return;
+}
+
+
+#endif  // end of __BUFFER_FUNCTIONS
+
+
+// end of file
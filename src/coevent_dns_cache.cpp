@@ -0,0 +1,254 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include "cpp_tools.h"
+#include <string.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace andrewmc::libcoevent;
+
+#define _DEFAULT_MAX_TTL        (300)
+#define _DEFAULT_NEGATIVE_TTL   (5)
+#define _MAX_ENTRIES            (4096)      // expired entries are purged when exceeded
+
+// ==========
+#define __CONSTRUCT_AND_DESTRUCT
+#ifdef __CONSTRUCT_AND_DESTRUCT
+
+DNSItnlCache::DNSItnlCache(Base *base)
+{
+    _owner_base = base;
+    _max_ttl = _DEFAULT_MAX_TTL;
+    _negative_ttl = _DEFAULT_NEGATIVE_TTL;
+    _hit_count = 0;
+    _miss_count = 0;
+    return;
+}
+
+
+DNSItnlCache::~DNSItnlCache()
+{
+    _entries.clear();
+    return;
+}
+
+
+#endif  // end of __CONSTRUCT_AND_DESTRUCT
+
+
+// ==========
+#define __PARAMETERS_AND_STATISTICS
+#ifdef __PARAMETERS_AND_STATISTICS
+
+void DNSItnlCache::set_dns_server(const std::string &dns_server_ip)
+{
+    if (dns_server_ip != _dns_server) {
+        _dns_server = dns_server_ip;
+        _entries.clear();
+    }
+    return;
+}
+
+
+const std::string &DNSItnlCache::dns_server()
+{
+    return _dns_server;
+}
+
+
+void DNSItnlCache::set_max_ttl(time_t seconds)
+{
+    _max_ttl = (seconds > 0) ? seconds : 0;
+    return;
+}
+
+
+time_t DNSItnlCache::max_ttl()
+{
+    return _max_ttl;
+}
+
+
+void DNSItnlCache::set_negative_ttl(time_t seconds)
+{
+    _negative_ttl = (seconds > 0) ? seconds : 0;
+    return;
+}
+
+
+time_t DNSItnlCache::negative_ttl()
+{
+    return _negative_ttl;
+}
+
+
+size_t DNSItnlCache::entry_count()
+{
+    return _entries.size();
+}
+
+
+uint64_t DNSItnlCache::hit_count()
+{
+    return _hit_count;
+}
+
+
+uint64_t DNSItnlCache::miss_count()
+{
+    return _miss_count;
+}
+
+
+void DNSItnlCache::purge()
+{
+    _entries.clear();
+    return;
+}
+
+
+void DNSItnlCache::_purge_expired(time_t now)
+{
+    std::map<std::string, _Entry>::iterator each_entry = _entries.begin();
+    while (each_entry != _entries.end())
+    {
+        if (each_entry->second.expire_time <= now) {
+            _entries.erase(each_entry ++);
+        } else {
+            each_entry ++;
+        }
+    }
+    return;
+}
+
+
+#endif  // end of __PARAMETERS_AND_STATISTICS
+
+
+// ==========
+#define __LOOKUP_FUNCTION
+#ifdef __LOOKUP_FUNCTION
+
+struct Error DNSItnlCache::lookup(Procedure *procedure, const std::string &host_name, NetType_t network_type, double timeout_seconds, std::vector<std::string> &addresses_out)
+{
+    struct Error status;
+    addresses_out.clear();
+
+    if (NULL == procedure || host_name.empty()) {
+        status.set_app_errno(ERR_PARA_NULL);
+        return status;
+    }
+    if (NetIPv4 != network_type && NetIPv6 != network_type) {
+        status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
+        return status;
+    }
+
+    std::string key = (NetIPv4 == network_type) ? "A/" : "AAAA/";
+    key.append(host_name);
+    time_t now = ::andrewmc::cpptools::sys_up_time();
+
+    // cached
+    std::map<std::string, _Entry>::iterator entry_iter = _entries.find(key);
+    if (_entries.end() != entry_iter)
+    {
+        _Entry &entry = entry_iter->second;
+        if (entry.expire_time > now)
+        {
+            _hit_count ++;
+            if (entry.addresses.empty()) {
+                status.set_app_errno(ERR_DNS_HOST_NOT_FOUND);
+                return status;
+            }
+
+            // rotate so that callers spread over all records
+            size_t count = entry.addresses.size();
+            size_t first = entry.next % count;
+            entry.next = first + 1;
+            for (size_t index = 0; index < count; index ++) {
+                addresses_out.push_back(entry.addresses[(first + index) % count]);
+            }
+            return status;
+        }
+        _entries.erase(entry_iter);
+    }
+
+    // query in coroutine of procedure. DNS server is reached over its own network type, whatever record type
+    // is asked. Without a configured server, IPv4 name servers of system are preferred
+    _miss_count ++;
+    std::vector<NetType_t> transport_types;
+    struct in_addr addr4;
+    if (_dns_server.empty()) {
+        transport_types.push_back(NetIPv4);
+        transport_types.push_back(NetIPv6);
+    } else {
+        transport_types.push_back((1 == inet_pton(AF_INET, _dns_server.c_str(), &addr4)) ? NetIPv4 : NetIPv6);
+    }
+
+    DNSItnlClient *dns_client = NULL;
+    for (size_t index = 0; index < transport_types.size(); index ++)
+    {
+        if (dns_client) {
+            procedure->delete_client(dns_client);
+        }
+        dns_client = (DNSItnlClient *)procedure->new_DNS_client(transport_types[index]);
+        if (NULL == dns_client) {
+            status.set_app_errno(ERR_NOT_INITIALIZED);
+            return status;
+        }
+
+        dns_client->set_query_type(network_type);
+        status = dns_client->resolve(host_name, timeout_seconds, _dns_server);
+        if (ERR_DNS_SERVER_IP_NOT_FOUND != status.app_err_code()) {
+            break;
+        }
+    }
+
+    _Entry entry;
+    DNSRRType_t rr_type = (NetIPv4 == network_type) ? DnsRRType_IPv4Addr : DnsRRType_IPv6Addr;
+    time_t ttl = _negative_ttl;
+    if (status.is_ok())
+    {
+        const DNSResult *result = dns_client->dns_result(host_name);
+        for (size_t index = 0; result && index < result->resource_record_count(); index ++)
+        {
+            const DNSResourceRecord *rr = result->resource_record(index);
+            if (rr_type == rr->record_type()) {
+                entry.addresses.push_back(rr->record_address());
+            }
+        }
+        if (FALSE == entry.addresses.empty()) {
+            ttl = result->time_to_live();
+            if (_max_ttl > 0 && ttl > _max_ttl) {
+                ttl = _max_ttl;
+            }
+        } else {
+            status.set_app_errno(ERR_DNS_HOST_NOT_FOUND);
+        }
+    }
+    procedure->delete_client(dns_client);
+
+    // timeout, server failures and network errors are not remembered
+    if (ttl > 0 && (status.is_ok() || ERR_DNS_HOST_NOT_FOUND == status.app_err_code()))
+    {
+        if (_entries.size() >= _MAX_ENTRIES) {
+            _purge_expired(now);
+        }
+        if (_entries.size() < _MAX_ENTRIES) {
+            entry.expire_time = now + ttl;
+            entry.next = 1;
+            _entries[key] = entry;
+        }
+    }
+
+    DEBUG("%s resolved %u addresses, TTL %u: %s", host_name.c_str(), (unsigned)entry.addresses.size(), (unsigned)ttl, status.c_err_msg());
+    addresses_out = entry.addresses;
+    return status;
+}
+
+
+#endif  // end of __LOOKUP_FUNCTION
+
+
+// end of file
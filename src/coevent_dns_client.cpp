@@ -40,6 +40,8 @@ std::vector<NetType_t> g_DNS_network_type;
 #ifdef __CO_EVENT_DNS_CLIENT_DEFINITIONS
 
 #define _DNS_HEADER_LENGTH      (12)
+#define _DNS_RCODE_NO_ERROR     (0)
+#define _DNS_RCODE_NXDOMAIN     (3)
 
 struct _DNSQueryText
 {
@@ -186,6 +188,8 @@ void DNSItnlClient::_init()
     _identifier = identifier;
 
     _udp_client = NULL;
+    _query_ID = 0;
+    _query_type = NetUnknown;
     return;
 }
 
@@ -259,6 +263,19 @@ std::string DNSItnlClient::quick_resolve(const std::string &domain_name, double
 }
 
 
+void DNSItnlClient::set_query_type(NetType_t query_type)
+{
+    _query_type = query_type;
+    return;
+}
+
+
+NetType_t DNSItnlClient::query_type()
+{
+    return (NetUnknown == _query_type) ? network_type() : _query_type;
+}
+
+
 Procedure *DNSItnlClient::owner_server()
 {
     if (_udp_client) {
@@ -293,14 +310,20 @@ struct Error DNSItnlClient::_send_dns_request_for(const char *c_domain_name, con
     ::andrewmc::cpptools::Data query_data;
     _DNSQueryText query;
     query.set_as_query_type();
-    query.set_transaction_ID(++ _transaction_ID);
+    _query_ID = ++ _transaction_ID;
+    query.set_transaction_ID(_query_ID);
     query.set_query_name(c_domain_name);
-    query.serialize_to_data(query_data, network_type());
+    query.serialize_to_data(query_data, query_type());
 
     DEBUG("Netowrk type: %u", network_type());
 
     DEBUG("Get request data: %s", dump_data_to_string(query_data).c_str());
 
+    // connected to DNS server, so that responses from other addresses are dropped by kernel
+    _status = _udp_client->connect(addr, addr_len);
+    if (_status.is_error()) {
+        return _status;
+    }
     _status = _udp_client->send(query_data.c_data(), query_data.length(), NULL, addr, addr_len);
     return _status;
 }
@@ -321,6 +344,25 @@ void DNSItnlClient::_parse_dns_response(const uint8_t *data_buff, size_t data_le
 }
 
 
+
+// RCODE of response for the request just sent, negative if datagram is not that response
+int DNSItnlClient::_response_code(const uint8_t *data_buff, size_t data_len, size_t *answer_count_out)
+{
+    if (data_len < _DNS_HEADER_LENGTH) {
+        return -1;
+    }
+
+    uint16_t transaction_ID = ((uint16_t)data_buff[0] << 8) + data_buff[1];
+    uint16_t flags = ((uint16_t)data_buff[2] << 8) + data_buff[3];
+    uint16_t answer_rrs = ((uint16_t)data_buff[6] << 8) + data_buff[7];
+    if (transaction_ID != _query_ID || 0 == (flags & 0x8000)) {
+        return -1;
+    }
+    *answer_count_out = answer_rrs;
+    return (int)(flags & 0x000F);
+}
+
+
 #endif  // end of __PRIVATE_FUNCTIONS
 
 
@@ -424,7 +466,14 @@ struct Error DNSItnlClient::resolve_in_timeval(const std::string &domain_name, c
 
     // recv and resolve
     size_t recv_size = 0;
-    uint8_t data_buff[2048];
+    DatagramItnlPool *pool = (DatagramItnlPool *)(_udp_client->owner()->datagram_pool());
+    struct DatagramBuffer *buffer = pool->acquire();
+    if (NULL == buffer) {
+        ERROR("No memory for DNS response buffer");
+        _status.set_sys_errno(ENOMEM);
+        return _status;
+    }
+    uint8_t *data_buff = buffer->data;
     struct timeval now_time = ::andrewmc::cpptools::sys_up_timeval();
     struct timeval end_time;
     struct timeval remain_time;
@@ -449,7 +498,7 @@ struct Error DNSItnlClient::resolve_in_timeval(const std::string &domain_name, c
     // recv()
     do {
         recv_size = 0;
-        _status = _udp_client->recv_in_timeval(data_buff, sizeof(data_buff), &recv_size, remain_time);
+        _status = _udp_client->recv_in_timeval(data_buff, buffer->capacity, &recv_size, remain_time);
 
         // check recv status
         if (FALSE == _status.is_ok()) {
@@ -469,7 +518,23 @@ struct Error DNSItnlClient::resolve_in_timeval(const std::string &domain_name, c
                 should_continue_recv = FALSE;
             }
             else {
-                DEBUG("Not the DNS request we are loking for");
+                size_t answer_count = 0;
+                int rcode = _response_code(data_buff, recv_size, &answer_count);
+
+                if (_DNS_RCODE_NXDOMAIN == rcode || (_DNS_RCODE_NO_ERROR == rcode && 0 == answer_count)) {
+                    DEBUG("%s not found", domain_name.c_str());
+                    _status.set_app_errno(ERR_DNS_HOST_NOT_FOUND);
+                    should_continue_recv = FALSE;
+                }
+                else if (rcode > _DNS_RCODE_NO_ERROR) {
+                    // SERVFAIL, REFUSED, FORMERR and so on say nothing about the host name
+                    DEBUG("DNS server answered %s with RCODE %d", domain_name.c_str(), rcode);
+                    _status.set_app_errno(ERR_DNS_SERVER_FAILURE);
+                    should_continue_recv = FALSE;
+                }
+                else {
+                    DEBUG("Not the DNS request we are loking for");
+                }
             }
         }   // end of if (FALSE == _status.is_ok())
 
@@ -492,6 +557,7 @@ struct Error DNSItnlClient::resolve_in_timeval(const std::string &domain_name, c
     } while (should_continue_recv);
 
     // return
+    pool->release(buffer);
     return _status;
 }
 #endif  // end of __DNS_PUBLIC_FUNCTIONS
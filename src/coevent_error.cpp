@@ -38,6 +38,23 @@ const char *g_error_msg_list[] = {
 
     "cannot find approperate DNS server IP",
 
+    "connection pool limit reached",
+    "session closed by server for idle or lifetime limit",
+
+    "frame exceeds max frame size",
+    "frame checksum mismatch",
+
+    "outbound queue above high watermark",
+
+    "TLS is not supported in this build",
+    "TLS handshake failed",
+    "TLS protocol error",
+
+    "host name not found",
+    "DNS server failed to answer",
+
+    "inbound queue of session is full",
+
     "unknown error"     // should place at last
 };
 
@@ -0,0 +1,1116 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include "coevent_http.h"
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <new>
+
+using namespace andrewmc::libcoevent;
+
+#define _DEFAULT_MAX_HEADER_SIZE        (16 * 1024)
+#define _DEFAULT_MAX_BODY_SIZE          (1024 * 1024)
+#define _DEFAULT_KEEP_ALIVE_TIMEOUT     (15.0)
+#define _INITIAL_READ_BUFF_SIZE         (4096)
+#define _MIN_READ_SIZE                  (1024)
+#define _MAX_CHUNK_LINE_SIZE            (1024)
+#define _OUTPUT_FLUSH_THRESHOLD         (64 * 1024)
+
+// ==========
+#define __STRING_VIEW
+#ifdef __STRING_VIEW
+
+std::string HTTPStringView::str() const
+{
+    return data ? std::string(data, length) : std::string();
+}
+
+
+BOOL HTTPStringView::equals(const char *c_str) const
+{
+    size_t str_len = c_str ? strlen(c_str) : 0;
+    return (str_len == length && 0 == memcmp(data, c_str, length)) ? TRUE : FALSE;
+}
+
+
+BOOL HTTPStringView::equals_ignore_case(const char *c_str) const
+{
+    size_t str_len = c_str ? strlen(c_str) : 0;
+    return (str_len == length && 0 == strncasecmp(data, c_str, length)) ? TRUE : FALSE;
+}
+
+
+static HTTPStringView _view(const char *data, size_t length)
+{
+    HTTPStringView view;
+    view.data = data;
+    view.length = length;
+    return view;
+}
+
+
+static HTTPStringView _trim(const char *start, const char *end)
+{
+    while (start < end && (' ' == *start || '\t' == *start)) {
+        start ++;
+    }
+    while (end > start && (' ' == end[-1] || '\t' == end[-1])) {
+        end --;
+    }
+    return _view(start, end - start);
+}
+
+
+// look for a token in comma-separated header value, such as "Connection: keep-alive, Upgrade"
+static BOOL _value_has_token(const HTTPStringView &value, const char *token)
+{
+    const char *pos = value.data;
+    const char *end = value.data + value.length;
+    while (pos < end)
+    {
+        const char *comma = (const char *)memchr(pos, ',', end - pos);
+        if (NULL == comma) {
+            comma = end;
+        }
+        if (_trim(pos, comma).equals_ignore_case(token)) {
+            return TRUE;
+        }
+        pos = comma + 1;
+    }
+    return FALSE;
+}
+
+#endif  // end of __STRING_VIEW
+
+
+// ==========
+#define __HTTP_REQUEST
+#ifdef __HTTP_REQUEST
+
+HTTPRequest::HTTPRequest()
+{
+    clear();
+    return;
+}
+
+
+void HTTPRequest::clear()
+{
+    _method = HTTPStringView();
+    _target = HTTPStringView();
+    _path = HTTPStringView();
+    _query = HTTPStringView();
+    _version_minor = 1;
+    _headers.clear();
+    _body = HTTPStringView();
+    _keep_alive = TRUE;
+    _is_chunked = FALSE;
+    _content_length = 0;
+    _session = NULL;
+    return;
+}
+
+
+const HTTPStringView &HTTPRequest::method() const
+{
+    return _method;
+}
+
+
+const HTTPStringView &HTTPRequest::target() const
+{
+    return _target;
+}
+
+
+const HTTPStringView &HTTPRequest::path() const
+{
+    return _path;
+}
+
+
+const HTTPStringView &HTTPRequest::query() const
+{
+    return _query;
+}
+
+
+unsigned HTTPRequest::version_minor() const
+{
+    return _version_minor;
+}
+
+
+BOOL HTTPRequest::keep_alive() const
+{
+    return _keep_alive;
+}
+
+
+size_t HTTPRequest::header_count() const
+{
+    return _headers.size();
+}
+
+
+const HTTPHeader &HTTPRequest::header(size_t index) const
+{
+    return _headers[index];
+}
+
+
+const HTTPStringView *HTTPRequest::header(const char *name) const
+{
+    for (std::vector<HTTPHeader>::const_iterator each_header = _headers.begin();
+        each_header != _headers.end();
+        each_header ++)
+    {
+        if (each_header->name.equals_ignore_case(name)) {
+            return &(each_header->value);
+        }
+    }
+    return NULL;
+}
+
+
+const void *HTTPRequest::body() const
+{
+    return _body.data;
+}
+
+
+size_t HTTPRequest::body_length() const
+{
+    return _body.length;
+}
+
+
+TCPSession *HTTPRequest::session() const
+{
+    return _session;
+}
+
+#endif  // end of __HTTP_REQUEST
+
+
+// ==========
+#define __HTTP_RESPONSE
+#ifdef __HTTP_RESPONSE
+
+static const char *_default_reason(int status_code)
+{
+    switch (status_code)
+    {
+        case 100:   return "Continue";
+        case 200:   return "OK";
+        case 201:   return "Created";
+        case 204:   return "No Content";
+        case 301:   return "Moved Permanently";
+        case 302:   return "Found";
+        case 304:   return "Not Modified";
+        case 400:   return "Bad Request";
+        case 403:   return "Forbidden";
+        case 404:   return "Not Found";
+        case 405:   return "Method Not Allowed";
+        case 408:   return "Request Timeout";
+        case 413:   return "Payload Too Large";
+        case 431:   return "Request Header Fields Too Large";
+        case 500:   return "Internal Server Error";
+        case 501:   return "Not Implemented";
+        case 503:   return "Service Unavailable";
+        case 505:   return "HTTP Version Not Supported";
+        default:    return "Unknown";
+    }
+}
+
+
+HTTPResponse::HTTPResponse()
+{
+    reset(NULL, NULL, TRUE);
+    return;
+}
+
+
+void HTTPResponse::reset(TCPSession *session, std::string *out, BOOL keep_alive, unsigned version_minor, BOOL is_head)
+{
+    _status_code = 200;
+    _reason.clear();
+    _headers.clear();
+    _body.clear();
+    _keep_alive = keep_alive;
+    _is_chunked = FALSE;
+    _is_head = is_head;
+    _version_minor = version_minor;
+    _out = out;
+    _session = session;
+    _status.clear_err();
+    return;
+}
+
+
+void HTTPResponse::set_status(int status_code, const std::string &reason)
+{
+    _status_code = status_code;
+    _reason = reason;
+    return;
+}
+
+
+void HTTPResponse::add_header(const std::string &name, const std::string &value)
+{
+    _headers.append(name);
+    _headers.append(": ", 2);
+    _headers.append(value);
+    _headers.append("\r\n", 2);
+    return;
+}
+
+
+void HTTPResponse::set_body(const void *data, size_t length)
+{
+    _body.assign((const char *)data, length);
+    return;
+}
+
+
+void HTTPResponse::set_body(const std::string &body)
+{
+    _body = body;
+    return;
+}
+
+
+void HTTPResponse::append_body(const void *data, size_t length)
+{
+    _body.append((const char *)data, length);
+    return;
+}
+
+
+void HTTPResponse::set_keep_alive(BOOL keep_alive)
+{
+    _keep_alive = keep_alive ? _keep_alive : FALSE;
+    return;
+}
+
+
+int HTTPResponse::status_code() const
+{
+    return _status_code;
+}
+
+
+BOOL HTTPResponse::keep_alive() const
+{
+    return _keep_alive;
+}
+
+
+void HTTPResponse::_append_head(BOOL chunked)
+{
+    char line[128];
+    int line_len = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n",
+                            _status_code, _reason.empty() ? _default_reason(_status_code) : _reason.c_str());
+    _out->append(line, line_len);
+
+    if (chunked) {
+        _out->append("Transfer-Encoding: chunked\r\n");
+    }
+    else if (_status_code >= 200 && 204 != _status_code && 304 != _status_code) {
+        line_len = snprintf(line, sizeof(line), "Content-Length: %llu\r\n", (unsigned long long)_body.length());
+        _out->append(line, line_len);
+    }
+
+    if (FALSE == _keep_alive) {
+        _out->append("Connection: close\r\n");
+    } else if (0 == _version_minor) {
+        _out->append("Connection: keep-alive\r\n");
+    }
+    _out->append(_headers);
+    _out->append("\r\n", 2);
+    return;
+}
+
+
+struct Error HTTPResponse::flush()
+{
+    _status.clear_err();
+    if (_out && _session && _out->length() > 0) {
+        _status = _session->reply(_out->data(), _out->length());
+        _out->clear();
+    }
+    return _status;
+}
+
+
+struct Error HTTPResponse::write_chunk(const void *data, size_t length)
+{
+    if (NULL == _out) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (0 == length) {
+        _status.clear_err();
+        return _status;
+    }
+
+    // HTTP/1.0 does not know chunked encoding
+    if (0 == _version_minor) {
+        append_body(data, length);
+        _status.clear_err();
+        return _status;
+    }
+
+    if (FALSE == _is_chunked) {
+        _append_head(TRUE);
+        _is_chunked = TRUE;
+    }
+    if (_is_head) {
+        return flush();
+    }
+
+    char size_line[32];
+    int size_len = snprintf(size_line, sizeof(size_line), "%lx\r\n", (unsigned long)length);
+    _out->append(size_line, size_len);
+    _out->append((const char *)data, length);
+    _out->append("\r\n", 2);
+    return flush();
+}
+
+
+void HTTPResponse::finish()
+{
+    if (_is_chunked) {
+        if (FALSE == _is_head) {
+            _out->append("0\r\n\r\n", 5);
+        }
+    }
+    else {
+        _append_head(FALSE);
+        if (FALSE == _is_head) {
+            _out->append(_body);
+        }
+    }
+    _body.clear();
+    return;
+}
+
+#endif  // end of __HTTP_RESPONSE
+
+
+// ==========
+// reference: [RFC 7230, HTTP/1.1 Message Syntax and Routing](https://tools.ietf.org/html/rfc7230)
+#define __HTTP_PARSER
+#ifdef __HTTP_PARSER
+
+typedef enum {
+    _ParseOK = 0,
+    _ParseNeedMore,
+    _ParseError,
+} _ParseResult_t;
+
+typedef enum {
+    _ChunkSizeLine = 0,
+    _ChunkData,
+    _ChunkDataEnd,
+    _ChunkTrailer,
+    _ChunkDone,
+} _ChunkPhase_t;
+
+// progress of decoding chunked body, offsets are relative to request start
+struct _ChunkState {
+    _ChunkPhase_t   phase;
+    size_t          scan_pos;
+    size_t          body_end;
+    uint64_t        chunk_left;
+};
+
+
+// find "\r\n\r\n" or "\n\n", scanning from *scanned_len. Returns head length including the blank line, or 0
+static size_t _find_head_end(const char *data, size_t len, size_t *scanned_len)
+{
+    size_t pos = (*scanned_len > 3) ? *scanned_len - 3 : 0;
+    while (pos < len)
+    {
+        const char *lf = (const char *)memchr(data + pos, '\n', len - pos);
+        if (NULL == lf) {
+            break;
+        }
+        size_t lf_pos = lf - data;
+        if (lf_pos + 1 < len && '\n' == data[lf_pos + 1]) {
+            return lf_pos + 2;
+        }
+        if (lf_pos + 2 < len && '\r' == data[lf_pos + 1] && '\n' == data[lf_pos + 2]) {
+            return lf_pos + 3;
+        }
+        pos = lf_pos + 1;
+    }
+    *scanned_len = len;
+    return 0;
+}
+
+
+static BOOL _parse_uint(const HTTPStringView &value, uint64_t *value_out)
+{
+    uint64_t result = 0;
+    if (0 == value.length || value.length > 19) {
+        return FALSE;
+    }
+    for (size_t index = 0; index < value.length; index ++) {
+        char ch = value.data[index];
+        if (ch < '0' || ch > '9') {
+            return FALSE;
+        }
+        result = result * 10 + (ch - '0');
+    }
+    *value_out = result;
+    return TRUE;
+}
+
+
+// parse request line and headers, head_len is known. Error status code is returned on failure
+int HTTPServer::_parse_head(const char *data, size_t head_len, HTTPRequest *request, BOOL *expect_continue)
+{
+    const char *end = data + head_len;
+    const char *line = data;
+    BOOL has_content_length = FALSE;
+    BOOL has_connection_close = FALSE;
+    BOOL has_connection_keep_alive = FALSE;
+
+    request->clear();
+    *expect_continue = FALSE;
+
+    // request line
+    const char *lf = (const char *)memchr(line, '\n', end - line);
+    const char *line_end = (lf > line && '\r' == lf[-1]) ? lf - 1 : lf;
+    const char *sp1 = (const char *)memchr(line, ' ', line_end - line);
+    if (NULL == sp1 || sp1 == line) {
+        return 400;
+    }
+    const char *sp2 = (const char *)memchr(sp1 + 1, ' ', line_end - sp1 - 1);
+    if (NULL == sp2 || sp2 == sp1 + 1) {
+        return 400;
+    }
+
+    request->_method = _view(line, sp1 - line);
+    request->_target = _view(sp1 + 1, sp2 - sp1 - 1);
+    HTTPStringView version = _view(sp2 + 1, line_end - sp2 - 1);
+    if (version.length != 8 || 0 != memcmp(version.data, "HTTP/1.", 7)) {
+        return (version.length >= 5 && 0 == memcmp(version.data, "HTTP/", 5)) ? 505 : 400;
+    }
+    if ('0' == version.data[7]) {
+        request->_version_minor = 0;
+    } else if ('1' == version.data[7]) {
+        request->_version_minor = 1;
+    } else {
+        return 505;
+    }
+
+    const char *question = (const char *)memchr(request->_target.data, '?', request->_target.length);
+    if (question) {
+        request->_path = _view(request->_target.data, question - request->_target.data);
+        request->_query = _view(question + 1, request->_target.data + request->_target.length - question - 1);
+    } else {
+        request->_path = request->_target;
+    }
+
+    // headers
+    line = lf + 1;
+    while (line < end)
+    {
+        lf = (const char *)memchr(line, '\n', end - line);
+        line_end = (lf > line && '\r' == lf[-1]) ? lf - 1 : lf;
+        if (line_end == line) {
+            break;      // blank line
+        }
+        if (' ' == *line || '\t' == *line) {
+            return 400;     // obsolete line folding
+        }
+
+        const char *colon = (const char *)memchr(line, ':', line_end - line);
+        if (NULL == colon || colon == line || ' ' == colon[-1] || '\t' == colon[-1]) {
+            return 400;
+        }
+
+        HTTPHeader header;
+        header.name = _view(line, colon - line);
+        header.value = _trim(colon + 1, line_end);
+        request->_headers.push_back(header);
+
+        if (header.name.equals_ignore_case("Content-Length"))
+        {
+            uint64_t length = 0;
+            if (FALSE == _parse_uint(header.value, &length)) {
+                return 400;
+            }
+            if (has_content_length && length != request->_content_length) {
+                return 400;
+            }
+            has_content_length = TRUE;
+            request->_content_length = length;
+        }
+        else if (header.name.equals_ignore_case("Transfer-Encoding"))
+        {
+            if (FALSE == header.value.equals_ignore_case("chunked")) {
+                return 501;
+            }
+            request->_is_chunked = TRUE;
+        }
+        else if (header.name.equals_ignore_case("Connection"))
+        {
+            has_connection_close = has_connection_close || _value_has_token(header.value, "close");
+            has_connection_keep_alive = has_connection_keep_alive || _value_has_token(header.value, "keep-alive");
+        }
+        else if (header.name.equals_ignore_case("Expect"))
+        {
+            *expect_continue = header.value.equals_ignore_case("100-continue");
+        }
+
+        line = lf + 1;
+    }
+
+    // both framing headers is a sign of request smuggling
+    if (has_content_length && request->_is_chunked) {
+        return 400;
+    }
+
+    if (has_connection_close) {
+        request->_keep_alive = FALSE;
+    } else if (0 == request->_version_minor) {
+        request->_keep_alive = has_connection_keep_alive;
+    } else {
+        request->_keep_alive = TRUE;
+    }
+    return 0;
+}
+
+
+// decode chunked body in place, chunk data is moved forward to form a contiguous body
+static _ParseResult_t _decode_chunks(char *data, size_t len, struct _ChunkState *state, uint64_t body_limit, size_t body_start, int *err_code)
+{
+    while (_ChunkDone != state->phase)
+    {
+        size_t available = len - state->scan_pos;
+        char *pos = data + state->scan_pos;
+
+        switch (state->phase)
+        {
+            case _ChunkSizeLine:
+            case _ChunkTrailer: {
+                char *lf = (char *)memchr(pos, '\n', available);
+                if (NULL == lf) {
+                    if (available > _MAX_CHUNK_LINE_SIZE) {
+                        *err_code = 400;
+                        return _ParseError;
+                    }
+                    return _ParseNeedMore;
+                }
+                size_t line_len = lf - pos;
+                if (line_len > 0 && '\r' == pos[line_len - 1]) {
+                    line_len --;
+                }
+                state->scan_pos = lf - data + 1;
+
+                if (_ChunkTrailer == state->phase) {
+                    if (0 == line_len) {
+                        state->phase = _ChunkDone;
+                    }
+                    break;
+                }
+
+                // chunk size in hex, extensions after ';' are ignored
+                uint64_t chunk_size = 0;
+                size_t digits = 0;
+                for (digits = 0; digits < line_len; digits ++)
+                {
+                    char ch = pos[digits];
+                    unsigned value = 0;
+                    if (ch >= '0' && ch <= '9') {
+                        value = ch - '0';
+                    } else if (ch >= 'a' && ch <= 'f') {
+                        value = ch - 'a' + 10;
+                    } else if (ch >= 'A' && ch <= 'F') {
+                        value = ch - 'A' + 10;
+                    } else {
+                        break;
+                    }
+                    if (digits >= 15) {
+                        *err_code = 413;
+                        return _ParseError;
+                    }
+                    chunk_size = (chunk_size << 4) | value;
+                }
+                if (0 == digits || (digits < line_len && ';' != pos[digits] && ' ' != pos[digits] && '\t' != pos[digits])) {
+                    *err_code = 400;
+                    return _ParseError;
+                }
+
+                if (0 == chunk_size) {
+                    state->phase = _ChunkTrailer;
+                }
+                else if ((uint64_t)(state->body_end - body_start) + chunk_size > body_limit) {
+                    *err_code = 413;
+                    return _ParseError;
+                }
+                else {
+                    state->chunk_left = chunk_size;
+                    state->phase = _ChunkData;
+                }
+            }   break;
+
+            case _ChunkData: {
+                size_t move_len = (state->chunk_left < available) ? (size_t)state->chunk_left : available;
+                if (0 == move_len) {
+                    return _ParseNeedMore;
+                }
+                if (state->body_end != state->scan_pos) {
+                    memmove(data + state->body_end, pos, move_len);
+                }
+                state->body_end += move_len;
+                state->scan_pos += move_len;
+                state->chunk_left -= move_len;
+                if (0 == state->chunk_left) {
+                    state->phase = _ChunkDataEnd;
+                }
+            }   break;
+
+            case _ChunkDataEnd: {
+                if (available >= 1 && '\n' == pos[0]) {
+                    state->scan_pos += 1;
+                }
+                else if (available >= 2 && '\r' == pos[0] && '\n' == pos[1]) {
+                    state->scan_pos += 2;
+                }
+                else if (available < 2 && (0 == available || '\r' == pos[0])) {
+                    return _ParseNeedMore;
+                }
+                else {
+                    *err_code = 400;
+                    return _ParseError;
+                }
+                state->phase = _ChunkSizeLine;
+            }   break;
+
+            default:
+                *err_code = 400;
+                return _ParseError;
+        }
+    }
+    return _ParseOK;
+}
+
+#endif  // end of __HTTP_PARSER
+
+
+// ==========
+#define __HTTP_CONNECTION
+#ifdef __HTTP_CONNECTION
+
+// read buffer of one connection. Unconsumed data locates in [start, end)
+struct _ReadBuffer {
+    char        *data;
+    size_t      size;
+    size_t      start;
+    size_t      end;
+
+    _ReadBuffer(): data(NULL), size(0), start(0), end(0) {}
+    ~_ReadBuffer() {
+        free(data);
+    }
+};
+
+
+static void _consume(struct _ReadBuffer *buff, size_t length)
+{
+    buff->start += length;
+    if (buff->start >= buff->end) {
+        buff->start = 0;
+        buff->end = 0;
+    }
+    return;
+}
+
+
+// read more data, ensure that the request from start can grow to expected_len
+static struct Error _read_more(TCPSession *session, struct _ReadBuffer *buff, size_t expected_len, double timeout)
+{
+    struct Error status;
+    size_t pending = buff->end - buff->start;
+
+    if (buff->start > 0 && (buff->start + expected_len > buff->size || buff->size - buff->end < _MIN_READ_SIZE)) {
+        memmove(buff->data, buff->data + buff->start, pending);
+        buff->start = 0;
+        buff->end = pending;
+    }
+
+    if (expected_len < pending + _MIN_READ_SIZE) {
+        expected_len = pending + _MIN_READ_SIZE;
+    }
+    if (buff->start + expected_len > buff->size)
+    {
+        size_t new_size = buff->size ? buff->size : _INITIAL_READ_BUFF_SIZE;
+        while (new_size < buff->start + expected_len) {
+            new_size *= 2;
+        }
+        char *new_data = (char *)realloc(buff->data, new_size);
+        if (NULL == new_data) {
+            throw std::bad_alloc();
+        }
+        buff->data = new_data;
+        buff->size = new_size;
+    }
+
+    size_t recv_len = 0;
+    status = session->recv(buff->data + buff->end, buff->size - buff->end, &recv_len, timeout);
+    if (status.is_ok() && 0 == recv_len) {
+        status.set_app_errno(ERR_NOT_CONNECTED);
+    }
+    buff->end += recv_len;
+    return status;
+}
+
+
+static void _reply_error(TCPSession *session, std::string *out, int status_code)
+{
+    HTTPResponse response;
+    response.reset(session, out, FALSE);
+    response.set_status(status_code);
+    response.finish();
+    response.flush();
+    return;
+}
+
+#endif  // end of __HTTP_CONNECTION
+
+
+// ==========
+#define __HTTP_SERVER
+#ifdef __HTTP_SERVER
+
+static void _http_session_worker(evutil_socket_t fd, Event *event, void *arg)
+{
+    HTTPServer *server = (HTTPServer *)arg;
+    server->serve_session((TCPSession *)event);
+    return;
+}
+
+
+HTTPServer::HTTPServer()
+{
+    char identifier[64];
+    sprintf(identifier, "HTTP server %p", this);
+    _identifier = identifier;
+
+    _not_found_handler = NULL;
+    _not_found_user_arg = NULL;
+    _max_header_size = _DEFAULT_MAX_HEADER_SIZE;
+    _max_body_size = _DEFAULT_MAX_BODY_SIZE;
+    _keep_alive_timeout = _DEFAULT_KEEP_ALIVE_TIMEOUT;
+    _max_requests_per_connection = 0;
+    _request_count = 0;
+    return;
+}
+
+
+HTTPServer::~HTTPServer()
+{
+    return;
+}
+
+
+struct Error HTTPServer::init(Base *base, const struct sockaddr *addr, socklen_t addr_len, BOOL auto_free)
+{
+    return init_session_mode(base, _http_session_worker, addr, addr_len, this, auto_free);
+}
+
+
+struct Error HTTPServer::init(Base *base, NetType_t network_type, int bind_port, BOOL auto_free)
+{
+    return init_session_mode(base, _http_session_worker, network_type, bind_port, this, auto_free);
+}
+
+
+void HTTPServer::add_route(const std::string &method, const std::string &path, HTTPHandler handler, void *user_arg)
+{
+    if (NULL == handler) {
+        return;
+    }
+
+    _Route route;
+    route.method = method;
+    route.path = path;
+    route.is_prefix = FALSE;
+    route.handler = handler;
+    route.user_arg = user_arg;
+    if (path.length() > 0 && '*' == path[path.length() - 1]) {
+        route.path.resize(path.length() - 1);
+        route.is_prefix = TRUE;
+    }
+    _routes.push_back(route);
+    return;
+}
+
+
+void HTTPServer::set_not_found_handler(HTTPHandler handler, void *user_arg)
+{
+    _not_found_handler = handler;
+    _not_found_user_arg = user_arg;
+    return;
+}
+
+
+void HTTPServer::set_max_header_size(size_t size)
+{
+    _max_header_size = size ? size : _DEFAULT_MAX_HEADER_SIZE;
+    return;
+}
+
+
+size_t HTTPServer::max_header_size()
+{
+    return _max_header_size;
+}
+
+
+void HTTPServer::set_max_body_size(uint64_t size)
+{
+    _max_body_size = size;
+    return;
+}
+
+
+uint64_t HTTPServer::max_body_size()
+{
+    return _max_body_size;
+}
+
+
+void HTTPServer::set_keep_alive_timeout(double seconds)
+{
+    _keep_alive_timeout = (seconds > 0) ? seconds : 0;
+    return;
+}
+
+
+double HTTPServer::keep_alive_timeout()
+{
+    return _keep_alive_timeout;
+}
+
+
+void HTTPServer::set_max_requests_per_connection(unsigned count)
+{
+    _max_requests_per_connection = count;
+    return;
+}
+
+
+unsigned HTTPServer::max_requests_per_connection()
+{
+    return _max_requests_per_connection;
+}
+
+
+uint64_t HTTPServer::request_count()
+{
+    return _request_count;
+}
+
+
+BOOL HTTPServer::_dispatch(HTTPRequest &request, HTTPResponse &response)
+{
+    BOOL path_matched = FALSE;
+    const HTTPStringView &path = request.path();
+    BOOL is_head = request.method().equals("HEAD");     // GET routes also serve HEAD
+
+    for (std::vector<_Route>::iterator each_route = _routes.begin();
+        each_route != _routes.end();
+        each_route ++)
+    {
+        const std::string &route_path = each_route->path;
+        if (each_route->is_prefix) {
+            if (path.length < route_path.length() || 0 != memcmp(path.data, route_path.data(), route_path.length())) {
+                continue;
+            }
+        }
+        else if (path.length != route_path.length() || 0 != memcmp(path.data, route_path.data(), path.length)) {
+            continue;
+        }
+
+        path_matched = TRUE;
+        const std::string &method = each_route->method;
+        if (method.empty() || request.method().equals(method.c_str())
+            || (is_head && 0 == method.compare("GET")))
+        {
+            (each_route->handler)(request, response, each_route->user_arg);
+            return TRUE;
+        }
+    }
+
+    if (path_matched) {
+        response.set_status(405);
+    }
+    else if (_not_found_handler) {
+        _not_found_handler(request, response, _not_found_user_arg);
+    }
+    else {
+        response.set_status(404);
+    }
+    return FALSE;
+}
+
+
+void HTTPServer::serve_session(TCPSession *session)
+{
+    struct _ReadBuffer buff;
+    std::string out;
+    HTTPRequest request;
+    HTTPResponse response;
+    struct Error status;
+    unsigned served_count = 0;
+
+    while (1)
+    {
+        // ----------
+        // request head
+        size_t scanned_len = 0;
+        size_t head_len = 0;
+        while (0 == (head_len = _find_head_end(buff.data + buff.start, buff.end - buff.start, &scanned_len)))
+        {
+            if (buff.end - buff.start > _max_header_size) {
+                _reply_error(session, &out, 431);
+                return;
+            }
+
+            // responses of pipelined requests go out before blocking
+            response.reset(session, &out, TRUE);
+            if (response.flush().is_error()) {
+                return;
+            }
+            status = _read_more(session, &buff, buff.end - buff.start + _MIN_READ_SIZE, _keep_alive_timeout);
+            if (status.is_error()) {
+                DEBUG("HTTP session ends: %s", status.c_err_msg());
+                return;
+            }
+        }
+        if (head_len > _max_header_size) {
+            _reply_error(session, &out, 431);
+            return;
+        }
+
+        BOOL expect_continue = FALSE;
+        int err_code = _parse_head(buff.data + buff.start, head_len, &request, &expect_continue);
+        if (err_code) {
+            _reply_error(session, &out, err_code);
+            return;
+        }
+
+        // ----------
+        // request body
+        size_t request_len = head_len;
+        BOOL has_read_body = FALSE;
+
+        if (request._is_chunked || request._content_length > 0)
+        {
+            if (request._content_length > _max_body_size) {
+                _reply_error(session, &out, 413);
+                return;
+            }
+            if (expect_continue && buff.end - buff.start == head_len) {
+                out.append("HTTP/1.1 100 Continue\r\n\r\n");
+            }
+        }
+
+        if (request._is_chunked)
+        {
+            struct _ChunkState chunk_state;
+            chunk_state.phase = _ChunkSizeLine;
+            chunk_state.scan_pos = head_len;
+            chunk_state.body_end = head_len;
+            chunk_state.chunk_left = 0;
+
+            while (1)
+            {
+                _ParseResult_t result = _decode_chunks(buff.data + buff.start, buff.end - buff.start, &chunk_state, _max_body_size, head_len, &err_code);
+                if (_ParseOK == result) {
+                    break;
+                }
+                if (_ParseError == result) {
+                    _reply_error(session, &out, err_code);
+                    return;
+                }
+
+                response.reset(session, &out, TRUE);
+                if (response.flush().is_error()) {
+                    return;
+                }
+                status = _read_more(session, &buff, buff.end - buff.start + _MIN_READ_SIZE, _keep_alive_timeout);
+                if (status.is_error()) {
+                    return;
+                }
+                has_read_body = TRUE;
+            }
+
+            request_len = chunk_state.scan_pos;
+            request._body = _view(buff.data + buff.start + head_len, chunk_state.body_end - head_len);
+        }
+        else if (request._content_length > 0)
+        {
+            request_len = head_len + (size_t)request._content_length;
+            while (buff.end - buff.start < request_len)
+            {
+                response.reset(session, &out, TRUE);
+                if (response.flush().is_error()) {
+                    return;
+                }
+                status = _read_more(session, &buff, request_len, _keep_alive_timeout);
+                if (status.is_error()) {
+                    return;
+                }
+                has_read_body = TRUE;
+            }
+            request._body = _view(buff.data + buff.start + head_len, (size_t)request._content_length);
+        }
+
+        // buffer may be moved while reading body, parse head again to fix the views
+        if (has_read_body) {
+            HTTPStringView body = request._body;
+            body.data = buff.data + buff.start + head_len;
+            _parse_head(buff.data + buff.start, head_len, &request, &expect_continue);
+            request._body = body;
+        }
+
+        // ----------
+        // handle request
+        served_count ++;
+        _request_count ++;
+        BOOL keep_alive = request.keep_alive();
+        if (_max_requests_per_connection > 0 && served_count >= _max_requests_per_connection) {
+            keep_alive = FALSE;
+        }
+
+        request._session = session;
+        response.reset(session, &out, keep_alive, request.version_minor(), request.method().equals("HEAD"));
+        _dispatch(request, response);
+        response.finish();
+        _consume(&buff, request_len);
+
+        if (FALSE == response.keep_alive()) {
+            response.flush();
+            return;
+        }
+        if (out.length() >= _OUTPUT_FLUSH_THRESHOLD && response.flush().is_error()) {
+            return;
+        }
+    }
+
+    return;
+}
+
+#endif  // end of __HTTP_SERVER
+
+
+// end of file
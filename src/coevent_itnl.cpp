@@ -12,9 +12,24 @@
 #include <sys/time.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <string.h>
 
 using namespace andrewmc::libcoevent;
 
+#ifndef SOL_UDP
+#define SOL_UDP                 (17)
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT             (103)
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO                 (104)
+#endif
+
+#define _MAX_GSO_SEGMENTS       (64)        // UDP_MAX_SEGMENTS in kernel
+#define _MAX_UDP_PAYLOAD        (65000)     // below 65507 of IPv4, leaving room for headers
+
 // ==========
 #define __CO_EVENT_ITNL
 #ifdef __CO_EVENT_ITNL
@@ -172,6 +187,148 @@ ssize_t andrewmc::libcoevent::recv_from(int sockfd, void *buf, size_t len, int f
 }
 
 
+ssize_t andrewmc::libcoevent::send_segmented(int sockfd, const void *buf, size_t len, size_t segment_size, const struct sockaddr *addr, socklen_t addrlen)
+{
+    const uint8_t *data = (const uint8_t *)buf;
+    size_t sent_len = 0;
+    BOOL is_gso_supported = TRUE;
+
+    if (0 == segment_size || segment_size > _MAX_UDP_PAYLOAD) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // a GSO super datagram carries no more than 64 segments and 64 KB
+    size_t segments_per_call = _MAX_UDP_PAYLOAD / segment_size;
+    if (segments_per_call > _MAX_GSO_SEGMENTS) {
+        segments_per_call = _MAX_GSO_SEGMENTS;
+    }
+
+    while (sent_len < len)
+    {
+        size_t chunk_len = len - sent_len;
+        ssize_t send_ret = 0;
+
+        if (is_gso_supported && chunk_len > segment_size)
+        {
+            if (chunk_len > segments_per_call * segment_size) {
+                chunk_len = segments_per_call * segment_size;
+            }
+
+            struct iovec iov;
+            struct msghdr msg;
+            char control[CMSG_SPACE(sizeof(uint16_t))];
+            memset(&msg, 0, sizeof(msg));
+            memset(control, 0, sizeof(control));
+            iov.iov_base = (void *)(data + sent_len);
+            iov.iov_len = chunk_len;
+            msg.msg_name = (void *)addr;
+            msg.msg_namelen = addr ? addrlen : 0;
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            *((uint16_t *)CMSG_DATA(cmsg)) = (uint16_t)segment_size;
+
+            send_ret = sendmsg(sockfd, &msg, 0);
+            if (send_ret < 0 && (EIO == errno || EINVAL == errno || ENOPROTOOPT == errno || EOPNOTSUPP == errno)) {
+                DEBUG("UDP GSO not supported on fd %d, send segments one by one", sockfd);
+                is_gso_supported = FALSE;
+                continue;
+            }
+        }
+        else
+        {
+            if (chunk_len > segment_size) {
+                chunk_len = segment_size;
+            }
+            send_ret = addr ? sendto(sockfd, data + sent_len, chunk_len, 0, addr, addrlen) : send(sockfd, data + sent_len, chunk_len, 0);
+        }
+
+        if (send_ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (sent_len > 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+                break;
+            }
+            return -1;
+        }
+        sent_len += send_ret;
+    }
+
+    return (ssize_t)sent_len;
+}
+
+
+ssize_t andrewmc::libcoevent::recv_segmented(int sockfd, void *buf, size_t len, struct sockaddr *src_addr, socklen_t *addrlen, size_t *segment_size_out)
+{
+    struct iovec iov;
+    struct msghdr msg;
+    char control[CMSG_SPACE(sizeof(int))];
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_name = src_addr;
+    msg.msg_namelen = addrlen ? *addrlen : 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t ret = recvmsg(sockfd, &msg, 0);
+    if (ret < 0) {
+        if (EAGAIN == errno) {
+            DEBUG("EAGAIN");
+            return 0;
+        }
+        return ret;
+    }
+    if (addrlen) {
+        *addrlen = msg.msg_namelen;
+    }
+
+    if (segment_size_out) {
+        *segment_size_out = gro_segment_size(&msg, (size_t)ret);
+    }
+    return ret;
+}
+
+
+size_t andrewmc::libcoevent::gro_segment_size(struct msghdr *msg, size_t recv_len)
+{
+    size_t segment_size = recv_len;
+    if (NULL == msg->msg_control) {
+        return segment_size;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (SOL_UDP == cmsg->cmsg_level && UDP_GRO == cmsg->cmsg_type) {
+            if (cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+                segment_size = (size_t)(*((int *)CMSG_DATA(cmsg)));
+            } else {
+                segment_size = (size_t)(*((uint16_t *)CMSG_DATA(cmsg)));
+            }
+        }
+    }
+    return segment_size;
+}
+
+
+int andrewmc::libcoevent::set_fd_udp_gro(int fd, BOOL enable)
+{
+    int value = enable ? 1 : 0;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &value, sizeof(value));
+}
+
+
 BOOL andrewmc::libcoevent::event_is_timeout(uint32_t libevent_what)
 {
     return (libevent_what & EV_TIMEOUT) ? TRUE : FALSE;
@@ -231,6 +388,34 @@ void andrewmc::libcoevent::convert_str_to_sockaddr_un(const std::string &str, st
 }
 
 
+void andrewmc::libcoevent::convert_sockaddr_in_to_v4mapped(const struct sockaddr_in *addr, struct sockaddr_in6 *addr_out)
+{
+    if (!(addr && addr_out)) {
+        return;
+    }
+    memset(addr_out, 0, sizeof(*addr_out));
+    addr_out->sin6_family = AF_INET6;
+    addr_out->sin6_port = addr->sin_port;
+    addr_out->sin6_addr.s6_addr[10] = 0xFF;
+    addr_out->sin6_addr.s6_addr[11] = 0xFF;
+    memcpy(&(addr_out->sin6_addr.s6_addr[12]), &(addr->sin_addr), sizeof(addr->sin_addr));
+    return;
+}
+
+
+BOOL andrewmc::libcoevent::is_IP_address(const std::string &str)
+{
+    struct in6_addr addr_buff;
+    if (1 == inet_pton(AF_INET, str.c_str(), &addr_buff)) {
+        return TRUE;
+    }
+    if (1 == inet_pton(AF_INET6, str.c_str(), &addr_buff)) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+
 std::string andrewmc::libcoevent::str_from_sin_addr(const struct in_addr *addr)
 {
     if (NULL == addr) {
@@ -253,6 +438,33 @@ std::string andrewmc::libcoevent::str_from_sin6_addr(const struct in6_addr *addr
 }
 
 
+std::string andrewmc::libcoevent::sockaddr_to_key(const struct sockaddr *addr)
+{
+    std::string key;
+    if (NULL == addr) {
+        return key;
+    }
+
+    key.append((const char *)&(addr->sa_family), sizeof(addr->sa_family));
+    if (AF_INET == addr->sa_family) {
+        const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+        key.append((const char *)&(addr4->sin_port), sizeof(addr4->sin_port));
+        key.append((const char *)&(addr4->sin_addr), sizeof(addr4->sin_addr));
+    }
+    else if (AF_INET6 == addr->sa_family) {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+        key.append((const char *)&(addr6->sin6_port), sizeof(addr6->sin6_port));
+        key.append((const char *)&(addr6->sin6_addr), sizeof(addr6->sin6_addr));
+        key.append((const char *)&(addr6->sin6_scope_id), sizeof(addr6->sin6_scope_id));
+    }
+    else if (AF_UNIX == addr->sa_family) {
+        const struct sockaddr_un *addrun = (const struct sockaddr_un *)addr;
+        key.append(addrun->sun_path, strnlen(addrun->sun_path, sizeof(addrun->sun_path)));
+    }
+    return key;
+}
+
+
 #endif  // end of __CO_EVENT_ITNL
 
 
@@ -12,7 +12,12 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <stdint.h>
+#include <list>
+#include <vector>
+#include <deque>
+#include <string>
 
 namespace andrewmc {
 namespace libcoevent {
@@ -20,6 +25,9 @@ namespace libcoevent {
 // forever
 #define FOREVER_SECONDS         (3600*24*365*10)
 
+// DNS lookup on cache miss, by functions without timeout parameter like UDPClient::send()
+#define DNS_LOOKUP_TIMEOUT      (5.0)
+
 // print()
 #define CFG_PRINT_BUFF_SIZE     (1024)
 ssize_t print(int fd, const char *format, ...);
@@ -55,6 +63,13 @@ int set_fd_reuseaddr(int fd);
 // recvfrom()
 ssize_t recv_from(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
 
+// UDP GSO and GRO. addr NULL means connected socket. Falls back to one sendto() per segment without kernel GSO.
+// recv_segmented() reports segment size of GRO coalesced datagrams, or received length of single datagram
+ssize_t send_segmented(int sockfd, const void *buf, size_t len, size_t segment_size, const struct sockaddr *addr, socklen_t addrlen);
+ssize_t recv_segmented(int sockfd, void *buf, size_t len, struct sockaddr *src_addr, socklen_t *addrlen, size_t *segment_size_out);
+size_t gro_segment_size(struct msghdr *msg, size_t recv_len);     // from UDP_GRO cmsg, recv_len if there is none
+int set_fd_udp_gro(int fd, BOOL enable);
+
 // libevent flag check
 BOOL event_is_timeout(uint32_t libevent_what);
 BOOL event_readable(uint32_t libevent_what);
@@ -65,11 +80,20 @@ BOOL event_got_signal(uint32_t libevent_what);
 void convert_str_to_sockaddr_in(const std::string &str, unsigned port, struct sockaddr_in *addr_out);
 void convert_str_to_sockaddr_in6(const std::string &str, unsigned port, struct sockaddr_in6 *addr_out);
 void convert_str_to_sockaddr_un(const std::string &str, struct sockaddr_un *addr_out);
+void convert_sockaddr_in_to_v4mapped(const struct sockaddr_in *addr, struct sockaddr_in6 *addr_out);   // ::ffff:a.b.c.d
+BOOL is_IP_address(const std::string &str);      // IPv4 or IPv6 literal, otherwise a host name
 
 // sockaddr to string
 std::string str_from_sin_addr(const struct in_addr *addr);
 std::string str_from_sin6_addr(const struct in6_addr *addr6);
 
+// sockaddr to binary key, covering family, port and address only
+std::string sockaddr_to_key(const struct sockaddr *addr);
+
+class ConnectionItnlPool;
+class DatagramItnlPool;
+struct DatagramBuffer;
+
 // Actual implementation of UDPClient
 class UDPItnlClient : public UDPClient
 {
@@ -85,6 +109,9 @@ protected:
     struct sockaddr_un  _remote_addr_unix;
     socklen_t       _remote_addr_len;
     Procedure       *_owner_server;
+    BOOL            _is_connected;
+    BOOL            _is_gro;
+    size_t          _last_segment_size;
 
 public:
     UDPItnlClient();
@@ -102,6 +129,16 @@ public:
     struct Error recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out_nullable, const struct timeval &timeout);
     struct Error recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out_nullable, unsigned timeout_milisecs);
 
+    struct Error connect(const struct sockaddr *addr, socklen_t addr_len);
+    struct Error connect(const std::string &target_address, unsigned target_port = 80);
+    struct Error disconnect(void);
+    BOOL is_connected();
+
+    struct Error send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out_nullable = NULL, const struct sockaddr *addr_nullable = NULL, socklen_t addr_len = 0);
+    struct Error set_gro(BOOL enable);
+    BOOL gro();
+    struct Error recv_segmented(void *data_out, const size_t len_limit, size_t *len_out_nullable, size_t *segment_size_out, double timeout_seconds = 0);
+
     std::string default_dns_server(size_t index = 0);
 
     std::string remote_addr();    // valid in IPv4 or IPv6 type
@@ -115,6 +152,8 @@ private:
     void _clear();
 
     struct sockaddr *_remote_addr();
+    BOOL _is_connected_peer(const struct sockaddr *addr, socklen_t addr_len);
+    ssize_t _recv(void *data_out, const size_t len_limit);
 };
 
 
@@ -124,6 +163,8 @@ protected:
     std::map<std::string, DNSResult *>  _dns_result;
     UDPItnlClient                       *_udp_client;
     static uint16_t                     _transaction_ID;
+    uint16_t                            _query_ID;      // transaction ID of last request
+    NetType_t                           _query_type;    // record type asked, NetUnknown means same as network type
 
 public:
     // construct and descruct functions
@@ -140,6 +181,10 @@ public:
     // read default DNS server configured in syste
     std::string default_dns_server(size_t index = 0, NetType_t *network_type_out = NULL);
 
+    // ask for A or AAAA records independently from the network type DNS server is reached over
+    void set_query_type(NetType_t query_type);
+    NetType_t query_type();
+
     // misc functions
     const DNSResult *dns_result(const std::string &domain_name);
     std::string quick_resolve(const std::string &domain_name, double timeout_seconds = 0, const std::string &dns_server_ip = "");
@@ -154,6 +199,56 @@ private:
     void _init();
     struct Error _send_dns_request_for(const char *c_domain_name, const struct sockaddr *addr, socklen_t addr_len);
     void _parse_dns_response(const uint8_t *c_data, size_t data_len);
+    int _response_code(const uint8_t *c_data, size_t data_len, size_t *answer_count_out);
+};
+
+
+// Idle and lifetime limit of server sessions, checked once a second on a timer wheel.
+// Session activity only updates a timestamp, deadlines are re-evaluated when the slot is due.
+class SessionReaper {
+public:
+    typedef void (*ReapFunc)(Event *session, void *arg);
+
+    struct Entry {
+        Event       *session;
+        time_t      start_time;         // sys up time
+        time_t      last_active;        // sys up time
+        size_t      slot;
+        std::list<Entry *>::iterator position;
+    };
+
+protected:
+    Base                *_owner_base;
+    struct event        *_timer;
+    ReapFunc            _reap_func;
+    void                *_reap_arg;
+
+    time_t              _idle_timeout;
+    time_t              _max_lifetime;
+    time_t              _now;
+    time_t              _last_tick;
+    uint64_t            _reaped_count;
+    std::vector<std::list<Entry *> >    _slots;
+
+public:
+    SessionReaper(Base *base, ReapFunc func, void *arg);
+    virtual ~SessionReaper();
+
+    void set_idle_timeout(time_t seconds);      // 0 means never
+    void set_max_lifetime(time_t seconds);      // 0 means never
+    uint64_t reaped_count();
+
+    Entry *add(Event *session);
+    void remove(Entry *entry);
+    void touch(Entry *entry) {
+        entry->last_active = _now;
+    }
+
+    void tick();                                // actually private
+
+private:
+    time_t _deadline(const Entry *entry);
+    void _schedule(Entry *entry, time_t deadline);
 };
 
 
@@ -161,8 +256,6 @@ private:
 class UDPItnlSession : public UDPSession {
 protected:
     void        *_event_arg;
-    int         _fd;
-    struct sockaddr_storage _self_addr;
     struct sockaddr_storage _remote_addr;
     socklen_t   _remote_addr_len;
     uint32_t    *_libevent_what_storage;
@@ -170,9 +263,15 @@ protected:
     int         _server_fd;
     UDPServer   *_server;
 
-    ::andrewmc::cpptools::Data _data_buff;
-    size_t      _data_offset;
-    size_t      _data_len_to_read;
+    // datagrams forwarded by server, session coroutine is woken up directly
+    std::deque<struct DatagramBuffer *> _inbound;
+    DatagramItnlPool    *_pool;
+    struct DatagramBuffer   *_viewed;   // returned by recv_view(), released on next recv
+    BOOL        _is_recv_waiting;
+
+    SessionReaper           *_reaper;
+    SessionReaper::Entry    *_reaper_entry;
+    BOOL                    _is_reaped;
 
     void _clear();
 
@@ -189,7 +288,13 @@ public:
     struct Error recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out_nullable, const struct timeval &timeout);
     struct Error recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out_nullable, unsigned timeout_milisecs);
 
+    struct Error recv_view(const void **data_out, size_t *len_out, double timeout_seconds = 0);
+    struct Error recv_view_in_timeval(const void **data_out, size_t *len_out, const struct timeval &timeout);
+
+    struct Error send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out_nullable = NULL);
+
     struct Error forward_incoming_data(const void *c_data, size_t data_len);
+    struct Error forward_incoming_buffer(struct DatagramBuffer *buffer);     // buffer is owned by session afterward, unless ERR_INBOUND_FULL
 
     struct Error sleep(double seconds);
     struct Error sleep(struct timeval &sleep_time);
@@ -200,12 +305,47 @@ public:
     void copy_remote_addr(struct sockaddr *addr_out, socklen_t addr_len);
 
     UDPServer *server();
+    void reap();                    // closed by server for idle or lifetime limit
+    void attach_reaper(SessionReaper *reaper);     // no-op if already attached or reaped
 
 public:
     int port() const;
 
 protected:
     struct stCoRoutine_t *_coroutine();
+    void _wait_inbound(const struct timeval &timeout);
+    void _wake_receiver();
+    struct DatagramBuffer *_pop_inbound(const struct timeval &timeout);
+    void _release_viewed();
+};
+
+
+// TLS state of one TCP connection, shared by TCPItnlSession and TCPItnlClient.
+// All operations are non-blocking: when -1 is returned with *want_what_out set to EV_READ or EV_WRITE,
+// caller should wait for that event and retry with the same arguments
+class TLSItnlStream {
+protected:
+    void            *_ssl;             // SSL
+    TLSContext      *_context;
+    std::string     _session_key;
+    BOOL            _is_ktls_send;
+    BOOL            _is_ktls_recv;
+
+public:
+    TLSItnlStream();
+    virtual ~TLSItnlStream();
+
+    struct Error init(TLSContext *context, int fd, BOOL is_server, const std::string &server_name, const std::string &session_key);
+    int handshake(short *want_what_out, struct Error *status_out);     // 1 done, 0 wait, -1 error
+    ssize_t read(void *data_out, size_t len_limit, short *want_what_out, struct Error *status_out);   // 0 means closed
+    ssize_t write(const void *data, size_t data_len, short *want_what_out, struct Error *status_out);
+    ssize_t send_file(int file_fd, off_t offset, size_t length, short *want_what_out, struct Error *status_out);
+    void shutdown();                // send close_notify without waiting
+
+    BOOL is_ktls_send();
+    BOOL is_ktls_recv();
+    TLSContext *context();
+    const std::string &session_key();
 };
 
 
@@ -221,6 +361,22 @@ protected:
 
     void                    *_event_arg;
 
+    SessionReaper           *_reaper;
+    SessionReaper::Entry    *_reaper_entry;
+    BOOL                    _is_reaped;
+
+    void                    *_writer_arg;
+    std::deque<std::string> _outbound;
+    size_t                  _outbound_offset;   // bytes sent of front buffer
+    size_t                  _outbound_bytes;
+    BOOL                    _is_writer_idle;
+    BOOL                    _is_producer_waiting;
+    size_t                  _high_watermark;
+    size_t                  _low_watermark;
+    struct Error            _writer_status;
+
+    TLSItnlStream           *_tls;
+
 public:
     TCPItnlSession();
     virtual ~TCPItnlSession();
@@ -236,6 +392,15 @@ public:
 
     struct Error disconnect(void);
 
+    struct Error start_writer(void);
+    struct Error post(const void *data, const size_t data_len);
+    struct Error reply_async(const void *data, const size_t data_len);
+    size_t outbound_bytes();
+
+    void set_write_watermarks(size_t high_watermark, size_t low_watermark);
+    size_t write_high_watermark();
+    size_t write_low_watermark();
+
     struct Error sleep(double seconds);
     struct Error sleep(struct timeval &sleep_time);
     struct Error sleep_milisecs(unsigned mili_secs);
@@ -246,9 +411,34 @@ public:
 
     TCPServer *server();
     int file_descriptor();
+    void reap();                    // disconnected by server for idle or lifetime limit
+    void attach_reaper(SessionReaper *reaper);     // no-op if already attached or reaped
+
+    void run_writer();              // actually protected, body of writer coroutine
+    BOOL hold_for_writer();         // actually protected, called when session coroutine ends. TRUE if writer still has data
+
+    struct Error relay(TCPClient *client, const struct RelayOptions &options, struct RelayStats *stats_out = NULL);
+
+    struct Error start_tls(TLSContext *context, double timeout_seconds = 0);
+    BOOL is_tls();
+    BOOL is_ktls();
+    struct Error send_file(int file_fd, off_t offset, size_t length, size_t *send_len_out_nullable = NULL);
+
+    void watch_io(short what, const struct timeval *timeout_nullable);     // actually protected, wait for EV_READ and/or EV_WRITE before next yield
+    uint32_t unwatch_io();          // actually protected, stop watching and return libevent flags occurred
+
+protected:
+    struct stCoRoutine_t *_coroutine();
 
 private:
     void _clear();
+    void _clear_writer();
+    void _consume_outbound(size_t length);
+    struct Error _enqueue_outbound(const void *data, const size_t data_len);
+    void _wake_producer();
+    ssize_t _send_nonblock(const struct iovec *iov, size_t iov_count);
+    struct Error _tls_recv(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout);
+    struct Error _tls_send(const void *data, const size_t data_len, size_t *send_len_out);
 };
 
 
@@ -264,6 +454,8 @@ protected:
 
     Procedure       *_owner_server;
     uint32_t        *_libevent_what_storage;
+    ConnectionItnlPool  *_pool;
+    TLSItnlStream   *_tls;
 
 public:
     TCPItnlClient();
@@ -285,8 +477,14 @@ public:
     struct Error connect_in_mimlisecs(const std::string &target_address, unsigned target_port, unsigned timeout_milisecs);
     struct Error connect_in_mimlisecs(const char *target_address, unsigned target_port, unsigned timeout_milisecs);
 
+    struct Error connect_any(const std::vector<struct sockaddr_storage> &addresses, double timeout_seconds = 0, double attempt_delay_seconds = 0.25);
+    struct Error connect_any(const std::vector<std::string> &target_addresses, unsigned target_port, double timeout_seconds = 0, double attempt_delay_seconds = 0.25);
+
     struct Error send(const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL);
 
+    struct Error connect_and_send(const struct sockaddr *addr, socklen_t addr_len, const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL, double timeout_seconds = 0);
+    struct Error connect_and_send(const std::string &target_address, unsigned target_port, const void *data, const size_t data_len, size_t *send_len_out_nullable = NULL, double timeout_seconds = 0);
+
     struct Error recv(void *data_out, const size_t len_limit, size_t *len_out_nullable, double timeout_seconds);
     struct Error recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out_nullable, const struct timeval &timeout);
     struct Error recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out_nullable, unsigned timeout_milisecs);
@@ -296,9 +494,270 @@ public:
     void copy_remote_addr(struct sockaddr *addr_out, socklen_t addr_len);
 
     Procedure *owner_server();
+    int file_descriptor();
+
+    void watch_io(short what, const struct timeval *timeout_nullable);     // actually protected, see TCPItnlSession
+    uint32_t unwatch_io();          // actually protected
+
+    struct Error start_tls(TLSContext *context, const std::string &server_name = "", double timeout_seconds = 0);
+    BOOL is_tls();
+    BOOL is_ktls();
+
+    // connection pool support
+    BOOL is_connected();
+    BOOL is_alive();        // connected, and neither closed by remote nor holding unread data
+    void rebind(Procedure *server, struct stCoRoutine_t *coroutine, void *user_arg);
+    void detach();          // unbind from owner server and coroutine while idle in pool
+    void set_connection_pool(ConnectionItnlPool *pool);
 
 private:
     void _clear();
+    struct Error _check_connect_para(const struct sockaddr *addr, socklen_t addr_len);
+    struct Error _wait_for_connection(const struct timeval &timeout);
+    void _adopt_connection(int fd, const struct sockaddr *addr, socklen_t addr_len);
+    struct Error _connect_host_name(const std::string &host_name, unsigned target_port, const struct timeval &timeout);
+    struct Error _tls_recv(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout);
+    struct Error _tls_send(const void *data, const size_t data_len, size_t *send_len_out);
+};
+
+
+// Actual implementation of ConnectionPool
+class ConnectionItnlPool : public ConnectionPool {
+protected:
+    struct _IdleClient {
+        TCPItnlClient   *client;
+        time_t          idle_since;     // sys up time
+    };
+
+    struct _Remote {
+        std::list<_IdleClient>  idle;   // most recently returned at back
+        size_t                  active;
+        _Remote(): active(0) {}
+    };
+
+    struct _ClientState {
+        std::string     key;
+        BOOL            is_idle;
+    };
+
+    Base            *_owner_base;
+    size_t          _max_idle_per_remote;
+    size_t          _max_active_per_remote;
+    time_t          _idle_timeout;
+    size_t          _idle_count;
+    size_t          _active_count;
+    std::map<std::string, _Remote>              _remotes;
+    std::map<TCPItnlClient *, _ClientState>     _clients;
+
+public:
+    ConnectionItnlPool(Base *base);
+    virtual ~ConnectionItnlPool();
+
+    void set_max_idle_per_remote(size_t count);
+    size_t max_idle_per_remote();
+    void set_max_active_per_remote(size_t count);
+    size_t max_active_per_remote();
+    void set_idle_timeout(double seconds);
+    double idle_timeout();
+
+    size_t idle_count();
+    size_t active_count();
+    void purge_idle();
+
+    // used by Procedure
+    TCPItnlClient *take_idle_client(const struct sockaddr *addr);   // alive, and already counted as active
+    BOOL can_open(const struct sockaddr *addr);
+    void track_active_client(TCPItnlClient *client, const struct sockaddr *addr);
+    void put_back(TCPItnlClient *client, BOOL reusable);
+    void forget_client(TCPItnlClient *client);                      // invoked when client is destructed
+
+private:
+    void _purge_expired(_Remote &remote, time_t now);
+    void _destroy_client(TCPItnlClient *client);
+};
+
+
+// Actual implementation of DNSCache
+class DNSItnlCache : public DNSCache {
+protected:
+    struct _Entry {
+        std::vector<std::string>    addresses;      // empty for negative entry
+        time_t                      expire_time;    // sys up time
+        size_t                      next;           // round robin
+        _Entry(): expire_time(0), next(0) {}
+    };
+
+    Base            *_owner_base;
+    std::string     _dns_server;
+    time_t          _max_ttl;
+    time_t          _negative_ttl;
+    uint64_t        _hit_count;
+    uint64_t        _miss_count;
+    std::map<std::string, _Entry>   _entries;   // key is network type and host name
+
+public:
+    DNSItnlCache(Base *base);
+    virtual ~DNSItnlCache();
+
+    void set_dns_server(const std::string &dns_server_ip);
+    const std::string &dns_server();
+    void set_max_ttl(time_t seconds);
+    time_t max_ttl();
+    void set_negative_ttl(time_t seconds);
+    time_t negative_ttl();
+
+    size_t entry_count();
+    uint64_t hit_count();
+    uint64_t miss_count();
+    void purge();
+
+    // used by clients. Resolves in coroutine of procedure if not cached, addresses are rotated for each call
+    struct Error lookup(Procedure *procedure, const std::string &host_name, NetType_t network_type, double timeout_seconds, std::vector<std::string> &addresses_out);
+
+private:
+    void _purge_expired(time_t now);
+};
+
+
+// one buffer of DatagramPool, data follows this header in the same allocation
+struct DatagramBuffer {
+    uint8_t     *data;
+    size_t      capacity;
+    size_t      length;
+};
+
+
+// Actual implementation of DatagramPool
+class DatagramItnlPool : public DatagramPool {
+protected:
+    size_t          _max_datagram_size;
+    size_t          _max_idle_buffers;
+    size_t          _in_use_count;
+    std::vector<struct DatagramBuffer *>   _idle_buffers;
+    std::vector<struct DatagramBuffer *>   _idle_small_buffers;
+
+public:
+    DatagramItnlPool();
+    virtual ~DatagramItnlPool();
+
+    void set_max_datagram_size(size_t size);
+    size_t max_datagram_size();
+    void set_max_idle_buffers(size_t count);
+    size_t max_idle_buffers();
+
+    size_t small_datagram_size();
+    size_t idle_count();
+    size_t in_use_count();
+
+    // buffer of max_datagram_size, or of small_datagram_size() for copies of short datagrams. NULL if out of memory
+    struct DatagramBuffer *acquire();
+    struct DatagramBuffer *acquire_small();
+    void release(struct DatagramBuffer *buffer);
+};
+
+
+// Values keyed by packed (family, port, address) of remote peer and an optional 64-bit id, e.g. UDP sessions of one
+// server, or pending transactions of UDPTransactor. Open addressing with linear probing, so that a lookup on each
+// datagram needs no allocation
+class UDPPeerTable {
+public:
+    struct Key {
+        uint16_t    family;
+        uint16_t    port;           // network byte order
+        uint32_t    scope_id;       // IPv6 only
+        uint8_t     addr[16];       // IPv4 address is in the first 4 bytes
+        uint64_t    id;             // transaction id, 0 for UDP sessions
+    };
+
+protected:
+    struct _Slot {
+        struct Key  key;
+        void        *value;         // NULL for empty slot
+    };
+
+    struct _Slot    *_slots;
+    size_t          _capacity;      // power of 2
+    size_t          _count;
+
+public:
+    UDPPeerTable();
+    virtual ~UDPPeerTable();
+
+    static void make_key(const struct sockaddr *addr, struct Key *key_out, uint64_t id = 0);
+
+    void *find(const struct Key &key);
+    struct Error insert(const struct Key &key, void *value);    // replaces existing one. ENOMEM if table cannot grow
+    BOOL erase(const struct Key &key);
+    size_t size();
+    void all_values(std::vector<void *> &values_out);
+    void clear();
+
+private:
+    size_t _index_of(const struct Key &key);    // slot of key, or the empty slot where key should be
+    BOOL _resize(size_t capacity);
+};
+
+
+// Actual implementation of UDPTransactor
+class UDPItnlTransactor : public UDPTransactor {
+protected:
+    struct _Transaction {
+        UDPItnlTransactor       *transactor;
+        Procedure               *procedure;
+        struct stCoRoutine_t    *coroutine;
+        struct event            *timer;
+        uint32_t                libevent_what;      // EV_READ if replied
+        void                    *reply_out;
+        size_t                  reply_limit;
+        size_t                  reply_len;
+    };
+
+    Base            *_owner_base;
+    NetType_t       _network_type;
+    int             _fd;
+    struct event    *_event;                // persistent, reads all replies
+
+    UDPTransactionIdFunc    _id_func;
+    void                    *_id_func_arg;
+    double          _initial_rto;
+    double          _max_rto;
+    unsigned        _max_retransmits;
+    uint64_t        _retransmit_count;
+    uint64_t        _unmatched_count;
+
+    UDPPeerTable                    _pending;       // key is remote address and transaction id
+    std::vector<struct event *>     _idle_timers;
+
+public:
+    UDPItnlTransactor(Base *base, NetType_t network_type);
+    virtual ~UDPItnlTransactor();
+
+    void set_transaction_id_func(UDPTransactionIdFunc func, void *user_arg = NULL);
+    void set_retransmission(double initial_rto, double max_rto, unsigned max_retransmits);
+    double initial_rto();
+    double max_rto();
+    unsigned max_retransmits();
+
+    struct Error transact(Procedure *procedure, const struct sockaddr *addr, socklen_t addr_len,
+                        const void *request, size_t request_len,
+                        void *reply_out, size_t reply_limit, size_t *reply_len_out_nullable, double timeout_seconds);
+    struct Error transact(Procedure *procedure, const std::string &target_address, unsigned target_port,
+                        const void *request, size_t request_len,
+                        void *reply_out, size_t reply_limit, size_t *reply_len_out_nullable, double timeout_seconds);
+
+    size_t pending_count();
+    uint64_t retransmit_count();
+    uint64_t unmatched_count();
+
+    void handle_readable();         // actually protected
+    static void handle_timer(evutil_socket_t fd, short what, void *arg);   // actually protected
+
+private:
+    struct Error _open();
+    struct Error _make_key(const struct sockaddr *addr, const void *data, size_t data_len, UDPPeerTable::Key *key_out);
+    struct event *_acquire_timer(struct _Transaction *transaction);
+    void _release_timer(struct event *timer);
+    void _update_event();
 };
 
 }   // end of namespace libcoevent
@@ -8,11 +8,42 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <vector>
 
 using namespace andrewmc::libcoevent;
 
 typedef Event _super;
 
+// ==========
+// internal functions
+#define __INTERNAL_FUNCTIONS
+#ifdef __INTERNAL_FUNCTIONS
+
+static double _now()
+{
+    struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+    return to_double(now);
+}
+
+
+// time left before deadline in *timeout_seconds, which is 0 (forever) if it was. Sets ERR_TIMEOUT if none is left
+BOOL Procedure::_remaining_time(double deadline, double *timeout_seconds)
+{
+    if (*timeout_seconds <= 0) {
+        return TRUE;
+    }
+
+    *timeout_seconds = deadline - _now();
+    if (*timeout_seconds <= 0) {
+        _status.set_app_errno(ERR_TIMEOUT);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#endif  // end of __INTERNAL_FUNCTIONS
+
+
 // ==========
 // public functions
 #define __PUBLIC_FUNCTIONS
@@ -81,6 +112,150 @@ TCPClient *Procedure::new_TCP_client(NetType_t network_type, void *user_arg)
 }
 
 
+TCPClient *Procedure::borrow_TCP_client(const struct sockaddr *addr, socklen_t addr_len, double timeout_seconds, void *user_arg)
+{
+    if (NULL == _coroutine()) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return NULL;
+    }
+    if (NULL == addr) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return NULL;
+    }
+
+    NetType_t network_type = NetUnknown;
+    switch (addr->sa_family)
+    {
+        case AF_INET:
+            network_type = NetIPv4;
+            break;
+        case AF_INET6:
+            network_type = NetIPv6;
+            break;
+        case AF_UNIX:
+            network_type = NetLocal;
+            break;
+        default:
+            _status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
+            return NULL;
+            break;
+    }
+
+    ConnectionItnlPool *pool = (ConnectionItnlPool *)(owner()->connection_pool());
+
+    // reuse an idle connection
+    TCPItnlClient *client = pool->take_idle_client(addr);
+    if (client) {
+        DEBUG("Reuse %s for '%s'", client->identifier().c_str(), _identifier.c_str());
+        client->rebind(this, _coroutine(), user_arg);
+        _client_chain.insert(client);
+        _status.clear_err();
+        return (TCPClient *)client;
+    }
+
+    // or establish a new one
+    if (FALSE == pool->can_open(addr)) {
+        _status.set_app_errno(ERR_POOL_EXHAUSTED);
+        return NULL;
+    }
+
+    client = new TCPItnlClient;
+    _status = client->init(this, _coroutine(), network_type, user_arg);
+    if (_status.is_ok()) {
+        pool->track_active_client(client, addr);
+        _client_chain.insert(client);
+        _status = client->connect_to_server(addr, addr_len, timeout_seconds);
+    }
+    else {
+        ERROR("Failed to init TCP client: %s", _status.c_err_msg());
+        delete client;
+        return NULL;
+    }
+
+    if (_status.is_error()) {
+        Error status = _status;
+        delete_client(client);
+        _status = status;
+        return NULL;
+    }
+    return (TCPClient *)client;
+}
+
+
+TCPClient *Procedure::borrow_TCP_client(const std::string &target_address, unsigned target_port, double timeout_seconds, void *user_arg)
+{
+    struct sockaddr_in addr4;
+    struct sockaddr_in6 addr6;
+
+    memset(&addr4, 0, sizeof(addr4));
+    memset(&addr6, 0, sizeof(addr6));
+    if (1 == inet_pton(AF_INET, target_address.c_str(), &(addr4.sin_addr))) {
+        addr4.sin_family = AF_INET;
+        addr4.sin_port = htons((unsigned short)target_port);
+        return borrow_TCP_client((struct sockaddr *)&addr4, sizeof(addr4), timeout_seconds, user_arg);
+    }
+    else if (1 == inet_pton(AF_INET6, target_address.c_str(), &(addr6.sin6_addr))) {
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_port = htons((unsigned short)target_port);
+        return borrow_TCP_client((struct sockaddr *)&addr6, sizeof(addr6), timeout_seconds, user_arg);
+    }
+
+    // host name, IPv4 is preferred. Lookups and connects share timeout_seconds
+    std::vector<std::string> ip_list;
+    DNSItnlCache *cache = (DNSItnlCache *)(owner()->dns_cache());
+    double deadline = _now() + timeout_seconds;
+
+    _status = cache->lookup(this, target_address, NetIPv4, timeout_seconds, ip_list);
+    if (_status.is_error() && ERR_DNS_HOST_NOT_FOUND == _status.app_err_code()) {
+        if (FALSE == _remaining_time(deadline, &timeout_seconds)) {
+            return NULL;
+        }
+        _status = cache->lookup(this, target_address, NetIPv6, timeout_seconds, ip_list);
+    }
+    if (_status.is_error()) {
+        return NULL;
+    }
+
+    // next address is tried if connect fails
+    for (size_t index = 0; index < ip_list.size(); index ++)
+    {
+        if (FALSE == _remaining_time(deadline, &timeout_seconds)) {
+            return NULL;
+        }
+        TCPClient *client = borrow_TCP_client(ip_list[index], target_port, timeout_seconds, user_arg);
+        if (client) {
+            return client;
+        }
+        DEBUG("Failed to borrow TCP client for %s: %s", ip_list[index].c_str(), _status.c_err_msg());
+    }
+    return NULL;
+}
+
+
+struct Error Procedure::return_TCP_client(TCPClient *client, BOOL reusable)
+{
+    if (NULL == client) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+
+    std::set<Client *>::iterator it = _client_chain.find(client);
+    if (it == _client_chain.end()) {
+        DEBUG("Client '%s' is not in '%s'", client->identifier().c_str(), _identifier.c_str());
+        _status.set_app_errno(ERR_OBJ_NOT_FOUND);
+        return _status;
+    }
+
+    // the pool either keeps it idle or closes it
+    _client_chain.erase(it);
+    ConnectionItnlPool *pool = (ConnectionItnlPool *)(owner()->connection_pool());
+    pool->put_back((TCPItnlClient *)client, reusable);
+
+    _status.clear_err();
+    return _status;
+}
+
+
 struct Error Procedure::delete_client(Client *client)
 {
     if (NULL == client) {
@@ -122,6 +297,27 @@ Procedure::~Procedure()
 }
 
 
+void Procedure::resume_coroutine(struct stCoRoutine_t *coroutine)
+{
+    Base *base = owner();
+    co_resume(coroutine);
+
+    // is coroutine end?
+    if (is_coroutine_end(coroutine)) {
+        // delete the event if this is under control of the base
+        DEBUG("Server %s ends", identifier().c_str());
+        base->delete_event_under_control(this);
+    }
+    return;
+}
+
+
+struct stCoRoutine_t *Procedure::coroutine()
+{
+    return _coroutine();
+}
+
+
 struct stCoRoutine_t *Procedure::_coroutine()
 {
     return NULL;
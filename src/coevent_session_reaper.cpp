@@ -0,0 +1,218 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include "cpp_tools.h"
+#include <string.h>
+#include <list>
+#include <vector>
+
+using namespace andrewmc::libcoevent;
+
+#define _WHEEL_SLOT_COUNT       (64)
+#define _TICK_SECONDS           (1)
+#define _NEVER                  ((time_t)0x7FFFFFFF)
+
+// ==========
+#define __LIBEVENT_CALLBACK
+#ifdef __LIBEVENT_CALLBACK
+
+static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    SessionReaper *reaper = (SessionReaper *)libevent_arg;
+    reaper->tick();
+    return;
+}
+
+#endif
+
+
+// ==========
+#define __CONSTRUCT_AND_DESTRUCT
+#ifdef __CONSTRUCT_AND_DESTRUCT
+
+SessionReaper::SessionReaper(Base *base, ReapFunc func, void *arg)
+{
+    _owner_base = base;
+    _reap_func = func;
+    _reap_arg = arg;
+    _idle_timeout = 0;
+    _max_lifetime = 0;
+    _now = ::andrewmc::cpptools::sys_up_time();
+    _last_tick = _now;
+    _reaped_count = 0;
+    _slots.resize(_WHEEL_SLOT_COUNT);
+
+    _timer = event_new(base->event_base(), -1, EV_PERSIST, _libevent_callback, this);
+    if (NULL == _timer) {
+        ERROR("Failed to new a reaper timer");
+    }
+    else {
+        struct timeval interval = {_TICK_SECONDS, 0};
+        event_add(_timer, &interval);
+    }
+    return;
+}
+
+
+SessionReaper::~SessionReaper()
+{
+    if (_timer) {
+        event_del(_timer);
+        event_free(_timer);
+        _timer = NULL;
+    }
+
+    // sessions should have been removed by their destructors
+    for (std::vector<std::list<Entry *> >::iterator each_slot = _slots.begin();
+        each_slot != _slots.end();
+        each_slot ++)
+    {
+        for (std::list<Entry *>::iterator each_entry = each_slot->begin();
+            each_entry != each_slot->end();
+            each_entry ++)
+        {
+            delete *each_entry;
+        }
+        each_slot->clear();
+    }
+    return;
+}
+
+
+#endif  // end of __CONSTRUCT_AND_DESTRUCT
+
+
+// ==========
+#define __PARAMETERS
+#ifdef __PARAMETERS
+
+void SessionReaper::set_idle_timeout(time_t seconds)
+{
+    _idle_timeout = (seconds > 0) ? seconds : 0;
+    return;
+}
+
+
+void SessionReaper::set_max_lifetime(time_t seconds)
+{
+    _max_lifetime = (seconds > 0) ? seconds : 0;
+    return;
+}
+
+
+uint64_t SessionReaper::reaped_count()
+{
+    return _reaped_count;
+}
+
+
+#endif  // end of __PARAMETERS
+
+
+// ==========
+#define __TIMER_WHEEL
+#ifdef __TIMER_WHEEL
+
+time_t SessionReaper::_deadline(const Entry *entry)
+{
+    time_t deadline = _NEVER;
+    if (_idle_timeout > 0) {
+        deadline = entry->last_active + _idle_timeout;
+    }
+    if (_max_lifetime > 0 && entry->start_time + _max_lifetime < deadline) {
+        deadline = entry->start_time + _max_lifetime;
+    }
+    return deadline;
+}
+
+
+void SessionReaper::_schedule(Entry *entry, time_t deadline)
+{
+    // deadlines beyond one round are parked in the last slot and re-checked then
+    if (deadline > _now + _WHEEL_SLOT_COUNT - 1) {
+        deadline = _now + _WHEEL_SLOT_COUNT - 1;
+    }
+    else if (deadline <= _now) {
+        deadline = _now + 1;
+    }
+
+    entry->slot = (size_t)(deadline % _WHEEL_SLOT_COUNT);
+    std::list<Entry *> &slot = _slots[entry->slot];
+    entry->position = slot.insert(slot.end(), entry);
+    return;
+}
+
+
+SessionReaper::Entry *SessionReaper::add(Event *session)
+{
+    Entry *entry = new Entry;
+    entry->session = session;
+    entry->start_time = _now;
+    entry->last_active = _now;
+    _schedule(entry, _deadline(entry));
+    return entry;
+}
+
+
+void SessionReaper::remove(Entry *entry)
+{
+    if (NULL == entry) {
+        return;
+    }
+    _slots[entry->slot].erase(entry->position);
+    delete entry;
+    return;
+}
+
+
+void SessionReaper::tick()
+{
+    std::vector<Event *> expired_sessions;
+    time_t now = ::andrewmc::cpptools::sys_up_time();
+
+    // catch up with missed ticks, but one round at most
+    if (now - _last_tick > _WHEEL_SLOT_COUNT) {
+        _last_tick = now - _WHEEL_SLOT_COUNT;
+    }
+    _now = now;
+
+    while (_last_tick < now)
+    {
+        _last_tick ++;
+
+        // entries may be rescheduled into the same slot while catching up
+        std::list<Entry *> due_entries;
+        due_entries.swap(_slots[_last_tick % _WHEEL_SLOT_COUNT]);
+
+        while (FALSE == due_entries.empty())
+        {
+            Entry *entry = due_entries.front();
+            due_entries.pop_front();
+
+            time_t deadline = _deadline(entry);
+            if (deadline > now) {
+                _schedule(entry, deadline);
+            }
+            else {
+                expired_sessions.push_back(entry->session);
+                delete entry;
+            }
+        }
+    }
+
+    // reap after the wheel is settled, as reap function may touch other sessions
+    for (std::vector<Event *>::iterator each_session = expired_sessions.begin();
+        each_session != expired_sessions.end();
+        each_session ++)
+    {
+        DEBUG("Reap %s", (*each_session)->identifier().c_str());
+        _reaped_count ++;
+        _reap_func(*each_session, _reap_arg);
+    }
+    return;
+}
+
+
+#endif  // end of __TIMER_WHEEL
+
+
+// end of file
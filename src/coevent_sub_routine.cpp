@@ -15,6 +15,8 @@ typedef Server _super;
 static int _g_libco_arg_counter = 0;    // to detect memory leaks
 
 
+namespace {
+
 struct _EventArg {
     SubRoutine          *event;
     void                *user_arg;
@@ -32,6 +34,8 @@ struct _EventArg {
     }
 };
 
+}   // end of anonymous namespace
+
 
 #endif
 
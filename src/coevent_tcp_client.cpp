@@ -8,10 +8,15 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 
 using namespace andrewmc::libcoevent;
 
+#ifndef MSG_FASTOPEN
+#define MSG_FASTOPEN    0x20000000
+#endif
+
 // ==========
 #define __EVENT_ARG_DEFINITION
 #ifdef __EVENT_ARG_DEFINITION
@@ -38,21 +43,14 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
     struct _EventArg *arg = (struct _EventArg *)libevent_arg;
     TCPItnlClient *client = arg->client;
     Procedure *server = client->owner_server();
-    Base *base = client->owner();
+    struct stCoRoutine_t *coroutine = arg->coroutine;     // client may be deleted or returned to pool inside coroutine
 
     // switch into the coroutine
     if (arg->libevent_what_ptr) {
         *(arg->libevent_what_ptr) = (uint32_t)what;
         DEBUG("libevent what: 0x%08x - %s %s %s", (unsigned)what, event_is_timeout(what) ? "timeout " : "", event_readable(what) ? "read" : "", event_writable(what) ? "write" : "");
     }
-    co_resume(arg->coroutine);
-
-    // is coroutine end?
-    if (is_coroutine_end(arg->coroutine)) {
-        // delete the event if this is under control of the base
-        DEBUG("Server %s ends", server->identifier().c_str());
-        base->delete_event_under_control(server);
-    }
+    server->resume_coroutine(coroutine);
 
     // done
     return;
@@ -78,6 +76,8 @@ TCPItnlClient::TCPItnlClient()
     _addr_len = 0;
     _is_connected = FALSE;
     _owner_server = NULL;
+    _pool = NULL;
+    _tls = NULL;
 
     _libevent_what_storage = (uint32_t *)malloc(sizeof(*_libevent_what_storage));
     if (NULL == _libevent_what_storage) {
@@ -93,6 +93,11 @@ TCPItnlClient::TCPItnlClient()
 
 TCPItnlClient::~TCPItnlClient()
 {
+    if (_pool) {
+        _pool->forget_client(this);
+        _pool = NULL;
+    }
+
     _clear();
 
     if (_libevent_what_storage) {
@@ -116,6 +121,12 @@ void TCPItnlClient::_clear()
         _event_arg = NULL;
     }
 
+    if (_tls) {
+        _tls->shutdown();
+        delete _tls;
+        _tls = NULL;
+    }
+
     if (_fd > 0) {
         close(_fd);
         _fd = 0;
@@ -321,18 +332,116 @@ Procedure *TCPItnlClient::owner_server()
 }
 
 
+int TCPItnlClient::file_descriptor()
+{
+    return _fd;
+}
+
+
+void TCPItnlClient::watch_io(short what, const struct timeval *timeout_nullable)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (NULL == _event || NULL == arg) {
+        return;
+    }
+
+    event_del(_event);
+    event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | what, _libevent_callback, arg);
+    *_libevent_what_storage = 0;
+    if (what || timeout_nullable) {
+        event_add(_event, timeout_nullable);
+    }
+    return;
+}
+
+
+uint32_t TCPItnlClient::unwatch_io()
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (NULL == _event || NULL == arg) {
+        return 0;
+    }
+
+    uint32_t libevent_what = *_libevent_what_storage;
+    event_del(_event);
+    event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);
+    *_libevent_what_storage = 0;
+    return libevent_what;
+}
+
+
 #endif  // __MISC_FUNCTIONS
 
 
+// ==========
+#define __CONNECTION_POOL_SUPPORT
+#ifdef __CONNECTION_POOL_SUPPORT
+
+BOOL TCPItnlClient::is_connected()
+{
+    return _is_connected;
+}
+
+
+BOOL TCPItnlClient::is_alive()
+{
+    if (FALSE == _is_connected || _fd <= 0) {
+        return FALSE;
+    }
+
+    // EAGAIN means nothing happened on this connection since last use. Either EOF or
+    // stale data means that this connection should not be reused.
+    uint8_t byte = 0;
+    ssize_t peek_len = ::recv(_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+    if (peek_len < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+        return TRUE;
+    }
+
+    DEBUG("%s is not reusable, peek_len = %d", _identifier.c_str(), (int)peek_len);
+    return FALSE;
+}
+
+
+void TCPItnlClient::rebind(Procedure *server, struct stCoRoutine_t *coroutine, void *user_arg)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (arg) {
+        arg->coroutine = coroutine;
+        arg->user_arg = user_arg;
+    }
+    _owner_server = server;
+    return;
+}
+
+
+void TCPItnlClient::detach()
+{
+    if (_event) {
+        event_del(_event);
+    }
+    rebind(NULL, NULL, NULL);
+    return;
+}
+
+
+void TCPItnlClient::set_connection_pool(ConnectionItnlPool *pool)
+{
+    _pool = pool;
+    return;
+}
+
+
+#endif  // end of __CONNECTION_POOL_SUPPORT
+
+
 // ==========
 #define __TCP_CONNECT_FUNCTION
 #ifdef __TCP_CONNECT_FUNCTION
 
-// reference: [Linux socket非阻塞connect方法（一）](https://blog.csdn.net/nphyez/article/details/10268723)
-// reference: [非阻塞connect编写方法介绍](http://dongxicheng.org/network/non-block-connect-implemention/)
-struct Error TCPItnlClient::connect_in_timeval(const struct sockaddr *addr, socklen_t addr_len, const struct timeval &timeout)
+// para and instance status check before connecting
+struct Error TCPItnlClient::_check_connect_para(const struct sockaddr *addr, socklen_t addr_len)
 {
-    // para and instance status check
+    _status.clear_err();
     if (!(addr && addr_len)) {
         _status.set_app_errno(ERR_PARA_NULL);
         return _status;
@@ -358,6 +467,90 @@ struct Error TCPItnlClient::connect_in_timeval(const struct sockaddr *addr, sock
         return _status;
     }
 
+    return _status;
+}
+
+
+// wait for a non-blocking connect() in progress
+struct Error TCPItnlClient::_wait_for_connection(const struct timeval &timeout)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    int conn_stat = event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ | EV_WRITE, _libevent_callback, arg);
+    if (conn_stat) {
+        _status.set_app_errno(ERR_EVENT_UNEXPECTED_ERROR);
+        return _status;
+    }
+
+    struct timeval timeout_copy;
+    timeout_copy.tv_sec = timeout.tv_sec;
+    timeout_copy.tv_usec = timeout.tv_usec;
+    if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
+        timeout_copy.tv_sec = FOREVER_SECONDS;
+    }
+    event_add(_event, &timeout_copy);
+    co_yield(arg->coroutine);       // hand coroutine control over
+
+    // check libevent return
+    uint32_t libevent_what = *_libevent_what_storage;
+    if (event_is_timeout(libevent_what))
+    {
+        *_libevent_what_storage = 0;
+        _status.set_app_errno(ERR_TIMEOUT);
+    }
+    else if (event_writable(libevent_what) || event_readable(libevent_what))
+    {
+#if 0
+        // check status, valid in Linux ONLY
+        connect(_fd, addr, addr_len);
+        int err_copy = errno;
+        if (EISCONN == err_copy) {
+            // success
+            DEBUG("Connect TCP via libevent successed");
+            _status.clear_err();
+        }
+        else {
+            DEBUG("Failed to connect via libevent: %s", strerror(err_copy));
+            _status.set_sys_errno(err_copy);
+        }
+#else
+        int err = 0;
+        socklen_t errlen = sizeof(err);
+        conn_stat = getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+        if (conn_stat < 0) {
+            _status.set_sys_errno();
+            ERROR("Failed in getsockopt: %s", strerror(errno));
+        }
+        else {
+            if (0 == err) {
+                DEBUG("Connect TCP via libevent successed");
+                _status.clear_err();
+            }
+            else {
+                DEBUG("Failed to connect via libevent: %d", err);
+                _status.set_sys_errno(err);
+            }
+        }
+#endif
+    }
+    else {
+        ERROR("unrecognized event flag: 0x%04u", (unsigned)libevent_what);
+        *_libevent_what_storage = 0;
+        _status.set_app_errno(ERR_UNKNOWN);
+    }
+
+    return _status;
+}
+
+
+// reference: [Linux socket非阻塞connect方法（一）](https://blog.csdn.net/nphyez/article/details/10268723)
+// reference: [非阻塞connect编写方法介绍](http://dongxicheng.org/network/non-block-connect-implemention/)
+struct Error TCPItnlClient::connect_in_timeval(const struct sockaddr *addr, socklen_t addr_len, const struct timeval &timeout)
+{
+    // para and instance status check
+    if (_check_connect_para(addr, addr_len).is_error()) {
+        return _status;
+    }
+
     // invoke connect()
     BOOL should_enter_libevent = FALSE;
     int conn_stat = connect(_fd, addr, addr_len);
@@ -375,73 +568,8 @@ struct Error TCPItnlClient::connect_in_timeval(const struct sockaddr *addr, sock
     }
 
     // connect by libevent
-    while (should_enter_libevent)
-    {
-        struct _EventArg *arg = (struct _EventArg *)_event_arg;
-        should_enter_libevent = FALSE;      // exit the loop
-
-        conn_stat = event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ | EV_WRITE, _libevent_callback, arg);
-        if (conn_stat) {
-            _status.set_app_errno(ERR_EVENT_UNEXPECTED_ERROR);
-            break;
-        }
-
-        struct timeval timeout_copy;
-        timeout_copy.tv_sec = timeout.tv_sec;
-        timeout_copy.tv_usec = timeout.tv_usec;
-        if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
-            timeout_copy.tv_sec = FOREVER_SECONDS;
-        }
-        event_add(_event, &timeout_copy);
-        co_yield(arg->coroutine);       // hand coroutine control over
-
-        // check libevent return
-        uint32_t libevent_what = *_libevent_what_storage;
-        if (event_is_timeout(libevent_what))
-        {
-            *_libevent_what_storage = 0;
-            _status.set_app_errno(ERR_TIMEOUT);
-        }
-        else if (event_writable(libevent_what) || event_readable(libevent_what))
-        {
-#if 0
-            // check status, valid in Linux ONLY
-            connect(_fd, addr, addr_len);
-            int err_copy = errno;
-            if (EISCONN == err_copy) {
-                // success
-                DEBUG("Connect TCP via libevent successed");
-                _status.clear_err();
-            }
-            else {
-                DEBUG("Failed to connect via libevent: %s", strerror(err_copy));
-                _status.set_sys_errno(err_copy);
-            }
-#else
-            int err = 0;
-            socklen_t errlen = sizeof(err);
-            conn_stat = getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
-            if (conn_stat < 0) {
-                _status.set_sys_errno();
-                ERROR("Failed in getsockopt: %s", strerror(errno));
-            }
-            else {
-                if (0 == err) {
-                    DEBUG("Connect TCP via libevent successed");
-                    _status.clear_err();
-                }
-                else {
-                    DEBUG("Failed to connect via libevent: %d", err);
-                    _status.set_sys_errno(err);
-                }
-            }
-#endif
-        }
-        else {
-            ERROR("unrecognized event flag: 0x%04u", (unsigned)libevent_what);
-            *_libevent_what_storage = 0;
-            _status.set_app_errno(ERR_UNKNOWN);
-        }
+    if (should_enter_libevent) {
+        _wait_for_connection(timeout);
     }
 
     // return
@@ -455,6 +583,10 @@ struct Error TCPItnlClient::connect_in_timeval(const struct sockaddr *addr, sock
 
 struct Error TCPItnlClient::connect_in_timeval(const std::string &target_address, unsigned target_port, const struct timeval &timeout)
 {
+    if (FALSE == is_IP_address(target_address)) {
+        return _connect_host_name(target_address, target_port, timeout);
+    }
+
     if (NetIPv4 == network_type()) {
         struct sockaddr_in addr;
         convert_str_to_sockaddr_in(target_address, target_port, &addr);
@@ -530,13 +662,507 @@ struct Error TCPItnlClient::connect_in_mimlisecs(const char *target_address, uns
 #endif      // end of __TCP_CONNECT_FUNCTION
 
 
+// ==========
+#define __HAPPY_EYEBALLS_FUNCTION
+#ifdef __HAPPY_EYEBALLS_FUNCTION
+
+#define _MIN_ATTEMPT_DELAY      (0.01)      // RFC 8305 suggests 100ms at least, but allow shorter on LAN
+#define _MAX_ATTEMPT_DELAY      (2.0)
+
+struct _EyeballsAttempt {
+    int                 fd;
+    struct event        *event;         // EV_WRITE, one shot
+    struct event        *wake_event;    // event of client, activated to resume coroutine
+    socklen_t           addr_len;
+    size_t              index;
+    BOOL                is_ready;
+};
+
+
+static double _now()
+{
+    struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+    return to_double(now);
+}
+
+
+static void _eyeballs_callback(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    // coroutine is resumed by the client event, so that coroutine end is handled in one place
+    struct _EyeballsAttempt *attempt = (struct _EyeballsAttempt *)libevent_arg;
+    attempt->is_ready = TRUE;
+    event_active(attempt->wake_event, EV_WRITE, 1);
+    return;
+}
+
+
+static void _eyeballs_close(struct _EyeballsAttempt *attempt)
+{
+    if (attempt->event) {
+        event_free(attempt->event);
+        attempt->event = NULL;
+    }
+    if (attempt->fd >= 0) {
+        close(attempt->fd);
+        attempt->fd = -1;
+    }
+    return;
+}
+
+
+// interleave address families, starting with the family of the first address (RFC 8305 section 4)
+static void _eyeballs_sort(const std::vector<struct sockaddr_storage> &addresses, std::vector<size_t> &order_out)
+{
+    std::vector<size_t> first_family;
+    std::vector<size_t> other_family;
+    order_out.clear();
+    if (addresses.empty()) {
+        return;
+    }
+
+    sa_family_t preferred = addresses[0].ss_family;
+    for (size_t index = 0; index < addresses.size(); index ++) {
+        if (AF_INET != addresses[index].ss_family && AF_INET6 != addresses[index].ss_family) {
+            continue;
+        }
+        if (preferred == addresses[index].ss_family) {
+            first_family.push_back(index);
+        } else {
+            other_family.push_back(index);
+        }
+    }
+
+    for (size_t index = 0; index < first_family.size() || index < other_family.size(); index ++) {
+        if (index < first_family.size()) {
+            order_out.push_back(first_family[index]);
+        }
+        if (index < other_family.size()) {
+            order_out.push_back(other_family[index]);
+        }
+    }
+    return;
+}
+
+
+// replace socket of this client with an established one
+void TCPItnlClient::_adopt_connection(int fd, const struct sockaddr *addr, socklen_t addr_len)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+
+    event_del(_event);
+    if (_fd > 0) {
+        close(_fd);
+    }
+    _fd = fd;
+
+    socklen_t self_len = sizeof(_self_addr);
+    memset(&_self_addr, 0, sizeof(_self_addr));
+    getsockname(_fd, (struct sockaddr *)&_self_addr, &self_len);
+    _addr_len = addr_len;
+    memcpy(&_remote_addr, addr, addr_len);
+
+    event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);
+    _is_connected = TRUE;
+    return;
+}
+
+
+struct Error TCPItnlClient::connect_any(const std::vector<struct sockaddr_storage> &addresses, double timeout_seconds, double attempt_delay_seconds)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    std::vector<size_t> order;
+    std::vector<struct _EyeballsAttempt> attempts;
+    struct Error last_error;
+    size_t next_order = 0;
+    size_t in_flight = 0;
+    int winner = -1;
+
+    if (NULL == arg || NULL == _event) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (_is_connected) {
+        _status.set_app_errno(ERR_ALREADY_CONNECTED);
+        return _status;
+    }
+    _eyeballs_sort(addresses, order);
+    if (order.empty()) {
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+    _status.clear_err();
+    last_error.set_app_errno(ERR_TIMEOUT);
+
+    if (attempt_delay_seconds < _MIN_ATTEMPT_DELAY) {
+        attempt_delay_seconds = _MIN_ATTEMPT_DELAY;
+    } else if (attempt_delay_seconds > _MAX_ATTEMPT_DELAY) {
+        attempt_delay_seconds = _MAX_ATTEMPT_DELAY;
+    }
+    attempts.reserve(order.size());     // addresses of elements are used by libevent
+
+    double deadline = (timeout_seconds > 0) ? _now() + timeout_seconds : 0;
+    double next_attempt_time = 0;
+
+    while (winner < 0)
+    {
+        double now = _now();
+
+        // start next attempt
+        if (next_order < order.size() && (now >= next_attempt_time || 0 == in_flight))
+        {
+            const struct sockaddr_storage *addr = &addresses[order[next_order]];
+            struct _EyeballsAttempt attempt;
+            attempt.fd = -1;
+            attempt.event = NULL;
+            attempt.wake_event = _event;
+            attempt.addr_len = (AF_INET == addr->ss_family) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+            attempt.index = order[next_order];
+            attempt.is_ready = FALSE;
+            attempts.push_back(attempt);
+            next_order ++;
+            next_attempt_time = now + attempt_delay_seconds;
+
+            struct _EyeballsAttempt *this_attempt = &attempts.back();
+            this_attempt->fd = socket(addr->ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            // an attempt failing at once lets next one start immediately, as an asynchronous failure does
+            if (this_attempt->fd < 0) {
+                last_error.set_sys_errno();
+                next_attempt_time = 0;
+                continue;
+            }
+
+            int conn_stat = connect(this_attempt->fd, (const struct sockaddr *)addr, this_attempt->addr_len);
+            if (0 == conn_stat) {
+                winner = (int)(attempts.size() - 1);
+                break;
+            }
+            if (EINPROGRESS != errno) {
+                DEBUG("%s attempt %u failed: %s", _identifier.c_str(), (unsigned)this_attempt->index, strerror(errno));
+                last_error.set_sys_errno();
+                _eyeballs_close(this_attempt);
+                next_attempt_time = 0;
+                continue;
+            }
+
+            this_attempt->event = event_new(_owner_base->event_base(), this_attempt->fd, EV_WRITE, _eyeballs_callback, this_attempt);
+            if (NULL == this_attempt->event) {
+                last_error.set_app_errno(ERR_EVENT_EVENT_NEW);
+                _eyeballs_close(this_attempt);
+                next_attempt_time = 0;
+                continue;
+            }
+            event_add(this_attempt->event, NULL);
+            in_flight ++;
+            continue;
+        }
+
+        if (0 == in_flight) {
+            _status = last_error;       // all failed
+            break;
+        }
+        if (deadline > 0 && now >= deadline) {
+            _status.set_app_errno(ERR_TIMEOUT);
+            break;
+        }
+
+        // wait for any attempt, or time to start next one
+        double wake_time = deadline;
+        if (next_order < order.size() && (0 == wake_time || next_attempt_time < wake_time)) {
+            wake_time = next_attempt_time;
+        }
+        struct timeval timeout = {FOREVER_SECONDS, 0};
+        if (wake_time > 0) {
+            timeout = to_timeval(wake_time - now);
+            if (0 == timeout.tv_sec && 0 == timeout.tv_usec) {
+                timeout.tv_usec = 1;
+            }
+        }
+
+        event_del(_event);
+        event_assign(_event, _owner_base->event_base(), -1, EV_TIMEOUT, _libevent_callback, arg);
+        *_libevent_what_storage = 0;
+        event_add(_event, &timeout);
+        co_yield(arg->coroutine);
+        event_del(_event);
+
+        // check finished attempts
+        for (size_t index = 0; index < attempts.size(); index ++)
+        {
+            struct _EyeballsAttempt *attempt = &attempts[index];
+            if (FALSE == attempt->is_ready || attempt->fd < 0) {
+                continue;
+            }
+            attempt->is_ready = FALSE;
+            in_flight --;
+
+            int err = 0;
+            socklen_t errlen = sizeof(err);
+            if (getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0) {
+                err = errno;
+            }
+            if (0 == err) {
+                winner = (int)index;
+                break;
+            }
+
+            // failed, next attempt starts immediately
+            DEBUG("%s attempt %u failed: %s", _identifier.c_str(), (unsigned)attempt->index, strerror(err));
+            last_error.set_sys_errno(err);
+            _eyeballs_close(attempt);
+            next_attempt_time = 0;
+        }
+    }
+
+    // keep the winner and close others
+    for (size_t index = 0; index < attempts.size(); index ++)
+    {
+        struct _EyeballsAttempt *attempt = &attempts[index];
+        if ((int)index != winner) {
+            _eyeballs_close(attempt);
+            continue;
+        }
+        if (attempt->event) {
+            event_free(attempt->event);
+            attempt->event = NULL;
+        }
+        _adopt_connection(attempt->fd, (const struct sockaddr *)&addresses[attempt->index], attempt->addr_len);
+        DEBUG("%s connected to %s:%u after %u attempts", _identifier.c_str(), remote_addr().c_str(), remote_port(), (unsigned)attempts.size());
+        _status.clear_err();
+    }
+
+    // restore client event
+    if (winner < 0) {
+        event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);
+    }
+    return _status;
+}
+
+
+struct Error TCPItnlClient::connect_any(const std::vector<std::string> &target_addresses, unsigned target_port, double timeout_seconds, double attempt_delay_seconds)
+{
+    std::vector<struct sockaddr_storage> addresses;
+
+    for (std::vector<std::string>::const_iterator each_addr = target_addresses.begin();
+        each_addr != target_addresses.end();
+        each_addr ++)
+    {
+        struct sockaddr_storage addr;
+        memset(&addr, 0, sizeof(addr));
+
+        struct sockaddr_in *addr4 = (struct sockaddr_in *)&addr;
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
+        if (1 == inet_pton(AF_INET, each_addr->c_str(), &(addr4->sin_addr))) {
+            addr4->sin_family = AF_INET;
+            addr4->sin_port = htons(target_port);
+        }
+        else if (1 == inet_pton(AF_INET6, each_addr->c_str(), &(addr6->sin6_addr))) {
+            addr6->sin6_family = AF_INET6;
+            addr6->sin6_port = htons(target_port);
+        }
+        else {
+            ERROR("illegal address '%s'", each_addr->c_str());
+            continue;
+        }
+        addresses.push_back(addr);
+    }
+
+    return connect_any(addresses, timeout_seconds, attempt_delay_seconds);
+}
+
+
+#endif  // end of __HAPPY_EYEBALLS_FUNCTION
+
+
+// ==========
+#define __HOST_NAME_CONNECT_FUNCTION
+#ifdef __HOST_NAME_CONNECT_FUNCTION
+
+// host name is resolved by DNS cache of owner base, then all addresses are tried by connect_any()
+struct Error TCPItnlClient::_connect_host_name(const std::string &host_name, unsigned target_port, const struct timeval &timeout)
+{
+    struct timeval timeout_copy = timeout;
+    double timeout_seconds = to_double(timeout_copy);
+    double start_time = _now();
+    std::vector<std::string> ip_list;
+
+    if (NULL == _owner_server || NULL == _owner_base) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (_is_connected) {
+        _status.set_app_errno(ERR_ALREADY_CONNECTED);
+        return _status;
+    }
+
+    DNSItnlCache *cache = (DNSItnlCache *)(_owner_base->dns_cache());
+    _status = cache->lookup(_owner_server, host_name, network_type(), timeout_seconds, ip_list);
+    if (_status.is_error()) {
+        return _status;
+    }
+
+    if (timeout_seconds > 0) {
+        timeout_seconds -= _now() - start_time;
+        if (timeout_seconds <= 0) {
+            _status.set_app_errno(ERR_TIMEOUT);
+            return _status;
+        }
+    }
+    return connect_any(ip_list, target_port, timeout_seconds);
+}
+
+
+#endif  // end of __HOST_NAME_CONNECT_FUNCTION
+
+
+// ==========
+#define __TCP_FAST_OPEN_FUNCTION
+#ifdef __TCP_FAST_OPEN_FUNCTION
+
+// reference: [TCP Fast Open](https://lwn.net/Articles/508865/)
+struct Error TCPItnlClient::connect_and_send(const struct sockaddr *addr, socklen_t addr_len, const void *data, const size_t data_len, size_t *send_len_out_nullable, double timeout_seconds)
+{
+    size_t total_sent = 0;
+
+    if (!(data && data_len)) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        goto END;
+    }
+    if (_check_connect_para(addr, addr_len).is_error()) {
+        goto END;
+    }
+
+    // sendto() with MSG_FASTOPEN acts as connect(). If TFO cookie is cached, data goes out with SYN
+    {
+        ssize_t send_len = ::sendto(_fd, data, data_len, MSG_FASTOPEN | MSG_NOSIGNAL, addr, addr_len);
+        if (send_len >= 0)
+        {
+            // data is already on the wire, wait for handshake so that refused connection is reported here
+            DEBUG("TCP fast open, %d bytes in SYN", (int)send_len);
+            if (_wait_for_connection(to_timeval(timeout_seconds)).is_ok()) {
+                total_sent = (size_t)send_len;
+            }
+        }
+        else if (EINPROGRESS == errno)
+        {
+            // no cookie yet, only SYN is sent
+            DEBUG("EINPROGRESS");
+            _wait_for_connection(to_timeval(timeout_seconds));
+        }
+        else if (EOPNOTSUPP == errno || EPIPE == errno || EINVAL == errno)
+        {
+            // fast open not supported by kernel or socket type
+            DEBUG("TCP fast open not supported: %s", strerror(errno));
+            connect_to_server(addr, addr_len, timeout_seconds);
+        }
+        else {
+            _status.set_sys_errno();
+        }
+    }
+
+    if (_status.is_error()) {
+        goto END;
+    }
+    if (FALSE == _is_connected) {
+        _is_connected = TRUE;
+        memcpy(&_remote_addr, addr, _addr_len);
+    }
+
+    // send the rest
+    if (total_sent < data_len) {
+        size_t rest_sent = 0;
+        send((const uint8_t *)data + total_sent, data_len - total_sent, &rest_sent);
+        total_sent += rest_sent;
+    }
+
+END:
+    if (send_len_out_nullable) {
+        *send_len_out_nullable = total_sent;
+    }
+    return _status;
+}
+
+
+struct Error TCPItnlClient::connect_and_send(const std::string &target_address, unsigned target_port, const void *data, const size_t data_len, size_t *send_len_out_nullable, double timeout_seconds)
+{
+    if (NetIPv4 == network_type()) {
+        struct sockaddr_in addr;
+        convert_str_to_sockaddr_in(target_address, target_port, &addr);
+        return connect_and_send((struct sockaddr *)&addr, sizeof(addr), data, data_len, send_len_out_nullable, timeout_seconds);
+    }
+    else {
+        struct sockaddr_in6 addr6;
+        convert_str_to_sockaddr_in6(target_address, target_port, &addr6);
+        return connect_and_send((struct sockaddr *)&addr6, sizeof(addr6), data, data_len, send_len_out_nullable, timeout_seconds);
+    }
+}
+
+
+#endif      // end of __TCP_FAST_OPEN_FUNCTION
+
+
 // ==========
 #define __SEND_FUNCTION
 #ifdef __SEND_FUNCTION
 
 struct Error TCPItnlClient::send(const void *data, const size_t data_len, size_t *send_len_out_nullable)
 {
-    // TODO:
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    size_t total_sent = 0;
+
+    if (!(data && data_len)) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        goto END;
+    }
+    if (FALSE == _is_connected) {
+        _status.set_app_errno(ERR_NOT_CONNECTED);
+        goto END;
+    }
+    _status.clear_err();
+
+    if (_tls) {
+        _status = _tls_send(data, data_len, &total_sent);
+        goto END;
+    }
+
+    while (total_sent < data_len)
+    {
+        ssize_t send_len = ::send(_fd, (const uint8_t *)data + total_sent, data_len - total_sent, MSG_NOSIGNAL);
+        if (send_len > 0) {
+            total_sent += send_len;
+            continue;
+        }
+        if (send_len < 0 && EINTR == errno) {
+            continue;
+        }
+        if (send_len < 0 && EAGAIN != errno && EWOULDBLOCK != errno) {
+            _status.set_sys_errno();
+            if (EPIPE == errno || ECONNRESET == errno) {
+                _is_connected = FALSE;
+            }
+            break;
+        }
+
+        // socket buffer full, wait until writable
+        event_del(_event);
+        if (event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_WRITE, _libevent_callback, arg)) {
+            _status.set_app_errno(ERR_EVENT_UNEXPECTED_ERROR);
+            break;
+        }
+        struct timeval timeout = {FOREVER_SECONDS, 0};
+        event_add(_event, &timeout);
+        co_yield(arg->coroutine);
+
+        if (FALSE == event_writable(*_libevent_what_storage)) {
+            ERROR("unrecognized event flag: 0x%04x", (unsigned)(*_libevent_what_storage));
+            _status.set_app_errno(ERR_UNKNOWN);
+            break;
+        }
+    }
+
+END:
+    if (send_len_out_nullable) {
+        *send_len_out_nullable = total_sent;
+    }
     return _status;
 }
 
@@ -550,12 +1176,82 @@ struct Error TCPItnlClient::send(const void *data, const size_t data_len, size_t
 
 struct Error TCPItnlClient::recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout)
 {
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    ssize_t recv_len = 0;
+
+    if (!(data_out && len_limit)) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        goto END;
+    }
     if (FALSE == _is_connected) {
         _status.set_app_errno(ERR_NOT_CONNECTED);
-        return _status;
+        goto END;
+    }
+    _status.clear_err();
+
+    if (_tls) {
+        size_t tls_len = 0;
+        _status = _tls_recv(data_out, len_limit, &tls_len, timeout);
+        recv_len = (ssize_t)tls_len;
+        goto END;
+    }
+
+    // try reading first, wait in libevent only if nothing is buffered in kernel
+    while (1)
+    {
+        recv_len = read(_fd, data_out, len_limit);
+        if (recv_len > 0) {
+            break;
+        }
+        if (0 == recv_len) {
+            DEBUG("%s closed by remote", _identifier.c_str());
+            _is_connected = FALSE;
+            break;
+        }
+        if (EINTR == errno) {
+            continue;
+        }
+        if (EAGAIN != errno && EWOULDBLOCK != errno) {
+            _status.set_sys_errno();
+            _is_connected = FALSE;
+            break;
+        }
+        event_del(_event);
+        if (event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg)) {
+            _status.set_app_errno(ERR_EVENT_UNEXPECTED_ERROR);
+            break;
+        }
+
+        struct timeval timeout_copy;
+        timeout_copy.tv_sec = timeout.tv_sec;
+        timeout_copy.tv_usec = timeout.tv_usec;
+        if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
+            timeout_copy.tv_sec = FOREVER_SECONDS;
+        }
+        event_add(_event, &timeout_copy);
+        co_yield(arg->coroutine);
+
+        uint32_t libevent_what = *_libevent_what_storage;
+        if (event_readable(libevent_what)) {
+            continue;
+        }
+        else if (event_is_timeout(libevent_what)) {
+            recv_len = 0;
+            _status.set_app_errno(ERR_TIMEOUT);
+            break;
+        }
+        else {
+            ERROR("unrecognized event flag: 0x%04x", (unsigned)libevent_what);
+            recv_len = 0;
+            _status.set_app_errno(ERR_UNKNOWN);
+            break;
+        }
     }
 
-    // TODO:
+END:
+    if (len_out) {
+        *len_out = (recv_len > 0) ? recv_len : 0;
+    }
     return _status;
 }
 
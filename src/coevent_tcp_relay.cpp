@@ -0,0 +1,311 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+using namespace andrewmc::libcoevent;
+
+#define _MIN_RELAY_BUFF_SIZE    (4096)
+
+// ==========
+// one direction of relay, from src_fd to dst_fd
+#define __RELAY_DIRECTION
+#ifdef __RELAY_DIRECTION
+
+struct _RelayDirection {
+    int         src_fd;
+    int         dst_fd;
+    int         pipe_fds[2];    // splice mode if pipe_fds[0] >= 0
+    uint8_t     *buff;          // copy mode
+    size_t      buff_size;
+    size_t      buff_offset;
+    size_t      pending;        // bytes read from src but not written to dst
+    uint64_t    bytes;
+    BOOL        is_src_eof;
+    BOOL        is_done;
+    BOOL        want_read;
+    BOOL        want_write;
+};
+
+
+static void _direction_init(struct _RelayDirection *dir, int src_fd, int dst_fd, size_t buff_size, BOOL use_splice)
+{
+    memset(dir, 0, sizeof(*dir));
+    dir->src_fd = src_fd;
+    dir->dst_fd = dst_fd;
+    dir->pipe_fds[0] = -1;
+    dir->pipe_fds[1] = -1;
+    dir->buff_size = buff_size;
+
+#ifdef SPLICE_F_NONBLOCK
+    if (use_splice && 0 == pipe2(dir->pipe_fds, O_NONBLOCK | O_CLOEXEC)) {
+#ifdef F_SETPIPE_SZ
+        fcntl(dir->pipe_fds[1], F_SETPIPE_SZ, (int)buff_size);
+#endif
+        return;
+    }
+    dir->pipe_fds[0] = -1;
+    dir->pipe_fds[1] = -1;
+#endif
+    return;
+}
+
+
+static void _direction_close_pipe(struct _RelayDirection *dir)
+{
+    if (dir->pipe_fds[0] >= 0) {
+        close(dir->pipe_fds[0]);
+        close(dir->pipe_fds[1]);
+        dir->pipe_fds[0] = -1;
+        dir->pipe_fds[1] = -1;
+    }
+    return;
+}
+
+
+static void _direction_clear(struct _RelayDirection *dir)
+{
+    _direction_close_pipe(dir);
+    if (dir->buff) {
+        free(dir->buff);
+        dir->buff = NULL;
+    }
+    return;
+}
+
+
+// splice is not supported by this pair of sockets, switch to copying. Only possible before any data moved
+static void _direction_fallback(struct _RelayDirection *dir)
+{
+    DEBUG("splice not supported between fd %d and %d, use copying", dir->src_fd, dir->dst_fd);
+    _direction_close_pipe(dir);
+    return;
+}
+
+
+static ssize_t _direction_read(struct _RelayDirection *dir)
+{
+#ifdef SPLICE_F_NONBLOCK
+    if (dir->pipe_fds[0] >= 0)
+    {
+        ssize_t read_len = splice(dir->src_fd, NULL, dir->pipe_fds[1], NULL, dir->buff_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (read_len >= 0 || EINVAL != errno || dir->bytes > 0) {
+            return read_len;
+        }
+        _direction_fallback(dir);
+    }
+#endif
+
+    if (NULL == dir->buff) {
+        dir->buff = (uint8_t *)malloc(dir->buff_size);
+        if (NULL == dir->buff) {
+            throw std::bad_alloc();
+        }
+    }
+    dir->buff_offset = 0;
+    return ::recv(dir->src_fd, dir->buff, dir->buff_size, 0);
+}
+
+
+static ssize_t _direction_write(struct _RelayDirection *dir)
+{
+#ifdef SPLICE_F_NONBLOCK
+    if (dir->pipe_fds[0] >= 0) {
+        return splice(dir->pipe_fds[0], NULL, dir->dst_fd, NULL, dir->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+#endif
+    return ::send(dir->dst_fd, dir->buff + dir->buff_offset, dir->pending, MSG_NOSIGNAL);
+}
+
+
+// move as much data as possible without blocking. Returns bytes written to dst
+static struct Error _direction_pump(struct _RelayDirection *dir, size_t *moved_out)
+{
+    struct Error status;
+    *moved_out = 0;
+    dir->want_read = FALSE;
+    dir->want_write = FALSE;
+
+    while (FALSE == dir->is_done)
+    {
+        if (dir->pending > 0)
+        {
+            ssize_t write_len = _direction_write(dir);
+            if (write_len > 0) {
+                dir->pending -= write_len;
+                dir->buff_offset += write_len;
+                dir->bytes += write_len;
+                *moved_out += write_len;
+                continue;
+            }
+            if (write_len < 0 && EINTR == errno) {
+                continue;
+            }
+            if (write_len < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+                dir->want_write = TRUE;
+                break;
+            }
+            status.set_sys_errno();
+            break;
+        }
+
+        if (dir->is_src_eof) {
+            // pass half close to the other side
+            shutdown(dir->dst_fd, SHUT_WR);
+            dir->is_done = TRUE;
+            break;
+        }
+
+        ssize_t read_len = _direction_read(dir);
+        if (read_len > 0) {
+            dir->pending = read_len;
+            continue;
+        }
+        if (0 == read_len) {
+            dir->is_src_eof = TRUE;
+            continue;
+        }
+        if (EINTR == errno) {
+            continue;
+        }
+        if (EAGAIN == errno || EWOULDBLOCK == errno) {
+            dir->want_read = TRUE;
+            break;
+        }
+        status.set_sys_errno();
+        break;
+    }
+
+    return status;
+}
+
+#endif  // end of __RELAY_DIRECTION
+
+
+// ==========
+#define __RELAY_FUNCTION
+#ifdef __RELAY_FUNCTION
+
+static double _now()
+{
+    struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+    return to_double(now);
+}
+
+
+struct Error TCPItnlSession::relay(TCPClient *client, const struct RelayOptions &options, struct RelayStats *stats_out)
+{
+    struct _RelayDirection upstream;        // session to client
+    struct _RelayDirection downstream;      // client to session
+    TCPItnlClient *client_itnl = (TCPItnlClient *)client;
+    struct stCoRoutine_t *coroutine = co_self();
+    double start_time = _now();
+    double last_active = start_time;
+
+    if (stats_out) {
+        memset(stats_out, 0, sizeof(*stats_out));
+    }
+    if (NULL == client) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    if (_fd <= 0 || client_itnl->file_descriptor() <= 0 || FALSE == client_itnl->is_connected()) {
+        _status.set_app_errno(ERR_NOT_CONNECTED);
+        return _status;
+    }
+    if (_tls || client->is_tls()) {
+        ERROR("%s cannot relay TLS connection", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+    if (_outbound_bytes > 0) {
+        ERROR("%s still has %u bytes queued to writer", _identifier.c_str(), (unsigned)_outbound_bytes);
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+    _status.clear_err();
+
+    size_t buff_size = (options.buffer_size < _MIN_RELAY_BUFF_SIZE) ? _MIN_RELAY_BUFF_SIZE : options.buffer_size;
+    int client_fd = client_itnl->file_descriptor();
+    _direction_init(&upstream, _fd, client_fd, buff_size, options.use_splice);
+    _direction_init(&downstream, client_fd, _fd, buff_size, options.use_splice);
+
+    while (FALSE == (upstream.is_done && downstream.is_done))
+    {
+        size_t moved_up = 0;
+        size_t moved_down = 0;
+        _status = _direction_pump(&upstream, &moved_up);
+        if (_status.is_ok()) {
+            _status = _direction_pump(&downstream, &moved_down);
+        }
+        if (_status.is_error()) {
+            break;
+        }
+
+        if (moved_up || moved_down) {
+            last_active = _now();
+            _server->notify_session_io(_fd, moved_up, moved_down);
+            if (_reaper_entry) {
+                _reaper->touch(_reaper_entry);
+            }
+        }
+        if (upstream.is_done && downstream.is_done) {
+            break;
+        }
+
+        // nearest deadline
+        double now = _now();
+        double deadline = 0;
+        if (options.idle_timeout > 0) {
+            deadline = last_active + options.idle_timeout;
+        }
+        if (options.total_timeout > 0 && (0 == deadline || start_time + options.total_timeout < deadline)) {
+            deadline = start_time + options.total_timeout;
+        }
+        if (deadline > 0 && now >= deadline) {
+            _status.set_app_errno(ERR_TIMEOUT);
+            break;
+        }
+        if (_is_reaped) {
+            _status.set_app_errno(ERR_SESSION_REAPED);
+            break;
+        }
+
+        // wait for both sockets in one yield
+        short session_what = (upstream.want_read ? EV_READ : 0) | (downstream.want_write ? EV_WRITE : 0);
+        short client_what = (downstream.want_read ? EV_READ : 0) | (upstream.want_write ? EV_WRITE : 0);
+        struct timeval timeout = {FOREVER_SECONDS, 0};
+        if (deadline > 0) {
+            timeout = to_timeval(deadline - now);
+        }
+
+        watch_io(session_what, &timeout);
+        client_itnl->watch_io(client_what, NULL);
+        co_yield(coroutine);
+        unwatch_io();
+        client_itnl->unwatch_io();
+    }
+
+    if (stats_out) {
+        stats_out->bytes_to_client = upstream.bytes;
+        stats_out->bytes_to_session = downstream.bytes;
+        stats_out->duration = _now() - start_time;
+        stats_out->is_spliced = (upstream.pipe_fds[0] >= 0 && downstream.pipe_fds[0] >= 0) ? TRUE : FALSE;
+    }
+    DEBUG("%s relay ends, %llu bytes up, %llu bytes down: %s", _identifier.c_str(),
+            (unsigned long long)upstream.bytes, (unsigned long long)downstream.bytes, _status.c_err_msg());
+
+    _direction_clear(&upstream);
+    _direction_clear(&downstream);
+    return _status;
+}
+
+#endif  // end of __RELAY_FUNCTION
+
+
+// end of file
@@ -7,11 +7,22 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <math.h>
 #include <map>
 
 using namespace andrewmc::libcoevent;
 
+#define _DEFAULT_LISTEN_BACKLOG     (128)
+#define _DEFAULT_ACCEPT_BUDGET      (64)
+#define _DEFAULT_FAST_OPEN_QUEUE    (0)
+#define _DEFAULT_MAX_SESSIONS       (0)
+#define _DEFAULT_OVERLOAD_INTERVAL  (0.1)
+#define _DEFAULT_TLS_HANDSHAKE_TIMEOUT  (10.0)
+
 
 // ==========
 // necessary definitions
@@ -23,7 +34,6 @@ struct _EventArg {
     WorkerFunc          session_worker_func;
     void                *session_user_arg;
     socklen_t           sock_len;
-    std::map<int, TCPSession *> *sessions;
 
     // TCP server supports session mode ONLY, therefore no coroutine needed.
 };
@@ -52,16 +62,34 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
     }
     else if (event_readable(libevent_what))
     {
-        struct sockaddr_storage remote_addr;
-        socklen_t sock_len = arg->sock_len;
-        int client_fd = accept(fd, (struct sockaddr *)&remote_addr, &sock_len);
+        // accept until EAGAIN, or until the budget of this round runs out. Remaining
+        // connections stay in the backlog and will trigger the persistent event again.
+        unsigned budget = server->accept_budget();
+        unsigned accepted = 0;
+
+        while ((0 == budget) || (accepted < budget))
+        {
+            struct sockaddr_storage remote_addr;
+            socklen_t sock_len = arg->sock_len;
+            int client_fd = accept4(fd, (struct sockaddr *)&remote_addr, &sock_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (client_fd < 0) {
+                if (EINTR == errno || ECONNABORTED == errno) {
+                    continue;
+                }
+                if (EAGAIN != errno && EWOULDBLOCK != errno) {
+                    ERROR("Failed in accept4(): %s", strerror(errno));
+                }
+                break;
+            }
 
-        if (client_fd < 0) {
-            ERROR("Failed in accept(): %s", strerror(errno));
-        }
-        else {
+            accepted ++;
             DEBUG("Accepted incomming connection, fd = %d", client_fd);
 
+            if (server->shed_if_overloaded(client_fd)) {
+                continue;
+            }
+
             TCPItnlSession *session = new TCPItnlSession;
             if (NULL == session) {
                 ERROR("Failed to create a TCP session");
@@ -76,11 +104,12 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
                     session = NULL;
                 }
                 else {
-                    (*(arg->sessions))[client_fd] = (TCPSession *)session;
+                    server->notify_session_accepted(client_fd, (TCPSession *)session);
                 }
             }
         }
 
+        DEBUG("%u connection(s) accepted in this round", accepted);
     }
     else {
         ERROR("Unrecognized event flag: 0x%02x", (unsigned)libevent_what);
@@ -113,14 +142,22 @@ void TCPServer::_clear()
         _event = NULL;
     }
 
-    for (std::map<int, TCPSession *>::iterator each_session = _sessions.begin();
+    for (std::vector<struct TCPSessionStat>::iterator each_session = _sessions.begin();
         each_session != _sessions.end();
         each_session ++)
     {
-        DEBUG("Delete TCP session: %s", each_session->second->identifier().c_str());
-        delete each_session->second;
+        if (each_session->session) {
+            DEBUG("Delete TCP session: %s", each_session->session->identifier().c_str());
+            delete each_session->session;
+        }
     }
     _sessions.clear();
+    _session_count = 0;
+
+    if (_session_reaper) {
+        delete _session_reaper;
+        _session_reaper = NULL;
+    }
 
     if (_fd > 0) {
         close(_fd);
@@ -143,7 +180,29 @@ TCPServer::TCPServer()
     _event_arg = NULL;
     _fd = 0;
     _sock_addr_len = 0;
+    _session_count = 0;
     _port = 0;
+    _listen_backlog = _DEFAULT_LISTEN_BACKLOG;
+    _accept_budget = _DEFAULT_ACCEPT_BUDGET;
+    _fast_open_queue = _DEFAULT_FAST_OPEN_QUEUE;
+
+    _max_sessions = _DEFAULT_MAX_SESSIONS;
+    _overload_target = 0;
+    _overload_interval = _DEFAULT_OVERLOAD_INTERVAL;
+    _first_above_time = 0;
+    _drop_next = 0;
+    _drop_count = 0;
+    _is_dropping = FALSE;
+    _last_queueing_delay = 0;
+    _shed_by_limit = 0;
+    _shed_by_delay = 0;
+
+    _idle_timeout = 0;
+    _max_session_lifetime = 0;
+    _session_reaper = NULL;
+
+    _tls_context = NULL;
+    _tls_handshake_timeout = _DEFAULT_TLS_HANDSHAKE_TIMEOUT;
     return;
 }
 
@@ -214,7 +273,6 @@ struct Error TCPServer::init_session_mode(Base *base, WorkerFunc session_func, c
     arg->session_worker_func = session_func;
     arg->session_user_arg = user_arg;
     arg->sock_len = _sock_addr_len;
-    arg->sessions = &_sessions;
 
     // init sockets
     memcpy(&_sock_addr, addr, _sock_addr_len);
@@ -236,8 +294,17 @@ struct Error TCPServer::init_session_mode(Base *base, WorkerFunc session_func, c
         return _status;
     }
 
+    // TCP fast open, not supported by local sockets
+    if (_fast_open_queue > 0 && AF_UNIX != addr->sa_family)
+    {
+        int queue_len = _fast_open_queue;
+        if (setsockopt(_fd, IPPROTO_TCP, TCP_FASTOPEN, &queue_len, sizeof(queue_len)) < 0) {
+            ERROR("Failed to enable TCP fast open: %s", strerror(errno));
+        }
+    }
+
     // listen
-    status = listen(_fd, 128);
+    status = listen(_fd, _listen_backlog);
     if (status < 0) {
         _clear();
         _status.set_sys_errno();
@@ -366,12 +433,13 @@ struct Error TCPServer::quit_session_mode_server()
 struct Error TCPServer::notify_session_ends(TCPSession *the_session)
 {
     TCPItnlSession *session = (TCPItnlSession *)the_session;
-    std::map<int, TCPSession *>::iterator session_in_control = _sessions.find(session->file_descriptor());
-    
-    if (_sessions.end() != session_in_control)
+    int fd = session->file_descriptor();
+
+    if (fd > 0 && (size_t)fd < _sessions.size() && the_session == _sessions[fd].session)
     {
-        DEBUG("dispatch session %s", session_in_control->second->identifier().c_str());
-        _sessions.erase(session_in_control);
+        DEBUG("dispatch session %s", session->identifier().c_str());
+        _sessions[fd].session = NULL;
+        _session_count --;
         _status.clear_err();
     }
     else {
@@ -382,6 +450,315 @@ struct Error TCPServer::notify_session_ends(TCPSession *the_session)
 }
 
 
+void TCPServer::notify_session_accepted(int fd, TCPSession *session)
+{
+    // fds are small dense integers, grow the table by doubling
+    if ((size_t)fd >= _sessions.size())
+    {
+        size_t new_size = _sessions.size() * 2;
+        if (new_size <= (size_t)fd) {
+            new_size = (size_t)fd + 1;
+        }
+        struct TCPSessionStat empty_stat;
+        memset(&empty_stat, 0, sizeof(empty_stat));
+        _sessions.resize(new_size, empty_stat);
+    }
+
+    struct TCPSessionStat &stat = _sessions[fd];
+    if (NULL == stat.session) {
+        _session_count ++;
+    }
+    stat.session = session;
+    stat.accept_time = ::andrewmc::cpptools::sys_up_timeval();
+    stat.last_active = stat.accept_time;
+    stat.bytes_in = 0;
+    stat.bytes_out = 0;
+    return;
+}
+
+
+void TCPServer::notify_session_io(int fd, size_t bytes_in, size_t bytes_out)
+{
+    if (fd <= 0 || (size_t)fd >= _sessions.size()) {
+        return;
+    }
+
+    struct TCPSessionStat &stat = _sessions[fd];
+    stat.last_active = ::andrewmc::cpptools::sys_up_timeval();
+    stat.bytes_in += bytes_in;
+    stat.bytes_out += bytes_out;
+    return;
+}
+
+
+const struct TCPSessionStat *TCPServer::session_stat(int fd)
+{
+    if (fd <= 0 || (size_t)fd >= _sessions.size() || NULL == _sessions[fd].session) {
+        return NULL;
+    }
+    return &(_sessions[fd]);
+}
+
+
+// ==========
+// reference: [Controlled Delay Active Queue Management](https://tools.ietf.org/html/rfc8289)
+#define __OVERLOAD_CONTROL_FUNCTIONS
+#ifdef __OVERLOAD_CONTROL_FUNCTIONS
+
+static double _now_seconds()
+{
+    struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+    return to_double(now);
+}
+
+
+void TCPServer::notify_queueing_delay(double delay_seconds)
+{
+    _last_queueing_delay = delay_seconds;
+    if (_overload_target <= 0) {
+        return;
+    }
+
+    // below target, leave dropping state
+    if (delay_seconds < _overload_target) {
+        if (_is_dropping) {
+            DEBUG("%s leaves dropping state", _identifier.c_str());
+        }
+        _first_above_time = 0;
+        _is_dropping = FALSE;
+        return;
+    }
+
+    // above target, enter dropping state if it lasts for an interval
+    double now = _now_seconds();
+    if (0 == _first_above_time) {
+        _first_above_time = now + _overload_interval;
+    }
+    else if (FALSE == _is_dropping && now >= _first_above_time) {
+        DEBUG("%s enters dropping state, delay %f", _identifier.c_str(), delay_seconds);
+        _is_dropping = TRUE;
+        _drop_count = 0;
+        _drop_next = now;
+    }
+    return;
+}
+
+
+BOOL TCPServer::shed_if_overloaded(int client_fd)
+{
+    BOOL should_shed = FALSE;
+
+    if (_max_sessions > 0 && _session_count >= _max_sessions)
+    {
+        should_shed = TRUE;
+        _shed_by_limit ++;
+    }
+    else if (_is_dropping)
+    {
+        // drop rate grows with the square root of drop count, as CoDel does
+        double now = _now_seconds();
+        if (now >= _drop_next) {
+            should_shed = TRUE;
+            _shed_by_delay ++;
+            _drop_count ++;
+            _drop_next = now + _overload_interval / sqrt((double)_drop_count);
+        }
+    }
+
+    if (FALSE == should_shed) {
+        return FALSE;
+    }
+
+    DEBUG("%s sheds connection, fd = %d", _identifier.c_str(), client_fd);
+    if (_shed_reply.length() > 0) {
+        ::send(client_fd, _shed_reply.c_str(), _shed_reply.length(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    close(client_fd);
+    return TRUE;
+}
+
+
+void TCPServer::set_max_sessions(size_t max_sessions)
+{
+    _max_sessions = max_sessions;
+    return;
+}
+
+
+size_t TCPServer::max_sessions()
+{
+    return _max_sessions;
+}
+
+
+size_t TCPServer::session_count()
+{
+    return _session_count;
+}
+
+
+void TCPServer::set_overload_control(double target_delay_seconds, double interval_seconds)
+{
+    _overload_target = (target_delay_seconds > 0) ? target_delay_seconds : 0;
+    _overload_interval = (interval_seconds > 0) ? interval_seconds : _DEFAULT_OVERLOAD_INTERVAL;
+    _first_above_time = 0;
+    _is_dropping = FALSE;
+    return;
+}
+
+
+double TCPServer::overload_target_delay()
+{
+    return _overload_target;
+}
+
+
+double TCPServer::last_queueing_delay()
+{
+    return _last_queueing_delay;
+}
+
+
+void TCPServer::set_shed_reply(const void *data, size_t data_len)
+{
+    if (data && data_len) {
+        _shed_reply.assign((const char *)data, data_len);
+    } else {
+        _shed_reply.clear();
+    }
+    return;
+}
+
+
+uint64_t TCPServer::shed_count()
+{
+    return _shed_by_limit + _shed_by_delay;
+}
+
+
+uint64_t TCPServer::shed_count_by_limit()
+{
+    return _shed_by_limit;
+}
+
+
+uint64_t TCPServer::shed_count_by_delay()
+{
+    return _shed_by_delay;
+}
+
+
+#endif  // end of __OVERLOAD_CONTROL_FUNCTIONS
+
+
+// ==========
+#define __SESSION_REAPER_FUNCTIONS
+#ifdef __SESSION_REAPER_FUNCTIONS
+
+static void _reap_session(Event *session, void *arg)
+{
+    ((TCPItnlSession *)session)->reap();
+    return;
+}
+
+
+static time_t _reaper_seconds(double seconds)
+{
+    return (seconds > 0) ? (time_t)ceil(seconds) : 0;
+}
+
+
+SessionReaper *TCPServer::session_reaper()
+{
+    if (NULL == _session_reaper && _owner_base && (_idle_timeout > 0 || _max_session_lifetime > 0))
+    {
+        _session_reaper = new SessionReaper(_owner_base, _reap_session, this);
+        _session_reaper->set_idle_timeout(_reaper_seconds(_idle_timeout));
+        _session_reaper->set_max_lifetime(_reaper_seconds(_max_session_lifetime));
+
+        // sessions accepted before limits were set
+        for (size_t fd = 0; fd < _sessions.size(); fd ++) {
+            if (_sessions[fd].session) {
+                ((TCPItnlSession *)(_sessions[fd].session))->attach_reaper(_session_reaper);
+            }
+        }
+    }
+    return _session_reaper;
+}
+
+
+void TCPServer::set_idle_timeout(double seconds)
+{
+    _idle_timeout = (seconds > 0) ? seconds : 0;
+    if (_session_reaper) {
+        _session_reaper->set_idle_timeout(_reaper_seconds(_idle_timeout));
+    } else {
+        session_reaper();
+    }
+    return;
+}
+
+
+double TCPServer::idle_timeout()
+{
+    return _idle_timeout;
+}
+
+
+void TCPServer::set_max_session_lifetime(double seconds)
+{
+    _max_session_lifetime = (seconds > 0) ? seconds : 0;
+    if (_session_reaper) {
+        _session_reaper->set_max_lifetime(_reaper_seconds(_max_session_lifetime));
+    } else {
+        session_reaper();
+    }
+    return;
+}
+
+
+double TCPServer::max_session_lifetime()
+{
+    return _max_session_lifetime;
+}
+
+
+uint64_t TCPServer::reaped_count()
+{
+    return _session_reaper ? _session_reaper->reaped_count() : 0;
+}
+
+
+#endif  // end of __SESSION_REAPER_FUNCTIONS
+
+
+// ==========
+#define __TLS_FUNCTIONS
+#ifdef __TLS_FUNCTIONS
+
+void TCPServer::set_tls_context(TLSContext *context, double handshake_timeout_seconds)
+{
+    _tls_context = context;
+    _tls_handshake_timeout = (handshake_timeout_seconds > 0) ? handshake_timeout_seconds : 0;
+    return;
+}
+
+
+TLSContext *TCPServer::tls_context()
+{
+    return _tls_context;
+}
+
+
+double TCPServer::tls_handshake_timeout()
+{
+    return _tls_handshake_timeout;
+}
+
+
+#endif  // end of __TLS_FUNCTIONS
+
+
 // ==========
 #define __MISC_FUNCTIONS
 #ifdef __MISC_FUNCTIONS
@@ -424,6 +801,45 @@ int TCPServer::port()
 }
 
 
+void TCPServer::set_listen_backlog(int backlog)
+{
+    _listen_backlog = (backlog > 0) ? backlog : SOMAXCONN;
+    return;
+}
+
+
+int TCPServer::listen_backlog()
+{
+    return _listen_backlog;
+}
+
+
+void TCPServer::set_accept_budget(unsigned max_accepts_per_event)
+{
+    _accept_budget = max_accepts_per_event;
+    return;
+}
+
+
+unsigned TCPServer::accept_budget()
+{
+    return _accept_budget;
+}
+
+
+void TCPServer::set_fast_open_queue(int queue_len)
+{
+    _fast_open_queue = (queue_len > 0) ? queue_len : 0;
+    return;
+}
+
+
+int TCPServer::fast_open_queue()
+{
+    return _fast_open_queue;
+}
+
+
 #endif
 
 
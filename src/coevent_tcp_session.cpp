@@ -8,6 +8,9 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
 
 using namespace andrewmc::libcoevent;
@@ -25,8 +28,24 @@ struct _EventArg {
     struct stCoRoutine_t *coroutine;
     WorkerFunc          worker_func;
     void                *user_arg;
+
+    struct timeval      accept_time;        // sys up time
+};
+
+
+// companion writer coroutine of full-duplex session
+struct _WriterArg {
+    TCPItnlSession      *session;
+    struct event        *event;             // EV_WRITE only
+    struct stCoRoutine_t *coroutine;
+    BOOL                is_reader_ended;    // session coroutine returned, writer releases session after sending all
 };
 
+#define _WRITER_IOV_MAX             (16)
+#define _OUTBOUND_MERGE_SIZE        (16 * 1024)
+#define _DEFAULT_HIGH_WATERMARK     (1024 * 1024)
+#define _DEFAULT_LOW_WATERMARK      (256 * 1024)
+
 #endif  // end of __CO_EVENT_TCP_SESSION_ARGUMENTS
 
 
@@ -39,10 +58,28 @@ struct _EventArg {
 static void *_libco_routine(void *libco_arg)
 {
     struct _EventArg *arg = (struct _EventArg *)libco_arg;
+
+    // TLS server, session function sees decrypted stream only
+    TCPServer *server = arg->session->server();
+    if (server->tls_context()) {
+        struct Error status = arg->session->start_tls(server->tls_context(), server->tls_handshake_timeout());
+        if (status.is_error()) {
+            return NULL;
+        }
+    }
+
     (arg->worker_func)(arg->fd, arg->session, arg->user_arg);
     return NULL;
 }
 
+
+static void *_libco_writer_routine(void *libco_arg)
+{
+    struct _WriterArg *arg = (struct _WriterArg *)libco_arg;
+    arg->session->run_writer();
+    return NULL;
+}
+
 #endif  // end of __CO_EVENT_TCP_SESSION_LIBCO_ROUTINE
 
 
@@ -51,6 +88,19 @@ static void *_libco_routine(void *libco_arg)
 #define __CO_EVENT_UDP_CALLBACK
 #ifdef __CO_EVENT_UDP_CALLBACK
 
+static void _release_session(TCPItnlSession *session)
+{
+    // delete the event if this is under control of the base
+    TCPServer *server = session->server();
+    Base *base = session->owner();
+
+    DEBUG("evtcp %s ends", session->identifier().c_str());
+    server->notify_session_ends(session);
+    base->delete_event_under_control(session);
+    return;
+}
+
+
 static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_arg)
 {
     struct _EventArg *arg = (struct _EventArg *)libevent_arg;
@@ -61,26 +111,42 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
         DEBUG("libevent what: 0x%04x - %s%s", (unsigned)what, event_is_timeout(what) ? "timeout " : "", event_readable(what) ? "read" : "");
     }
 
+    // queueing delay, from accept to the first run of session
+    if (FALSE == is_coroutine_started(arg->coroutine))
+    {
+        struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+        struct timeval delay;
+        timersub(&now, &(arg->accept_time), &delay);
+        arg->session->server()->notify_queueing_delay(to_double(delay));
+    }
+
     // handle control to user application
     co_resume(arg->coroutine);
 
-    // is coroutine end?
-    if (is_coroutine_end(arg->coroutine))
-    {
-        // delete the event if this is under control of the base
-        TCPItnlSession *session = arg->session;
-        TCPServer *server = session->server();
-        Base *base = session->owner();
-
-        DEBUG("evtcp %s ends", session->identifier().c_str());
-        server->notify_session_ends(session);
-        base->delete_event_under_control(session);
+    // is coroutine end? Session is released by writer if there is still data to send
+    if (is_coroutine_end(arg->coroutine) && FALSE == arg->session->hold_for_writer()) {
+        _release_session(arg->session);
     }
 
     // done
     return;
 }
 
+
+static void _libevent_writer_callback(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    struct _WriterArg *arg = (struct _WriterArg *)libevent_arg;
+    TCPItnlSession *session = arg->session;
+
+    co_resume(arg->coroutine);
+
+    // writer ends after session coroutine ends, or on error
+    if (is_coroutine_end(arg->coroutine) && arg->is_reader_ended) {
+        _release_session(session);
+    }
+    return;
+}
+
 #endif
 
 
@@ -99,6 +165,17 @@ TCPItnlSession::TCPItnlSession()
     _addr_len = 0;
     _server = NULL;
     _event_arg = NULL;
+    _reaper = NULL;
+    _reaper_entry = NULL;
+    _is_reaped = FALSE;
+    _tls = NULL;
+    _writer_arg = NULL;
+    _outbound_offset = 0;
+    _outbound_bytes = 0;
+    _is_writer_idle = FALSE;
+    _is_producer_waiting = FALSE;
+    _high_watermark = _DEFAULT_HIGH_WATERMARK;
+    _low_watermark = _DEFAULT_LOW_WATERMARK;
 
     _libevent_what_storage = (uint32_t *)malloc(sizeof(*_libevent_what_storage));
     if (NULL == _libevent_what_storage) {
@@ -134,16 +211,34 @@ TCPItnlSession::~TCPItnlSession()
 
 void TCPItnlSession::_clear()
 {
+    _clear_writer();
+
     if (_event) {
         event_del(_event);
         _event = NULL;
     }
 
+    // session may be deleted by a client callback when coroutine ends there
+    if (_server && _fd > 0) {
+        _server->notify_session_ends(this);
+    }
+    if (_tls) {
+        _tls->shutdown();
+        delete _tls;
+        _tls = NULL;
+    }
     if (_fd > 0) {
         close(_fd);
         _fd = 0;
     }
 
+    if (_reaper_entry) {
+        _reaper->remove(_reaper_entry);
+        _reaper_entry = NULL;
+    }
+    _reaper = NULL;
+    _is_reaped = FALSE;
+
     _remote_addr.ss_family = (sa_family_t)0;
     _addr_len = 0;
     _server = NULL;
@@ -151,6 +246,30 @@ void TCPItnlSession::_clear()
 }
 
 
+void TCPItnlSession::_clear_writer()
+{
+    struct _WriterArg *arg = (struct _WriterArg *)_writer_arg;
+    if (arg) {
+        if (arg->event) {
+            event_free(arg->event);
+        }
+        if (arg->coroutine) {
+            co_release(arg->coroutine);
+        }
+        free(arg);
+        _writer_arg = NULL;
+    }
+
+    _outbound.clear();
+    _outbound_offset = 0;
+    _outbound_bytes = 0;
+    _is_writer_idle = FALSE;
+    _is_producer_waiting = FALSE;
+    _writer_status.clear_err();
+    return;
+}
+
+
 #endif  // end of __CONSTRUCT_AND_DESTRUCTORS
 
 
@@ -202,10 +321,12 @@ struct Error TCPItnlSession::init(TCPServer *server, int fd, WorkerFunc func, co
 
     _event_arg = arg;
     arg->session = this;
+    arg->fd = fd;
     arg->libevent_what_ptr = _libevent_what_storage;
     arg->worker_func = func;
     arg->user_arg = user_arg;
     arg->coroutine = NULL;
+    arg->accept_time = ::andrewmc::cpptools::sys_up_timeval();
     memcpy(&_remote_addr, remote_addr, _addr_len);
 
     // create routine for libco
@@ -216,9 +337,8 @@ struct Error TCPItnlSession::init(TCPServer *server, int fd, WorkerFunc func, co
         return _status;
     }
 
-    // non block
+    // fd is already non-blocking, it is accepted by accept4()
     _fd = fd;
-    set_fd_nonblock(fd);
 
     // create event
     _server = server;
@@ -236,6 +356,9 @@ struct Error TCPItnlSession::init(TCPServer *server, int fd, WorkerFunc func, co
         event_add(_event, &sleep_time);
     }
 
+    // idle and lifetime limit
+    attach_reaper(server->session_reaper());
+
     // auto_free
     _owner_base->put_event_under_control(this);
 
@@ -252,34 +375,491 @@ struct Error TCPItnlSession::init(TCPServer *server, int fd, WorkerFunc func, co
 
 struct Error TCPItnlSession::reply(const void *data, const size_t data_len, size_t *send_len_out_nullable)
 {
-    ssize_t send_len = 0;
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    size_t total_sent = 0;
 
     if (!(data && data_len)) {
         _status.set_app_errno(ERR_PARA_NULL);
+        goto END;
     }
-    else if (_fd <= 0) {
+    if (_fd <= 0) {
         _status.set_app_errno(ERR_NOT_INITIALIZED);
+        goto END;
     }
-    else {
-        send_len = write(_fd, data, data_len);
-        if (send_len < 0) {
+    _status.clear_err();
+
+    // full-duplex, data goes after those queued
+    if (_writer_arg) {
+        _status = reply_async(data, data_len);
+        total_sent = _status.is_ok() ? data_len : 0;
+        goto END;
+    }
+
+    // encrypted, waiting is done by TLS stream
+    if (_tls) {
+        _status = _tls_send(data, data_len, &total_sent);
+    }
+
+    while (NULL == _tls && total_sent < data_len)
+    {
+        ssize_t send_len = ::send(_fd, (const uint8_t *)data + total_sent, data_len - total_sent, MSG_NOSIGNAL);
+        if (send_len > 0) {
+            total_sent += send_len;
+            continue;
+        }
+        if (send_len < 0 && EINTR == errno) {
+            continue;
+        }
+        if (send_len < 0 && EAGAIN != errno && EWOULDBLOCK != errno) {
             _status.set_sys_errno();
+            break;
         }
-        else {
-            _status.clear_err();
+
+        // socket buffer full, wait until writable and then switch back to read event
+        event_del(_event);
+        event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_WRITE, _libevent_callback, arg);
+        struct timeval timeout = {FOREVER_SECONDS, 0};
+        event_add(_event, &timeout);
+        co_yield(arg->coroutine);
+
+        uint32_t libevent_what = *_libevent_what_storage;
+        event_del(_event);
+        event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);
+        *_libevent_what_storage = 0;
+
+        if (FALSE == event_writable(libevent_what)) {
+            ERROR("unrecognized event flag: 0x%04x", (unsigned)libevent_what);
+            _status.set_app_errno(ERR_UNKNOWN);
+            break;
+        }
+    }
+
+    if (total_sent > 0) {
+        _server->notify_session_io(_fd, 0, total_sent);
+        if (_reaper_entry) {
+            _reaper->touch(_reaper_entry);
         }
     }
 
+END:
     if (send_len_out_nullable) {
-        *send_len_out_nullable = (send_len > 0) ? send_len : 0;
+        *send_len_out_nullable = total_sent;
     }
     return _status;
 }
 
 
+// send without blocking, errno is EAGAIN if socket buffer or TLS engine wants to wait
+ssize_t TCPItnlSession::_send_nonblock(const struct iovec *iov, size_t iov_count)
+{
+    if (NULL == _tls) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec *)iov;
+        msg.msg_iovlen = iov_count;
+        return sendmsg(_fd, &msg, MSG_NOSIGNAL);
+    }
+
+    // one record at a time, TLS has no writev
+    struct Error status;
+    short want_what = 0;
+    ssize_t send_len = _tls->write(iov[0].iov_base, iov[0].iov_len, &want_what, &status);
+    if (send_len < 0) {
+        errno = want_what ? EAGAIN : EPROTO;
+    }
+    return send_len;
+}
+
+
 #endif  // end of __SEND_FUNCTION
 
 
+// ==========
+#define __SEND_FILE_FUNCTION
+#ifdef __SEND_FILE_FUNCTION
+
+struct Error TCPItnlSession::send_file(int file_fd, off_t offset, size_t length, size_t *send_len_out_nullable)
+{
+    size_t total_sent = 0;
+
+    if (file_fd < 0 || 0 == length) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        goto END;
+    }
+    if (_fd <= 0) {
+        _status.set_app_errno(ERR_NOT_CONNECTED);
+        goto END;
+    }
+    if (_outbound_bytes > 0) {
+        ERROR("%s still has %u bytes queued to writer", _identifier.c_str(), (unsigned)_outbound_bytes);
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        goto END;
+    }
+    _status.clear_err();
+
+    while (total_sent < length)
+    {
+        ssize_t send_len = 0;
+        short want_what = EV_WRITE;
+
+        if (_tls) {
+            send_len = _tls->send_file(file_fd, offset + total_sent, length - total_sent, &want_what, &_status);
+            if (send_len < 0 && 0 == want_what) {
+                break;
+            }
+        }
+        else {
+            off_t file_offset = offset + total_sent;
+            send_len = ::sendfile(_fd, file_fd, &file_offset, length - total_sent);
+            if (0 == send_len) {
+                ERROR("%s file ends before %u bytes", _identifier.c_str(), (unsigned)length);
+                _status.set_app_errno(ERR_PARA_ILLEGAL);
+                break;
+            }
+            if (send_len < 0 && EINTR == errno) {
+                continue;
+            }
+            if (send_len < 0 && EAGAIN != errno && EWOULDBLOCK != errno) {
+                _status.set_sys_errno();
+                break;
+            }
+        }
+
+        if (send_len > 0) {
+            total_sent += send_len;
+            continue;
+        }
+
+        // wait until socket is ready
+        struct timeval timeout = {FOREVER_SECONDS, 0};
+        watch_io(want_what, &timeout);
+        co_yield(co_self());
+        uint32_t libevent_what = unwatch_io();
+        if (_is_reaped) {
+            _status.set_app_errno(ERR_SESSION_REAPED);
+            break;
+        }
+        if (FALSE == event_readable(libevent_what) && FALSE == event_writable(libevent_what)) {
+            ERROR("unrecognized event flag: 0x%04x", (unsigned)libevent_what);
+            _status.set_app_errno(ERR_UNKNOWN);
+            break;
+        }
+    }
+
+    if (total_sent > 0) {
+        _server->notify_session_io(_fd, 0, total_sent);
+        if (_reaper_entry) {
+            _reaper->touch(_reaper_entry);
+        }
+    }
+
+END:
+    if (send_len_out_nullable) {
+        *send_len_out_nullable = total_sent;
+    }
+    return _status;
+}
+
+
+#endif  // end of __SEND_FILE_FUNCTION
+
+
+// ==========
+#define __DUPLEX_WRITER_FUNCTIONS
+#ifdef __DUPLEX_WRITER_FUNCTIONS
+
+struct Error TCPItnlSession::start_writer()
+{
+    if (_writer_arg) {
+        return _writer_status;
+    }
+    if (_fd <= 0 || NULL == _owner_base) {
+        _writer_status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _writer_status;
+    }
+    _writer_status.clear_err();
+
+    struct _WriterArg *arg = (struct _WriterArg *)malloc(sizeof(*arg));
+    if (NULL == arg) {
+        throw std::bad_alloc();
+        _writer_status.set_sys_errno();
+        return _writer_status;
+    }
+    arg->session = this;
+    arg->event = NULL;
+    arg->coroutine = NULL;
+    arg->is_reader_ended = FALSE;
+    _writer_arg = arg;
+
+    int call_ret = co_create(&(arg->coroutine), NULL, _libco_writer_routine, arg);
+    if (call_ret != 0) {
+        arg->coroutine = NULL;
+        _writer_status.set_app_errno(ERR_LIBCO_CREATE);
+        return _writer_status;
+    }
+
+    // event is added only when there is data to send, coroutine starts on first writable event
+    arg->event = event_new(_owner_base->event_base(), _fd, EV_WRITE, _libevent_writer_callback, arg);
+    if (NULL == arg->event) {
+        _writer_status.set_app_errno(ERR_EVENT_EVENT_NEW);
+        return _writer_status;
+    }
+
+    _is_writer_idle = TRUE;
+    DEBUG("%s writer started", _identifier.c_str());
+    return _writer_status;
+}
+
+
+struct Error TCPItnlSession::_enqueue_outbound(const void *data, const size_t data_len)
+{
+    if (!(data && data_len)) {
+        struct Error status;
+        status.set_app_errno(ERR_PARA_NULL);
+        return status;
+    }
+    if (_is_reaped) {
+        _writer_status.set_app_errno(ERR_SESSION_REAPED);
+        return _writer_status;
+    }
+    if (NULL == _writer_arg && start_writer().is_error()) {
+        return _writer_status;
+    }
+    if (_writer_status.is_error()) {
+        return _writer_status;      // writer stopped on error
+    }
+
+    struct _WriterArg *arg = (struct _WriterArg *)_writer_arg;
+    if (_fd <= 0 || NULL == arg->event) {
+        _writer_status.set_app_errno(ERR_NOT_CONNECTED);
+        return _writer_status;
+    }
+
+    // nothing queued, try sending directly
+    size_t sent_len = 0;
+    if (_outbound.empty())
+    {
+        struct iovec iov;
+        iov.iov_base = (void *)data;
+        iov.iov_len = data_len;
+        ssize_t send_len = _send_nonblock(&iov, 1);
+        if (send_len > 0) {
+            sent_len = (size_t)send_len;
+            _server->notify_session_io(_fd, 0, sent_len);
+            if (_reaper_entry) {
+                _reaper->touch(_reaper_entry);
+            }
+            if (sent_len == data_len) {
+                return _writer_status;
+            }
+        }
+        else if (send_len < 0 && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+            _writer_status.set_sys_errno();
+            return _writer_status;
+        }
+    }
+
+    // small pieces are merged to reduce writev() entries
+    const char *remain = (const char *)data + sent_len;
+    size_t remain_len = data_len - sent_len;
+    if (FALSE == _outbound.empty() && _outbound.back().length() + remain_len <= _OUTBOUND_MERGE_SIZE) {
+        _outbound.back().append(remain, remain_len);
+    } else {
+        _outbound.push_back(std::string(remain, remain_len));
+    }
+    _outbound_bytes += remain_len;
+
+    // wake up writer
+    if (_is_writer_idle) {
+        _is_writer_idle = FALSE;
+        event_add(arg->event, NULL);
+    }
+    return _writer_status;
+}
+
+
+struct Error TCPItnlSession::post(const void *data, const size_t data_len)
+{
+    if (_high_watermark > 0 && _outbound_bytes >= _high_watermark) {
+        struct Error status;
+        status.set_app_errno(ERR_OUTBOUND_FULL);
+        return status;
+    }
+    return _enqueue_outbound(data, data_len);
+}
+
+
+struct Error TCPItnlSession::reply_async(const void *data, const size_t data_len)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+
+    // other coroutines cannot be suspended by this session
+    if (NULL == arg || co_self() != arg->coroutine) {
+        return post(data, data_len);
+    }
+
+    struct Error status = _enqueue_outbound(data, data_len);
+    if (status.is_error() || 0 == _high_watermark || _outbound_bytes <= _high_watermark) {
+        return status;
+    }
+
+    // backpressure, resumed by writer
+    DEBUG("%s outbound %u bytes, wait for writer", _identifier.c_str(), (unsigned)_outbound_bytes);
+    while (_writer_status.is_ok() && _outbound_bytes > _low_watermark)
+    {
+        _is_producer_waiting = TRUE;
+        *_libevent_what_storage = 0;
+        co_yield(arg->coroutine);
+        _is_producer_waiting = FALSE;
+    }
+    if (_is_reaped) {
+        _writer_status.set_app_errno(ERR_SESSION_REAPED);
+    }
+    return _writer_status;
+}
+
+
+void TCPItnlSession::_wake_producer()
+{
+    if (_is_producer_waiting && _event) {
+        _is_producer_waiting = FALSE;
+        event_active(_event, EV_WRITE, 1);
+    }
+    return;
+}
+
+
+size_t TCPItnlSession::outbound_bytes()
+{
+    return _outbound_bytes;
+}
+
+
+void TCPItnlSession::set_write_watermarks(size_t high_watermark, size_t low_watermark)
+{
+    _high_watermark = high_watermark;
+    _low_watermark = (low_watermark < high_watermark) ? low_watermark : high_watermark / 2;
+    return;
+}
+
+
+size_t TCPItnlSession::write_high_watermark()
+{
+    return _high_watermark;
+}
+
+
+size_t TCPItnlSession::write_low_watermark()
+{
+    return _low_watermark;
+}
+
+
+void TCPItnlSession::_consume_outbound(size_t length)
+{
+    _outbound_bytes -= length;
+    while (length > 0)
+    {
+        size_t front_left = _outbound.front().length() - _outbound_offset;
+        if (length < front_left) {
+            _outbound_offset += length;
+            return;
+        }
+        length -= front_left;
+        _outbound.pop_front();
+        _outbound_offset = 0;
+    }
+    return;
+}
+
+
+void TCPItnlSession::run_writer()
+{
+    struct _WriterArg *arg = (struct _WriterArg *)_writer_arg;
+    struct iovec iov[_WRITER_IOV_MAX];
+
+    while (1)
+    {
+        if (_outbound.empty())
+        {
+            if (arg->is_reader_ended) {
+                break;
+            }
+            // wait for post()
+            _is_writer_idle = TRUE;
+            co_yield(arg->coroutine);
+            continue;
+        }
+        if (_fd <= 0) {
+            _writer_status.set_app_errno(ERR_NOT_CONNECTED);
+            break;
+        }
+
+        size_t iov_count = 0;
+        for (std::deque<std::string>::iterator each_buff = _outbound.begin();
+            each_buff != _outbound.end() && iov_count < _WRITER_IOV_MAX;
+            each_buff ++, iov_count ++)
+        {
+            size_t offset = (0 == iov_count) ? _outbound_offset : 0;
+            iov[iov_count].iov_base = (void *)(each_buff->data() + offset);
+            iov[iov_count].iov_len = each_buff->length() - offset;
+        }
+
+        ssize_t send_len = _send_nonblock(iov, iov_count);
+        if (send_len > 0) {
+            _consume_outbound((size_t)send_len);
+            _server->notify_session_io(_fd, 0, (size_t)send_len);
+            if (_reaper_entry) {
+                _reaper->touch(_reaper_entry);
+            }
+            if (_outbound_bytes <= _low_watermark) {
+                _wake_producer();
+            }
+        }
+        else if (send_len < 0 && EINTR == errno) {
+            continue;
+        }
+        else if (send_len < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+            event_add(arg->event, NULL);
+            co_yield(arg->coroutine);
+        }
+        else {
+            _writer_status.set_sys_errno();
+            ERROR("%s writer stopped: %s", _identifier.c_str(), _writer_status.c_err_msg());
+            break;
+        }
+    }
+
+    // data left is discarded on error
+    _outbound.clear();
+    _outbound_offset = 0;
+    _outbound_bytes = 0;
+    _is_writer_idle = FALSE;
+    _wake_producer();
+    return;
+}
+
+
+BOOL TCPItnlSession::hold_for_writer()
+{
+    struct _WriterArg *arg = (struct _WriterArg *)_writer_arg;
+    if (NULL == arg) {
+        return FALSE;
+    }
+
+    arg->is_reader_ended = TRUE;
+    if (NULL == arg->coroutine || is_coroutine_end(arg->coroutine)) {
+        return FALSE;
+    }
+    if (_outbound.empty() || _fd <= 0) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#endif  // end of __DUPLEX_WRITER_FUNCTIONS
+
+
 // ==========
 #define __RECV_FUNCTION
 #ifdef __RECV_FUNCTION
@@ -301,58 +881,50 @@ struct Error TCPItnlSession::recv_in_timeval(void *data_out, const size_t len_li
         _status.set_app_errno(ERR_NOT_INITIALIZED);
         goto END;
     }
+    if (_is_reaped) {
+        _status.set_app_errno(ERR_SESSION_REAPED);
+        goto END;
+    }
     if (_fd <= 0) {
         _status.set_app_errno(ERR_NOT_CONNECTED);
         goto END;
     }
     _status.clear_err();
 
-    // recvfrom()
-    libevent_what = *_libevent_what_storage;
-    if (event_readable(libevent_what))
-    {
-        // data readable
-        recv_len = read(_fd, data_out, len_limit);
-        if (recv_len < 0) {
-            _status.set_sys_errno();
-        }
-        // EAGAIN
-        else if (0 == recv_len) {
-            DEBUG("EAGAIN");
-            *_libevent_what_storage &= ~EV_READ;
-            return recv_in_timeval(data_out, len_limit, len_out, timeout);
-        }
+    if (_tls) {
+        size_t tls_len = 0;
+        _status = _tls_recv(data_out, len_limit, &tls_len, timeout);
+        recv_len = (ssize_t)tls_len;
+        goto NOTIFY;
     }
-    else {
-        // no data avaliable
-        struct timeval clock_now = ::andrewmc::cpptools::sys_up_timeval();
-        struct timeval clock_timeout;
+
+    // read directly, wait only if no data available. 0 means closed by remote
+    recv_len = read(_fd, data_out, len_limit);
+    if ((recv_len < 0) && (EAGAIN == errno || EWOULDBLOCK == errno))
+    {
         struct timeval timeout_copy;
         timeout_copy.tv_sec = timeout.tv_sec;
         timeout_copy.tv_usec = timeout.tv_usec;
+        recv_len = 0;
 
         DEBUG("TCP libevent what flag: 0x%04x, now wait", (unsigned)(*_libevent_what_storage));
         if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
             timeout_copy.tv_sec = FOREVER_SECONDS;
-            clock_timeout.tv_sec = FOREVER_SECONDS;
         }
-        else {
-            timeradd(&clock_now, &timeout_copy, &clock_timeout);
-        }
-        *_libevent_what_storage &= ~EV_TIMEOUT;
+        *_libevent_what_storage = 0;
         event_add(_event, &timeout_copy);
         co_yield(arg->coroutine);
 
         // check if timeout
         libevent_what = *_libevent_what_storage;
-        if (event_is_timeout(libevent_what)) {
+        if (_is_reaped) {
+            _status.set_app_errno(ERR_SESSION_REAPED);
+        }
+        else if (event_is_timeout(libevent_what)) {
             _status.set_app_errno(ERR_TIMEOUT);
         }
         else if (event_readable(libevent_what)) {
             recv_len = read(_fd, data_out, len_limit);
-            if (recv_len < 0) {
-                _status.set_sys_errno();
-            }
         }
         else {
             ERROR("unrecognized event flag: 0x%04u", libevent_what);
@@ -360,6 +932,17 @@ struct Error TCPItnlSession::recv_in_timeval(void *data_out, const size_t len_li
         }
     }
 
+NOTIFY:
+    if (recv_len < 0) {
+        _status.set_sys_errno();
+    }
+    else if (recv_len > 0) {
+        _server->notify_session_io(_fd, (size_t)recv_len, 0);
+        if (_reaper_entry) {
+            _reaper->touch(_reaper_entry);
+        }
+    }
+
     // write read data len and return
 END:
     if (len_out) {
@@ -408,6 +991,24 @@ struct Error TCPItnlSession::disconnect()
         return _status;
     }
 
+    // queued data is discarded
+    struct _WriterArg *writer_arg = (struct _WriterArg *)_writer_arg;
+    if (writer_arg && writer_arg->event) {
+        event_del(writer_arg->event);
+        _outbound.clear();
+        _outbound_offset = 0;
+        _outbound_bytes = 0;
+        _writer_status.set_app_errno(ERR_NOT_CONNECTED);
+    }
+
+    if (_tls) {
+        _tls->shutdown();
+        delete _tls;
+        _tls = NULL;
+    }
+
+    // release fd slot in server before the fd number is reused
+    _server->notify_session_ends(this);
     close(_fd);
     _fd = 0;
 
@@ -500,6 +1101,73 @@ int TCPItnlSession::file_descriptor()
 }
 
 
+struct stCoRoutine_t *TCPItnlSession::_coroutine()
+{
+    if (_event_arg) {
+        struct _EventArg *arg = (struct _EventArg *)_event_arg;
+        return arg->coroutine;
+    }
+    else {
+        return NULL;
+    }
+}
+
+
+void TCPItnlSession::watch_io(short what, const struct timeval *timeout_nullable)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (NULL == _event || NULL == arg) {
+        return;
+    }
+
+    event_del(_event);
+    event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | what, _libevent_callback, arg);
+    *_libevent_what_storage = 0;
+    if (what || timeout_nullable) {
+        event_add(_event, timeout_nullable);
+    }
+    return;
+}
+
+
+uint32_t TCPItnlSession::unwatch_io()
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (NULL == _event || NULL == arg) {
+        return 0;
+    }
+
+    uint32_t libevent_what = *_libevent_what_storage;
+    event_del(_event);
+    event_assign(_event, _owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);
+    *_libevent_what_storage = 0;
+    return libevent_what;
+}
+
+
+void TCPItnlSession::reap()
+{
+    // entry is already released by reaper. Shutdown wakes up pending recv() with EOF
+    _reaper_entry = NULL;
+    _is_reaped = TRUE;
+    if (_fd > 0) {
+        shutdown(_fd, SHUT_RDWR);
+    }
+    return;
+}
+
+
+void TCPItnlSession::attach_reaper(SessionReaper *reaper)
+{
+    if (NULL == reaper || _reaper_entry || _is_reaped) {
+        return;
+    }
+    _reaper = reaper;
+    _reaper_entry = _reaper->add(this);
+    return;
+}
+
+
 NetType_t TCPItnlSession::network_type()
 {
     switch(_remote_addr.ss_family)
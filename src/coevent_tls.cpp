@@ -0,0 +1,813 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include "coevent_tls.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#if TLS_FLAG
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/bio.h>
+#endif
+
+using namespace andrewmc::libcoevent;
+
+// ==========
+#define __TLS_TOOLS
+#ifdef __TLS_TOOLS
+
+#if TLS_FLAG
+static void _log_ssl_errors(const char *action)
+{
+    unsigned long err_code = 0;
+    while (0 != (err_code = ERR_get_error())) {
+        char err_str[256];
+        ERR_error_string_n(err_code, err_str, sizeof(err_str));
+        ERROR("%s: %s", action, err_str);
+    }
+    return;
+}
+
+
+static void _global_init()
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    static BOOL is_initialized = FALSE;
+    if (FALSE == is_initialized) {
+        SSL_library_init();
+        SSL_load_error_strings();
+        is_initialized = TRUE;
+    }
+#endif
+    return;
+}
+
+
+// new session ticket from server, which arrives after handshake in TLS 1.3
+static int _new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+    TLSItnlStream *stream = (TLSItnlStream *)SSL_get_app_data(ssl);
+    if (NULL == stream || stream->session_key().empty()) {
+        return 0;
+    }
+    stream->context()->save_session(stream->session_key(), session);
+    return 1;       // reference is taken
+}
+#endif  // end of TLS_FLAG
+
+
+static double _now()
+{
+    struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+    return to_double(now);
+}
+
+
+// wait for socket event in the coroutine. Conn is TCPItnlSession or TCPItnlClient
+template <class Conn>
+static struct Error _wait_io(Conn *conn, short what, double deadline)
+{
+    struct Error status;
+    struct timeval timeout = {FOREVER_SECONDS, 0};
+    if (deadline > 0) {
+        double time_left = deadline - _now();
+        if (time_left <= 0) {
+            status.set_app_errno(ERR_TIMEOUT);
+            return status;
+        }
+        timeout = to_timeval(time_left);
+    }
+
+    conn->watch_io(what, &timeout);
+    co_yield(co_self());
+    uint32_t libevent_what = conn->unwatch_io();
+
+    if (FALSE == event_readable(libevent_what) && FALSE == event_writable(libevent_what)) {
+        status.set_app_errno(event_is_timeout(libevent_what) ? ERR_TIMEOUT : ERR_UNKNOWN);
+    }
+    return status;
+}
+
+
+template <class Conn>
+static struct Error _handshake(Conn *conn, TLSItnlStream *tls, double timeout_seconds)
+{
+    struct Error status;
+    double deadline = (timeout_seconds > 0) ? _now() + timeout_seconds : 0;
+
+    while (1)
+    {
+        short want_what = 0;
+        int ret = tls->handshake(&want_what, &status);
+        if (ret > 0) {
+            break;
+        }
+        if (ret < 0) {
+            break;
+        }
+        status = _wait_io(conn, want_what, deadline);
+        if (status.is_error()) {
+            break;
+        }
+    }
+    return status;
+}
+
+
+// read once, waiting if nothing is available
+template <class Conn>
+static struct Error _read_some(Conn *conn, TLSItnlStream *tls, void *data_out, size_t len_limit, size_t *len_out, const struct timeval &timeout)
+{
+    struct Error status;
+    double deadline = 0;
+    if (timeout.tv_sec || timeout.tv_usec) {
+        struct timeval timeout_copy = timeout;
+        deadline = _now() + to_double(timeout_copy);
+    }
+
+    *len_out = 0;
+    while (1)
+    {
+        short want_what = 0;
+        ssize_t read_len = tls->read(data_out, len_limit, &want_what, &status);
+        if (read_len >= 0) {
+            *len_out = (size_t)read_len;
+            break;
+        }
+        if (0 == want_what) {
+            break;
+        }
+        status = _wait_io(conn, want_what, deadline);
+        if (status.is_error()) {
+            break;
+        }
+    }
+    return status;
+}
+
+
+template <class Conn>
+static struct Error _write_all(Conn *conn, TLSItnlStream *tls, const void *data, size_t data_len, size_t *send_len_out)
+{
+    struct Error status;
+    size_t total_sent = 0;
+
+    while (total_sent < data_len)
+    {
+        short want_what = 0;
+        ssize_t send_len = tls->write((const uint8_t *)data + total_sent, data_len - total_sent, &want_what, &status);
+        if (send_len > 0) {
+            total_sent += send_len;
+            continue;
+        }
+        if (0 == want_what) {
+            break;
+        }
+        status = _wait_io(conn, want_what, 0);
+        if (status.is_error()) {
+            break;
+        }
+    }
+
+    *send_len_out = total_sent;
+    return status;
+}
+
+#endif  // end of __TLS_TOOLS
+
+
+// ==========
+#define __TLS_CONTEXT
+#ifdef __TLS_CONTEXT
+
+TLSContext::TLSContext()
+{
+    _ssl_ctx = NULL;
+    _is_server = FALSE;
+    _is_ktls_enabled = TRUE;
+    _is_verify_peer = FALSE;
+    pthread_mutex_init(&_session_lock, NULL);
+    return;
+}
+
+
+TLSContext::~TLSContext()
+{
+#if TLS_FLAG
+    for (std::map<std::string, void *>::iterator each_session = _client_sessions.begin();
+        each_session != _client_sessions.end();
+        each_session ++)
+    {
+        SSL_SESSION_free((SSL_SESSION *)each_session->second);
+    }
+    _client_sessions.clear();
+
+    if (_ssl_ctx) {
+        SSL_CTX_free((SSL_CTX *)_ssl_ctx);
+        _ssl_ctx = NULL;
+    }
+#endif
+    pthread_mutex_destroy(&_session_lock);
+    return;
+}
+
+
+struct Error TLSContext::init_server(const std::string &cert_chain_file, const std::string &private_key_file)
+{
+#if TLS_FLAG
+    if (_ssl_ctx) {
+        _status.set_app_errno(ERR_ALREADY_CONNECTED);
+        return _status;
+    }
+    _global_init();
+
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
+    if (NULL == ctx) {
+        _log_ssl_errors("SSL_CTX_new");
+        _status.set_app_errno(ERR_TLS_HANDSHAKE);
+        return _status;
+    }
+
+    SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_chain_file.c_str()) <= 0
+        || SSL_CTX_use_PrivateKey_file(ctx, private_key_file.c_str(), SSL_FILETYPE_PEM) <= 0
+        || SSL_CTX_check_private_key(ctx) <= 0)
+    {
+        _log_ssl_errors("load certificate");
+        SSL_CTX_free(ctx);
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+
+    _ssl_ctx = ctx;
+    _is_server = TRUE;
+    set_ktls(_is_ktls_enabled);
+    _status.clear_err();
+#else
+    _status.set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return _status;
+}
+
+
+struct Error TLSContext::init_client(const std::string &ca_file, BOOL verify_peer)
+{
+#if TLS_FLAG
+    if (_ssl_ctx) {
+        _status.set_app_errno(ERR_ALREADY_CONNECTED);
+        return _status;
+    }
+    _global_init();
+
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_client_method());
+    if (NULL == ctx) {
+        _log_ssl_errors("SSL_CTX_new");
+        _status.set_app_errno(ERR_TLS_HANDSHAKE);
+        return _status;
+    }
+
+    SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    if (verify_peer)
+    {
+        int load_ret = ca_file.empty() ? SSL_CTX_set_default_verify_paths(ctx) : SSL_CTX_load_verify_locations(ctx, ca_file.c_str(), NULL);
+        if (load_ret <= 0) {
+            _log_ssl_errors("load CA");
+            SSL_CTX_free(ctx);
+            _status.set_app_errno(ERR_PARA_ILLEGAL);
+            return _status;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    }
+
+    // sessions are cached by TLSContext, not by OpenSSL
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, _new_session_callback);
+
+    _ssl_ctx = ctx;
+    _is_server = FALSE;
+    _is_verify_peer = verify_peer;
+    set_ktls(_is_ktls_enabled);
+    _status.clear_err();
+#else
+    _status.set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return _status;
+}
+
+
+BOOL TLSContext::is_server()
+{
+    return _is_server;
+}
+
+
+BOOL TLSContext::is_verify_peer()
+{
+    return _is_verify_peer;
+}
+
+
+void TLSContext::set_ktls(BOOL enable)
+{
+    _is_ktls_enabled = enable ? TRUE : FALSE;
+#if TLS_FLAG && defined(SSL_OP_ENABLE_KTLS)
+    if (_ssl_ctx) {
+        if (_is_ktls_enabled) {
+            SSL_CTX_set_options((SSL_CTX *)_ssl_ctx, SSL_OP_ENABLE_KTLS);
+        } else {
+            SSL_CTX_clear_options((SSL_CTX *)_ssl_ctx, SSL_OP_ENABLE_KTLS);
+        }
+    }
+#endif
+    return;
+}
+
+
+BOOL TLSContext::ktls()
+{
+    return _is_ktls_enabled;
+}
+
+
+struct Error TLSContext::set_ticket_keys(const void *keys, size_t keys_len)
+{
+#if TLS_FLAG
+    if (NULL == _ssl_ctx) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (NULL == keys || 0 == keys_len) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    if (SSL_CTX_set_tlsext_ticket_keys((SSL_CTX *)_ssl_ctx, (void *)keys, (long)keys_len) <= 0) {
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+    _status.clear_err();
+#else
+    _status.set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return _status;
+}
+
+
+void *TLSContext::native_handle()
+{
+    return _ssl_ctx;
+}
+
+
+void TLSContext::save_session(const std::string &key, void *ssl_session)
+{
+#if TLS_FLAG
+    pthread_mutex_lock(&_session_lock);
+    std::map<std::string, void *>::iterator session_iter = _client_sessions.find(key);
+    if (_client_sessions.end() != session_iter) {
+        SSL_SESSION_free((SSL_SESSION *)session_iter->second);
+        session_iter->second = ssl_session;
+    } else {
+        _client_sessions[key] = ssl_session;
+    }
+    pthread_mutex_unlock(&_session_lock);
+#endif
+    return;
+}
+
+
+void *TLSContext::take_session(const std::string &key)
+{
+    void *ssl_session = NULL;
+#if TLS_FLAG
+    pthread_mutex_lock(&_session_lock);
+    std::map<std::string, void *>::iterator session_iter = _client_sessions.find(key);
+    if (_client_sessions.end() != session_iter) {
+        ssl_session = session_iter->second;
+        SSL_SESSION_up_ref((SSL_SESSION *)ssl_session);
+    }
+    pthread_mutex_unlock(&_session_lock);
+#endif
+    return ssl_session;
+}
+
+#endif  // end of __TLS_CONTEXT
+
+
+// ==========
+#define __TLS_STREAM
+#ifdef __TLS_STREAM
+
+TLSItnlStream::TLSItnlStream()
+{
+    _ssl = NULL;
+    _context = NULL;
+    _is_ktls_send = FALSE;
+    _is_ktls_recv = FALSE;
+    return;
+}
+
+
+TLSItnlStream::~TLSItnlStream()
+{
+#if TLS_FLAG
+    if (_ssl) {
+        SSL_free((SSL *)_ssl);
+        _ssl = NULL;
+    }
+#endif
+    return;
+}
+
+
+struct Error TLSItnlStream::init(TLSContext *context, int fd, BOOL is_server, const std::string &server_name, const std::string &session_key)
+{
+    struct Error status;
+#if TLS_FLAG
+    if (NULL == context || NULL == context->native_handle()) {
+        status.set_app_errno(ERR_NOT_INITIALIZED);
+        return status;
+    }
+
+    SSL *ssl = SSL_new((SSL_CTX *)context->native_handle());
+    if (NULL == ssl) {
+        _log_ssl_errors("SSL_new");
+        status.set_app_errno(ERR_TLS_HANDSHAKE);
+        return status;
+    }
+    SSL_set_fd(ssl, fd);
+    SSL_set_app_data(ssl, this);
+    _ssl = ssl;
+    _context = context;
+
+    if (is_server) {
+        SSL_set_accept_state(ssl);
+        return status;
+    }
+
+    SSL_set_connect_state(ssl);
+    if (FALSE == server_name.empty()) {
+        SSL_set_tlsext_host_name(ssl, server_name.c_str());
+        if (context->is_verify_peer()) {
+            SSL_set1_host(ssl, server_name.c_str());
+        }
+    }
+
+    _session_key = session_key;
+    SSL_SESSION *session = (SSL_SESSION *)context->take_session(session_key);
+    if (session) {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+#else
+    status.set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return status;
+}
+
+
+#if TLS_FLAG
+// convert SSL_get_error() to waiting flag or error status
+static void _check_ssl_error(SSL *ssl, int ret, short *want_what_out, struct Error *status_out)
+{
+    int ssl_err = SSL_get_error(ssl, ret);
+    *want_what_out = 0;
+    switch (ssl_err)
+    {
+        case SSL_ERROR_WANT_READ:
+            *want_what_out = EV_READ;
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            *want_what_out = EV_WRITE;
+            break;
+        case SSL_ERROR_SYSCALL:
+            if (errno) {
+                status_out->set_sys_errno();
+            } else {
+                status_out->set_app_errno(ERR_NOT_CONNECTED);
+            }
+            ERR_clear_error();
+            break;
+        default:
+            _log_ssl_errors("TLS");
+            status_out->set_app_errno(ERR_TLS_IO);
+            break;
+    }
+    return;
+}
+#endif
+
+
+int TLSItnlStream::handshake(short *want_what_out, struct Error *status_out)
+{
+    *want_what_out = 0;
+#if TLS_FLAG
+    ERR_clear_error();
+    errno = 0;
+    int ret = SSL_do_handshake((SSL *)_ssl);
+    if (1 == ret)
+    {
+        BIO *wbio = SSL_get_wbio((SSL *)_ssl);
+        BIO *rbio = SSL_get_rbio((SSL *)_ssl);
+        (void)wbio;
+        (void)rbio;
+#ifndef OPENSSL_NO_KTLS
+#ifdef BIO_get_ktls_send
+        _is_ktls_send = BIO_get_ktls_send(wbio) ? TRUE : FALSE;
+        _is_ktls_recv = BIO_get_ktls_recv(rbio) ? TRUE : FALSE;
+#endif
+#endif
+        DEBUG("TLS handshake done, %s, kTLS send %d recv %d, resumed %d", SSL_get_version((SSL *)_ssl),
+                _is_ktls_send, _is_ktls_recv, SSL_session_reused((SSL *)_ssl));
+        status_out->clear_err();
+        return 1;
+    }
+
+    _check_ssl_error((SSL *)_ssl, ret, want_what_out, status_out);
+    if (*want_what_out) {
+        return 0;
+    }
+    if (status_out->is_ok() || ERR_NOT_CONNECTED == status_out->app_err_code()) {
+        status_out->set_app_errno(ERR_TLS_HANDSHAKE);
+    }
+#else
+    status_out->set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return -1;
+}
+
+
+ssize_t TLSItnlStream::read(void *data_out, size_t len_limit, short *want_what_out, struct Error *status_out)
+{
+    *want_what_out = 0;
+#if TLS_FLAG
+    ERR_clear_error();
+    errno = 0;
+    int ret = SSL_read((SSL *)_ssl, data_out, (len_limit > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)len_limit);
+    if (ret > 0) {
+        return ret;
+    }
+    if (SSL_ERROR_ZERO_RETURN == SSL_get_error((SSL *)_ssl, ret)) {
+        return 0;       // close_notify
+    }
+    _check_ssl_error((SSL *)_ssl, ret, want_what_out, status_out);
+    if (0 == *want_what_out && ERR_NOT_CONNECTED == status_out->app_err_code()) {
+        status_out->clear_err();
+        return 0;       // EOF without close_notify
+    }
+#else
+    status_out->set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return -1;
+}
+
+
+ssize_t TLSItnlStream::write(const void *data, size_t data_len, short *want_what_out, struct Error *status_out)
+{
+    *want_what_out = 0;
+#if TLS_FLAG
+    ERR_clear_error();
+    errno = 0;
+    int ret = SSL_write((SSL *)_ssl, data, (data_len > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)data_len);
+    if (ret > 0) {
+        return ret;
+    }
+    _check_ssl_error((SSL *)_ssl, ret, want_what_out, status_out);
+#else
+    status_out->set_app_errno(ERR_TLS_NOT_SUPPORTED);
+#endif
+    return -1;
+}
+
+
+ssize_t TLSItnlStream::send_file(int file_fd, off_t offset, size_t length, short *want_what_out, struct Error *status_out)
+{
+    *want_what_out = 0;
+#if TLS_FLAG
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+    if (_is_ktls_send)
+    {
+        ERR_clear_error();
+        errno = 0;
+        ossl_ssize_t ret = SSL_sendfile((SSL *)_ssl, file_fd, offset, length, 0);
+        if (ret > 0) {
+            return (ssize_t)ret;
+        }
+        if (EAGAIN == errno || EWOULDBLOCK == errno) {
+            *want_what_out = EV_WRITE;
+            return -1;
+        }
+        status_out->set_sys_errno();
+        return -1;
+    }
+#endif
+
+    // userspace encryption
+    uint8_t buff[16 * 1024];
+    size_t read_limit = (length < sizeof(buff)) ? length : sizeof(buff);
+    ssize_t read_len = pread(file_fd, buff, read_limit, offset);
+    if (read_len <= 0) {
+        if (read_len < 0) {
+            status_out->set_sys_errno();
+        } else {
+            status_out->set_app_errno(ERR_PARA_ILLEGAL);    // file shorter than required
+        }
+        return -1;
+    }
+    return write(buff, (size_t)read_len, want_what_out, status_out);
+#else
+    status_out->set_app_errno(ERR_TLS_NOT_SUPPORTED);
+    return -1;
+#endif
+}
+
+
+void TLSItnlStream::shutdown()
+{
+#if TLS_FLAG
+    if (_ssl && SSL_is_init_finished((SSL *)_ssl)) {
+        ERR_clear_error();
+        SSL_shutdown((SSL *)_ssl);
+        ERR_clear_error();
+    }
+#endif
+    return;
+}
+
+
+BOOL TLSItnlStream::is_ktls_send()
+{
+    return _is_ktls_send;
+}
+
+
+BOOL TLSItnlStream::is_ktls_recv()
+{
+    return _is_ktls_recv;
+}
+
+
+TLSContext *TLSItnlStream::context()
+{
+    return _context;
+}
+
+
+const std::string &TLSItnlStream::session_key()
+{
+    return _session_key;
+}
+
+#endif  // end of __TLS_STREAM
+
+
+// ==========
+#define __TLS_SESSION_FUNCTIONS
+#ifdef __TLS_SESSION_FUNCTIONS
+
+struct Error TCPItnlSession::start_tls(TLSContext *context, double timeout_seconds)
+{
+    if (NULL == context) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    if (_tls) {
+        _status.set_app_errno(ERR_ALREADY_CONNECTED);
+        return _status;
+    }
+    if (_fd <= 0) {
+        _status.set_app_errno(ERR_NOT_CONNECTED);
+        return _status;
+    }
+
+    TLSItnlStream *tls = new TLSItnlStream;
+    _status = tls->init(context, _fd, TRUE, "", "");
+    if (_status.is_ok()) {
+        _status = _handshake(this, tls, timeout_seconds);
+    }
+    if (_status.is_error()) {
+        DEBUG("%s TLS handshake failed: %s", _identifier.c_str(), _status.c_err_msg());
+        delete tls;
+        return _status;
+    }
+
+    _tls = tls;
+    return _status;
+}
+
+
+BOOL TCPItnlSession::is_tls()
+{
+    return _tls ? TRUE : FALSE;
+}
+
+
+BOOL TCPItnlSession::is_ktls()
+{
+    return (_tls && _tls->is_ktls_send()) ? TRUE : FALSE;
+}
+
+
+struct Error TCPItnlSession::_tls_recv(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout)
+{
+    struct Error status = _read_some(this, _tls, data_out, len_limit, len_out, timeout);
+    if (_is_reaped) {
+        status.set_app_errno(ERR_SESSION_REAPED);
+    }
+    return status;
+}
+
+
+struct Error TCPItnlSession::_tls_send(const void *data, const size_t data_len, size_t *send_len_out)
+{
+    return _write_all(this, _tls, data, data_len, send_len_out);
+}
+
+#endif  // end of __TLS_SESSION_FUNCTIONS
+
+
+// ==========
+#define __TLS_CLIENT_FUNCTIONS
+#ifdef __TLS_CLIENT_FUNCTIONS
+
+struct Error TCPItnlClient::start_tls(TLSContext *context, const std::string &server_name, double timeout_seconds)
+{
+    if (NULL == context) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    if (_tls) {
+        _status.set_app_errno(ERR_ALREADY_CONNECTED);
+        return _status;
+    }
+    if (FALSE == _is_connected) {
+        _status.set_app_errno(ERR_NOT_CONNECTED);
+        return _status;
+    }
+
+    // sessions are resumed for the same server name and address
+    char port_str[16];
+    sprintf(port_str, ":%u", remote_port());
+    std::string session_key = server_name + "/" + remote_addr() + port_str;
+
+    TLSItnlStream *tls = new TLSItnlStream;
+    _status = tls->init(context, _fd, FALSE, server_name, session_key);
+    if (_status.is_ok()) {
+        _status = _handshake(this, tls, timeout_seconds);
+    }
+    if (_status.is_error()) {
+        DEBUG("%s TLS handshake failed: %s", _identifier.c_str(), _status.c_err_msg());
+        delete tls;
+        return _status;
+    }
+
+    _tls = tls;
+    return _status;
+}
+
+
+BOOL TCPItnlClient::is_tls()
+{
+    return _tls ? TRUE : FALSE;
+}
+
+
+BOOL TCPItnlClient::is_ktls()
+{
+    return (_tls && _tls->is_ktls_send()) ? TRUE : FALSE;
+}
+
+
+struct Error TCPItnlClient::_tls_recv(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout)
+{
+    struct Error status = _read_some(this, _tls, data_out, len_limit, len_out, timeout);
+    if (status.is_ok() && 0 == *len_out) {
+        DEBUG("%s closed by remote", _identifier.c_str());
+        _is_connected = FALSE;
+    }
+    else if (status.is_error() && FALSE == status.is_timeout()) {
+        _is_connected = FALSE;
+    }
+    return status;
+}
+
+
+struct Error TCPItnlClient::_tls_send(const void *data, const size_t data_len, size_t *send_len_out)
+{
+    struct Error status = _write_all(this, _tls, data, data_len, send_len_out);
+    if (status.is_error()) {
+        _is_connected = FALSE;
+    }
+    return status;
+}
+
+#endif  // end of __TLS_CLIENT_FUNCTIONS
+
+
+// end of file
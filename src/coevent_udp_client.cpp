@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <vector>
 
 using namespace andrewmc::libcoevent;
 
@@ -16,6 +17,8 @@ using namespace andrewmc::libcoevent;
 #define __CO_EVENT_UDP_CLIENT_DEFINITIONS
 #ifdef __CO_EVENT_UDP_CLIENT_DEFINITIONS
 
+namespace {
+
 struct _EventArg {
     UDPItnlClient       *event;
     int                 fd;
@@ -28,6 +31,8 @@ struct _EventArg {
     {}
 };
 
+}   // end of anonymous namespace
+
 #endif
 
 
@@ -41,21 +46,14 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
     struct _EventArg *arg = (struct _EventArg *)libevent_arg;
     UDPItnlClient *client = arg->event;
     Procedure *server = client->owner_server();
-    Base *base = client->owner();
+    struct stCoRoutine_t *coroutine = arg->coroutine;     // client may be deleted inside coroutine, e.g. DNS lookup of DNSCache
 
     // switch into the coroutine
     if (arg->libevent_what_ptr) {
         *(arg->libevent_what_ptr) = (uint32_t)what;
         DEBUG("libevent what: 0x%08x - %s%s", (unsigned)what, event_is_timeout(what) ? "timeout " : "", event_readable(what) ? "read" : "");
     }
-    co_resume(arg->coroutine);
-
-    // is coroutine end?
-    if (is_coroutine_end(arg->coroutine)) {
-        // delete the event if this is under control of the base
-        DEBUG("Server %s ends", server->identifier().c_str());
-        base->delete_event_under_control(server);
-    }
+    server->resume_coroutine(coroutine);
 
     // done
     return;
@@ -108,6 +106,9 @@ void UDPItnlClient::_init()
     _fd_ipv6 = 0;
     _fd_unix = 0;
     _remote_addr_len = 0;
+    _is_connected = FALSE;
+    _is_gro = FALSE;
+    _last_segment_size = 0;
     _libevent_what_storage = NULL;
 
     if (NULL == _libevent_what_storage) {
@@ -147,6 +148,7 @@ void UDPItnlClient::_clear()
     _fd_ipv4 = 0;
     _fd_ipv6 = 0;
     _fd_unix = 0;
+    _is_connected = FALSE;
     return;
 }
 
@@ -260,6 +262,32 @@ struct sockaddr *UDPItnlClient::_remote_addr()
 }
 
 
+BOOL UDPItnlClient::_is_connected_peer(const struct sockaddr *addr, socklen_t addr_len)
+{
+    if (FALSE == _is_connected) {
+        return FALSE;
+    }
+
+    if (_fd_ipv4 && AF_INET == addr->sa_family && addr_len >= sizeof(struct sockaddr_in)) {
+        const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+        return (addr4->sin_port == _remote_addr_ipv4.sin_port
+                && addr4->sin_addr.s_addr == _remote_addr_ipv4.sin_addr.s_addr) ? TRUE : FALSE;
+    }
+    else if (_fd_ipv6 && AF_INET6 == addr->sa_family && addr_len >= sizeof(struct sockaddr_in6)) {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+        return (addr6->sin6_port == _remote_addr_ipv6.sin6_port
+                && 0 == memcmp(&(addr6->sin6_addr), &(_remote_addr_ipv6.sin6_addr), sizeof(addr6->sin6_addr))) ? TRUE : FALSE;
+    }
+    else if (_fd_unix && AF_UNIX == addr->sa_family) {
+        const struct sockaddr_un *addrun = (const struct sockaddr_un *)addr;
+        return (0 == strncmp(addrun->sun_path, _remote_addr_unix.sun_path, sizeof(addrun->sun_path))) ? TRUE : FALSE;
+    }
+    else {
+        return FALSE;
+    }
+}
+
+
 #endif  // end of __MISC_FUNCTIONS
 
 
@@ -411,7 +439,11 @@ struct Error UDPItnlClient::send(const void *data, const size_t data_len, size_t
     
     ssize_t send_ret = 0;
 
-    send_ret = sendto(_fd, data, data_len, 0, addr, addr_len);
+    if (_is_connected_peer(addr, addr_len)) {
+        send_ret = ::send(_fd, data, data_len, 0);
+    } else {
+        send_ret = sendto(_fd, data, data_len, 0, addr, addr_len);
+    }
     if (send_ret < 0) {
         _status.set_sys_errno();
     }
@@ -425,17 +457,49 @@ struct Error UDPItnlClient::send(const void *data, const size_t data_len, size_t
 
 struct Error UDPItnlClient::send(const void *data, const size_t data_len, size_t *send_len_out, const std::string &target_address, unsigned target_port)
 {
-    if (0 == target_address.length()) {
-        _status.set_app_errno(ERR_PARA_NULL);
+    if (0 == target_address.length())
+    {
+        if (FALSE == _is_connected) {
+            _status.set_app_errno(ERR_PARA_NULL);
+            return _status;
+        }
+
+        // connected peer
+        _status.clear_err();
+        if (!(data && data_len)) {
+            return _status;
+        }
+        ssize_t send_ret = ::send(_fd, data, data_len, 0);
+        if (send_ret < 0) {
+            _status.set_sys_errno();
+        }
+        if (send_len_out) {
+            *send_len_out = (send_ret > 0) ? send_ret : 0;
+        }
         return _status;
     }
     else {
+        // host name, resolved by DNS cache of owner base
+        if ((_fd_ipv4 || _fd_ipv6) && FALSE == is_IP_address(target_address))
+        {
+            std::vector<std::string> ip_list;
+            DNSItnlCache *cache = (DNSItnlCache *)(_owner_base->dns_cache());
+            _status = cache->lookup(_owner_server, target_address, network_type(), DNS_LOOKUP_TIMEOUT, ip_list);
+            if (_status.is_error()) {
+                if (send_len_out) {
+                    *send_len_out = 0;
+                }
+                return _status;
+            }
+            return send(data, data_len, send_len_out, ip_list[0], target_port);
+        }
+
         if (_fd_ipv4) {
             struct sockaddr_in addr;
             convert_str_to_sockaddr_in(target_address, target_port, &addr);
             return send(data, data_len, send_len_out, (struct sockaddr *)(&addr), sizeof(addr));
         }
-        else if (_fd_ipv4) {
+        else if (_fd_ipv6) {
             struct sockaddr_in6 addr;
             convert_str_to_sockaddr_in6(target_address, target_port, &addr);
             return send(data, data_len, send_len_out, (struct sockaddr *)(&addr), sizeof(addr));
@@ -465,6 +529,10 @@ struct Error UDPItnlClient::send(const void *data, const size_t data_len, size_t
 
 struct Error UDPItnlClient::reply(const void *data, const size_t data_len, size_t *send_len_out)
 {
+    if (_is_connected) {
+        return send(data, data_len, send_len_out, "");
+    }
+
     struct sockaddr *addr = _remote_addr();
     if (NULL == addr) {
         _status.set_app_errno(ERR_NOT_INITIALIZED);
@@ -510,7 +578,7 @@ struct Error UDPItnlClient::recv_in_timeval(void *data_out, const size_t len_lim
 
     if (event_readable(libevent_what))
     {
-        recv_len = recv_from(_fd, data_out, len_limit, 0, _remote_addr(), &_remote_addr_len);
+        recv_len = _recv(data_out, len_limit);
         if (recv_len < 0) {
             _status.set_sys_errno();
         }
@@ -536,7 +604,7 @@ struct Error UDPItnlClient::recv_in_timeval(void *data_out, const size_t len_lim
         libevent_what = *_libevent_what_storage;
         if (event_readable(libevent_what))
         {
-            recv_len = recv_from(_fd, data_out, len_limit, 0, _remote_addr(), &_remote_addr_len);
+            recv_len = _recv(data_out, len_limit);
             if (recv_len < 0) {
                 _status.set_sys_errno();
             }
@@ -566,7 +634,220 @@ struct Error UDPItnlClient::recv_in_mimlisecs(void *data_out, const size_t len_l
     return recv_in_timeval(data_out, len_limit, len_out, timeout);
 }
 
+
+ssize_t UDPItnlClient::_recv(void *data_out, const size_t len_limit)
+{
+    ssize_t ret = 0;
+
+    if (_is_gro) {
+        if (_is_connected) {
+            return ::andrewmc::libcoevent::recv_segmented(_fd, data_out, len_limit, NULL, NULL, &_last_segment_size);
+        }
+        return ::andrewmc::libcoevent::recv_segmented(_fd, data_out, len_limit, _remote_addr(), &_remote_addr_len, &_last_segment_size);
+    }
+
+    if (FALSE == _is_connected) {
+        ret = recv_from(_fd, data_out, len_limit, 0, _remote_addr(), &_remote_addr_len);
+    }
+    else {
+        // remote address is always the connected peer
+        ret = ::recv(_fd, data_out, len_limit, 0);
+        if (ret < 0 && EAGAIN == errno) {
+            DEBUG("EAGAIN");
+            ret = 0;
+        }
+    }
+    _last_segment_size = (ret > 0) ? ret : 0;
+    return ret;
+}
+
 #endif
 
 
+// ==========
+#define __CONNECT_FUNCTION
+#ifdef __CONNECT_FUNCTION
+
+struct Error UDPItnlClient::connect(const struct sockaddr *addr, socklen_t addr_len)
+{
+    struct sockaddr *peer_addr = _remote_addr();
+
+    if (NULL == addr) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    if (_fd <= 0 || NULL == peer_addr) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    _status.clear_err();
+
+    if (::connect(_fd, addr, addr_len) < 0) {
+        _status.set_sys_errno();
+        return _status;
+    }
+
+    // remember the peer, which is used by remote_addr() and reply()
+    socklen_t storage_len = _fd_ipv4 ? sizeof(_remote_addr_ipv4) : (_fd_ipv6 ? sizeof(_remote_addr_ipv6) : sizeof(_remote_addr_unix));
+    memset(peer_addr, 0, storage_len);
+    memcpy(peer_addr, addr, addr_len <= storage_len ? addr_len : storage_len);
+    _remote_addr_len = addr_len <= storage_len ? addr_len : storage_len;
+    _is_connected = TRUE;
+
+    DEBUG("%s connected to %s:%u", _identifier.c_str(), remote_addr().c_str(), remote_port());
+    return _status;
+}
+
+
+struct Error UDPItnlClient::connect(const std::string &target_address, unsigned target_port)
+{
+    if (0 == target_address.length()) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+
+    // host name, resolved by DNS cache of owner base
+    if ((_fd_ipv4 || _fd_ipv6) && FALSE == is_IP_address(target_address))
+    {
+        std::vector<std::string> ip_list;
+        DNSItnlCache *cache = (DNSItnlCache *)(_owner_base->dns_cache());
+        _status = cache->lookup(_owner_server, target_address, network_type(), DNS_LOOKUP_TIMEOUT, ip_list);
+        if (_status.is_error()) {
+            return _status;
+        }
+        return connect(ip_list[0], target_port);
+    }
+
+    if (_fd_ipv4) {
+        struct sockaddr_in addr;
+        convert_str_to_sockaddr_in(target_address, target_port, &addr);
+        return connect((struct sockaddr *)(&addr), sizeof(addr));
+    }
+    else if (_fd_ipv6) {
+        struct sockaddr_in6 addr;
+        convert_str_to_sockaddr_in6(target_address, target_port, &addr);
+        return connect((struct sockaddr *)(&addr), sizeof(addr));
+    }
+    else if (_fd_unix) {
+        struct sockaddr_un addr;
+        convert_str_to_sockaddr_un(target_address, &addr);
+        return connect((struct sockaddr *)(&addr), sizeof(addr));
+    }
+    else {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+}
+
+
+struct Error UDPItnlClient::disconnect(void)
+{
+    _status.clear_err();
+    if (FALSE == _is_connected) {
+        return _status;
+    }
+
+    // dissolve the association, see connect(2)
+    struct sockaddr addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sa_family = AF_UNSPEC;
+    if (::connect(_fd, &addr, sizeof(addr)) < 0 && EAFNOSUPPORT != errno) {
+        _status.set_sys_errno();
+        return _status;
+    }
+
+    _is_connected = FALSE;
+    return _status;
+}
+
+
+BOOL UDPItnlClient::is_connected()
+{
+    return _is_connected;
+}
+
+#endif  // end of __CONNECT_FUNCTION
+
+
+// ==========
+#define __SEGMENTATION_OFFLOAD_FUNCTIONS
+#ifdef __SEGMENTATION_OFFLOAD_FUNCTIONS
+
+struct Error UDPItnlClient::send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out, const struct sockaddr *addr, socklen_t addr_len)
+{
+    ssize_t send_ret = 0;
+
+    if (send_len_out) {
+        *send_len_out = 0;
+    }
+    if (!(data && data_len && segment_size)) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    if (_fd <= 0) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (NULL == addr && FALSE == _is_connected) {
+        _status.set_app_errno(ERR_NOT_CONNECTED);
+        return _status;
+    }
+    _status.clear_err();
+
+    if (addr && _is_connected_peer(addr, addr_len)) {
+        addr = NULL;
+    }
+    send_ret = ::andrewmc::libcoevent::send_segmented(_fd, data, data_len, segment_size, addr, addr_len);
+    if (send_ret < 0) {
+        _status.set_sys_errno();
+    }
+
+    if (send_len_out) {
+        *send_len_out = (send_ret > 0) ? send_ret : 0;
+    }
+    return _status;
+}
+
+
+struct Error UDPItnlClient::set_gro(BOOL enable)
+{
+    _status.clear_err();
+    if (_fd <= 0) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (set_fd_udp_gro(_fd, enable) < 0) {
+        _status.set_sys_errno();
+        return _status;
+    }
+    _is_gro = enable ? TRUE : FALSE;
+    return _status;
+}
+
+
+BOOL UDPItnlClient::gro()
+{
+    return _is_gro;
+}
+
+
+struct Error UDPItnlClient::recv_segmented(void *data_out, const size_t len_limit, size_t *len_out, size_t *segment_size_out, double timeout_seconds)
+{
+    size_t recv_len = 0;
+
+    _last_segment_size = 0;
+    recv(data_out, len_limit, &recv_len, timeout_seconds);
+
+    if (len_out) {
+        *len_out = recv_len;
+    }
+    if (segment_size_out) {
+        *segment_size_out = (recv_len > 0) ? _last_segment_size : 0;
+    }
+    return _status;
+}
+
+#endif  // end of __SEGMENTATION_OFFLOAD_FUNCTIONS
+
+
 // end of file
@@ -0,0 +1,234 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <vector>
+#include <netinet/in.h>
+
+using namespace andrewmc::libcoevent;
+
+#define _INITIAL_CAPACITY       (64)
+#define _MAX_LOAD_PERCENT       (50)        // table is doubled above this load
+
+// ==========
+#define __CONSTRUCT_AND_DESTRUCT
+#ifdef __CONSTRUCT_AND_DESTRUCT
+
+UDPPeerTable::UDPPeerTable()
+{
+    _slots = NULL;
+    _capacity = 0;
+    _count = 0;
+    return;
+}
+
+
+UDPPeerTable::~UDPPeerTable()
+{
+    clear();
+    return;
+}
+
+
+void UDPPeerTable::clear()
+{
+    if (_slots) {
+        free(_slots);
+        _slots = NULL;
+    }
+    _capacity = 0;
+    _count = 0;
+    return;
+}
+
+
+#endif  // end of __CONSTRUCT_AND_DESTRUCT
+
+
+// ==========
+#define __KEY_FUNCTIONS
+#ifdef __KEY_FUNCTIONS
+
+void UDPPeerTable::make_key(const struct sockaddr *addr, struct Key *key_out, uint64_t id)
+{
+    memset(key_out, 0, sizeof(*key_out));
+    key_out->family = addr->sa_family;
+    key_out->id = id;
+
+    if (AF_INET == addr->sa_family) {
+        const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+        key_out->port = addr4->sin_port;
+        memcpy(key_out->addr, &(addr4->sin_addr), sizeof(addr4->sin_addr));
+    }
+    else if (AF_INET6 == addr->sa_family) {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+        key_out->port = addr6->sin6_port;
+        key_out->scope_id = addr6->sin6_scope_id;
+        memcpy(key_out->addr, &(addr6->sin6_addr), sizeof(addr6->sin6_addr));
+    }
+    return;
+}
+
+
+static size_t _key_hash(const struct UDPPeerTable::Key &key)
+{
+    uint64_t words[4];
+    memcpy(words, &key, sizeof(words));
+
+    // multiply-xorshift mixing, cheap and good enough for addresses and ids
+    uint64_t hash = words[0] * 0x9E3779B97F4A7C15ULL;
+    hash ^= words[1] + 0xC2B2AE3D27D4EB4FULL + (hash << 6) + (hash >> 2);
+    hash ^= words[2] + 0x165667B19E3779F9ULL + (hash << 6) + (hash >> 2);
+    hash ^= words[3] + 0x27D4EB2F165667C5ULL + (hash << 6) + (hash >> 2);
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+    return (size_t)hash;
+}
+
+
+static BOOL _key_equal(const struct UDPPeerTable::Key &key_a, const struct UDPPeerTable::Key &key_b)
+{
+    return (0 == memcmp(&key_a, &key_b, sizeof(key_a))) ? TRUE : FALSE;
+}
+
+
+#endif  // end of __KEY_FUNCTIONS
+
+
+// ==========
+#define __TABLE_FUNCTIONS
+#ifdef __TABLE_FUNCTIONS
+
+size_t UDPPeerTable::_index_of(const struct Key &key)
+{
+    size_t mask = _capacity - 1;
+    size_t index = _key_hash(key) & mask;
+
+    while (_slots[index].value && FALSE == _key_equal(_slots[index].key, key)) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+
+// table is left unchanged if memory is not available
+BOOL UDPPeerTable::_resize(size_t capacity)
+{
+    struct _Slot *old_slots = _slots;
+    size_t old_capacity = _capacity;
+
+    _slots = (struct _Slot *)calloc(capacity, sizeof(*_slots));
+    if (NULL == _slots) {
+        _slots = old_slots;
+        return FALSE;
+    }
+    _capacity = capacity;
+
+    for (size_t old_index = 0; old_index < old_capacity; old_index ++) {
+        if (old_slots[old_index].value) {
+            _slots[_index_of(old_slots[old_index].key)] = old_slots[old_index];
+        }
+    }
+
+    if (old_slots) {
+        free(old_slots);
+    }
+    return TRUE;
+}
+
+
+void *UDPPeerTable::find(const struct Key &key)
+{
+    if (0 == _count) {
+        return NULL;
+    }
+    return _slots[_index_of(key)].value;
+}
+
+
+struct Error UDPPeerTable::insert(const struct Key &key, void *value)
+{
+    struct Error status;
+    if (NULL == value) {
+        erase(key);
+        return status;
+    }
+
+    BOOL is_resized = TRUE;
+    if (NULL == _slots) {
+        is_resized = _resize(_INITIAL_CAPACITY);
+    }
+    else if ((_count + 1) * 100 > _capacity * _MAX_LOAD_PERCENT) {
+        is_resized = _resize(_capacity * 2);
+    }
+    if (FALSE == is_resized) {
+        status.set_sys_errno(ENOMEM);
+        return status;
+    }
+
+    size_t index = _index_of(key);
+    if (NULL == _slots[index].value) {
+        _count ++;
+    }
+    _slots[index].key = key;
+    _slots[index].value = value;
+    return status;
+}
+
+
+BOOL UDPPeerTable::erase(const struct Key &key)
+{
+    if (0 == _count) {
+        return FALSE;
+    }
+
+    size_t mask = _capacity - 1;
+    size_t index = _index_of(key);
+    if (NULL == _slots[index].value) {
+        return FALSE;
+    }
+
+    // backward shift deletion, so that no tombstone is needed
+    size_t next = (index + 1) & mask;
+    while (_slots[next].value)
+    {
+        size_t home = _key_hash(_slots[next].key) & mask;
+        BOOL should_move = (index <= next) ? (home <= index || home > next) : (home <= index && home > next);
+        if (should_move) {
+            _slots[index] = _slots[next];
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    _slots[index].value = NULL;
+    _count --;
+    return TRUE;
+}
+
+
+size_t UDPPeerTable::size()
+{
+    return _count;
+}
+
+
+void UDPPeerTable::all_values(std::vector<void *> &values_out)
+{
+    values_out.clear();
+    values_out.reserve(_count);
+    for (size_t index = 0; index < _capacity; index ++) {
+        if (_slots[index].value) {
+            values_out.push_back(_slots[index].value);
+        }
+    }
+    return;
+}
+
+
+#endif  // end of __TABLE_FUNCTIONS
+
+
+// end of file
@@ -9,6 +9,11 @@
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <map>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <math.h>
+#include <linux/filter.h>
 
 using namespace andrewmc::libcoevent;
 
@@ -19,6 +24,9 @@ typedef Server _super;
 #define __CO_EVENT_UDP_DEFINITIONS
 #ifdef __CO_EVENT_UDP_DEFINITIONS
 
+// each source file has its own _EventArg, internal linkage keeps their constructors apart
+namespace {
+
 struct _EventArg {
     UDPServer            *event;
     int                 fd;
@@ -31,12 +39,38 @@ struct _EventArg {
     WorkerFunc          session_worker_func;
     void                *session_user_arg;
 
-    std::map<std::string, UDPSession *> *session_collection;
-
-    _EventArg(): event(NULL), fd(0), libevent_what_ptr(NULL), coroutine(NULL)
+    UDPPeerTable     *session_table;
+    uint64_t            inbound_drop_count;     // datagrams dropped for full inbound queue of sessions
+
+    // worker pool, see UDPServer::set_worker_count()
+    struct event        *worker_event;      // timer of this worker, socket readable is dispatched by server event
+    struct _EventArg    *first_worker;      // which holds the pool, NULL if only one worker
+    struct event        *socket_event;                  // valid in first worker, same as UDPServer::_event
+    std::vector<struct _EventArg *> workers;            // valid in first worker
+    std::deque<struct _EventArg *>  idle_workers;       // valid in first worker, waiting for datagram
+    unsigned            running_workers;                // valid in first worker
+    struct _EventArg    *current_worker;                // valid in first worker, whose coroutine is running
+    uint32_t            libevent_what;                  // storage of libevent_what_ptr, except first worker
+    struct sockaddr_storage remote_addr;                // peer of this worker, except first worker
+    socklen_t           remote_addr_len;
+
+    _EventArg(): event(NULL), fd(0), libevent_what_ptr(NULL), coroutine(NULL), session_table(NULL), inbound_drop_count(0), worker_event(NULL), first_worker(NULL), socket_event(NULL), running_workers(0), current_worker(NULL), libevent_what(0), remote_addr_len(sizeof(remote_addr))
     {}
 };
 
+}   // end of anonymous namespace
+
+#define _MAX_BATCH_SIZE         (64)        // messages in one recvmmsg() or sendmmsg()
+#define _SESSION_BATCH_SIZE     (16)        // datagrams drained by session mode worker on each readable event
+#define _DEFAULT_SESSION_INBOUND_LIMIT  (256)   // datagrams queued in each session
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT                (15)
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF    (51)
+#endif
+
 #endif
 
 
@@ -60,22 +94,28 @@ static void *_libco_routine(void *libco_arg)
 #define __CO_EVENT_UDP_CALLBACK
 #ifdef __CO_EVENT_UDP_CALLBACK
 
-static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_arg)
+// Switch into coroutine of a worker. Server records which worker is running, and lives until all workers end.
+// Every resumption of server coroutines goes here, including those from clients by UDPServer::resume_coroutine()
+static void _resume_worker(struct _EventArg *arg)
 {
-    struct _EventArg *arg = (struct _EventArg *)libevent_arg;
-
-    // switch into the coroutine
-    if (arg->libevent_what_ptr) {
-        *(arg->libevent_what_ptr) = (uint32_t)what;
-        DEBUG("libevent what: 0x%08x - %s%s%s", (unsigned)what, event_is_timeout(what) ? "timeout " : "", event_readable(what) ? "read" : "", event_got_signal(what) ? "signal" : "");
-    }
+    struct _EventArg *first = arg->first_worker;
 
     // handle control to user application
+    if (first) {
+        first->current_worker = arg;
+    }
     co_resume(arg->coroutine);
+    if (first) {
+        first->current_worker = NULL;
+    }
 
     // is coroutine end?
     if (is_coroutine_end(arg->coroutine))
     {
+        if (first && --(first->running_workers) > 0) {
+            return;
+        }
+
         // delete the event if this is under control of the base
         UDPServer *event = arg->event;
         Base *base  = event->owner();
@@ -83,11 +123,46 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
         DEBUG("evudp %s ends", event->identifier().c_str());
         base->delete_event_under_control(event);
     }
+    return;
+}
+
+
+static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    struct _EventArg *arg = (struct _EventArg *)libevent_arg;
+
+    // switch into the coroutine
+    if (arg->libevent_what_ptr) {
+        *(arg->libevent_what_ptr) = (uint32_t)what;
+        DEBUG("libevent what: 0x%08x - %s%s%s", (unsigned)what, event_is_timeout(what) ? "timeout " : "", event_readable(what) ? "read" : "", event_got_signal(what) ? "signal" : "");
+    }
+    _resume_worker(arg);
 
     // done
     return;
 }
 
+
+// socket event of worker pool, hand it to the longest idle worker
+static void _dispatch_callback(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    struct _EventArg *first = (struct _EventArg *)libevent_arg;
+    if (first->idle_workers.empty()) {
+        return;
+    }
+
+    struct _EventArg *worker = first->idle_workers.front();
+    first->idle_workers.pop_front();
+    event_del(worker->worker_event);
+
+    // worker may be blocked by other I/O before next recv, so remaining idle workers keep watching the socket
+    if (FALSE == first->idle_workers.empty()) {
+        event_add(first->socket_event, NULL);
+    }
+    _libevent_callback(fd, what, worker);
+    return;
+}
+
 #endif
 
 
@@ -95,68 +170,129 @@ static void _libevent_callback(evutil_socket_t fd, short what, void *libevent_ar
 #define __SESSION_MODE_WORKER_FUNC
 #ifdef __SESSION_MODE_WORKER_FUNC
 
+// Short datagrams are copied into small buffers, so that a queued one does not pin a buffer of max_datagram_size.
+// Large ones are handed over without copy, and the slot is refilled before next batch
+static void _forward_datagram(struct _EventArg *arg, DatagramItnlPool *pool, UDPItnlSession *session, struct DatagramBuffer **slot)
+{
+    struct DatagramBuffer *datagram = *slot;
+    if (datagram->length <= pool->small_datagram_size() && pool->small_datagram_size() < datagram->capacity)
+    {
+        struct DatagramBuffer *small = pool->acquire_small();
+        if (small) {
+            memcpy(small->data, datagram->data, datagram->length);
+            small->length = datagram->length;
+            datagram = small;
+        }
+    }
+
+    if (session->forward_incoming_buffer(datagram).is_error()) {
+        DEBUG("inbound queue of %s:%u is full, datagram dropped", session->remote_addr().c_str(), session->remote_port());
+        arg->inbound_drop_count ++;
+        if (datagram != *slot) {
+            pool->release(datagram);
+        }
+        return;
+    }
+
+    if (datagram == *slot) {
+        *slot = NULL;
+    }
+    return;
+}
+
+
 static void _session_mode_worker(evutil_socket_t fd, Event *abs_server, void *libcoevent_arg)
 {
     struct _EventArg *arg = (struct _EventArg *)libcoevent_arg;
     void *user_arg = arg->session_user_arg;
     WorkerFunc worker_func = arg->session_worker_func;
     UDPServer *server = (UDPServer *)abs_server;
-    std::map<std::string, UDPSession *> *session_collection = arg->session_collection;
-
-    uint8_t data_buff[4096];
-    size_t recv_len = 0;
+    UDPPeerTable *session_table = arg->session_table;
+    UDPPeerTable::Key remote_key;
+
+    struct UDPMessage msgs[_SESSION_BATCH_SIZE];
+    struct DatagramBuffer *buffers[_SESSION_BATCH_SIZE];
+    uint8_t drop_buff[1];
+    size_t batch_size = 0;
+    size_t recv_count = 0;
     Error status;
     BOOL should_exit_udp = FALSE;
 
-    socklen_t sock_len = 0;
-    switch(server->network_type())
-    {
-        default:
-        case NetIPv4:
-            sock_len = sizeof(struct sockaddr_in);
-            break;
-        case NetIPv6:
-            sock_len = sizeof(struct sockaddr_in6);
-            break;
+    // datagrams are received into pooled buffers, which are handed over to sessions
+    DatagramItnlPool *pool = (DatagramItnlPool *)(server->owner()->datagram_pool());
+    for (size_t index = 0; index < _SESSION_BATCH_SIZE; index ++) {
+        buffers[index] = NULL;
     }
 
     // receive data
     do {
-        recv_len = 0;
-        status = server->recv((void *)data_buff, sizeof(data_buff), &recv_len);
-        if (status.is_ok() && (recv_len > 0))
+        for (batch_size = 0; batch_size < _SESSION_BATCH_SIZE; batch_size ++)
         {
-            std::string remote_ip = server->client_addr();
-            unsigned remote_port = server->client_port();
+            if (NULL == buffers[batch_size]) {
+                buffers[batch_size] = pool->acquire();
+                if (NULL == buffers[batch_size]) {
+                    break;
+                }
+            }
+            msgs[batch_size].data = buffers[batch_size]->data;
+            msgs[batch_size].data_len = buffers[batch_size]->capacity;
+        }
 
-            DEBUG("Got data: %s", ::andrewmc::cpptools::dump_data_to_string(data_buff, recv_len).c_str());
+        if (0 == batch_size) {
+            // out of memory, still read from socket so that it does not keep being readable
+            msgs[0].data = drop_buff;
+            msgs[0].data_len = sizeof(drop_buff);
+            batch_size = 1;
+        }
 
-            char remote_key_buff[128];
-            snprintf(remote_key_buff, sizeof(remote_key_buff), "%s:%u", remote_ip.c_str(), remote_port);
+        recv_count = 0;
+        status = server->recv_batch(msgs, batch_size, &recv_count);
+        if (status.is_ok())
+        {
+            for (size_t index = 0; index < recv_count; index ++)
+            {
+                const struct UDPMessage *msg = &(msgs[index]);
+                if (0 == msg->data_len) {
+                    continue;
+                }
+                if (NULL == buffers[index]) {
+                    ERROR("No memory for datagram buffer, datagram dropped");
+                    continue;
+                }
+                if (msg->is_truncated) {
+                    DEBUG("datagram truncated to %u bytes, max_datagram_size of pool should be larger", (unsigned)msg->data_len);
+                }
+                buffers[index]->length = msg->data_len;
+                DEBUG("Got data: %s", ::andrewmc::cpptools::dump_data_to_string((const uint8_t *)msg->data, msg->data_len).c_str());
 
-            std::string remote_key = std::string(remote_key_buff);
+                UDPPeerTable::make_key((const struct sockaddr *)&(msg->addr), &remote_key);
 
-            std::map<std::string, UDPSession *>::iterator session_iter = session_collection->find(remote_key);
-            if (session_collection->end() != session_iter)
-            {
-                UDPItnlSession *session = (UDPItnlSession *)(session_iter->second);
-                session->forward_incoming_data(data_buff, recv_len);
-            }
-            else {
-                // we should create a session
-                struct sockaddr_storage sock_addr;
-                server->copy_client_addr((struct sockaddr *)&sock_addr, sock_len);
-
-                UDPItnlSession *session = new UDPItnlSession;
-                status = session->init(server, fd, worker_func, (struct sockaddr *)&sock_addr, sock_len, user_arg);
-                if (FALSE == status.is_ok()) {
-                    delete session;
-                    ERROR("Failed to create UDP session: %s", status.c_err_msg());
+                UDPItnlSession *existing_session = (UDPItnlSession *)(session_table->find(remote_key));
+                if (existing_session)
+                {
+                    _forward_datagram(arg, pool, existing_session, &(buffers[index]));
                 }
                 else {
-                    DEBUG("Create session for %s", remote_key.c_str());
-                    session->forward_incoming_data(data_buff, recv_len);
-                    (*session_collection)[remote_key] = (UDPSession *)session;
+                    // we should create a session
+                    UDPItnlSession *session = new UDPItnlSession;
+                    status = session->init(server, fd, worker_func, (const struct sockaddr *)&(msg->addr), msg->addr_len, user_arg);
+                    if (FALSE == status.is_ok()) {
+                        delete session;
+                        ERROR("Failed to create UDP session: %s", status.c_err_msg());
+                        continue;
+                    }
+
+                    status = session_table->insert(remote_key, (UDPSession *)session);
+                    if (status.is_error()) {
+                        // session is already under control of base
+                        ERROR("Failed to add UDP session, datagram from %s:%u dropped: %s",
+                                session->remote_addr().c_str(), session->remote_port(), status.c_err_msg());
+                        server->owner()->delete_event_under_control(session);
+                    }
+                    else {
+                        DEBUG("Create session for %s:%u", session->remote_addr().c_str(), session->remote_port());
+                        _forward_datagram(arg, pool, session, &(buffers[index]));
+                    }
                 }
             }
         }
@@ -166,16 +302,18 @@ static void _session_mode_worker(evutil_socket_t fd, Event *abs_server, void *li
             should_exit_udp = TRUE;
         }
         else {
-            ERROR("unrecognized err: %s, recv_len = %u", status.c_err_msg(), (unsigned)recv_len);
+            ERROR("unrecognized err: %s, recv_count = %u", status.c_err_msg(), (unsigned)recv_count);
         }
 
     } while (FALSE == should_exit_udp);
 
     // exit UDP server
+    for (size_t index = 0; index < _SESSION_BATCH_SIZE; index ++) {
+        pool->release(buffers[index]);
+    }
     return;
 }
 
-
 #endif
 
 
@@ -185,12 +323,55 @@ static void _session_mode_worker(evutil_socket_t fd, Event *abs_server, void *li
 
 uint32_t UDPServer::_libevent_what()
 {
-    uint32_t ret = *_libevent_what_storage;
-    *_libevent_what_storage = 0;
+    struct _EventArg *arg = (struct _EventArg *)_worker_arg();
+    uint32_t *storage = arg ? arg->libevent_what_ptr : _libevent_what_storage;
+    uint32_t ret = *storage;
+    *storage = 0;
     return ret;
 }
 
 
+// _EventArg of running worker, which is the only one unless worker pool is used
+void *UDPServer::_worker_arg()
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (arg && arg->current_worker) {
+        return arg->current_worker;
+    }
+    return arg;
+}
+
+
+// wait for socket or timeout, in which worker_arg is the calling one
+void UDPServer::_wait(void *worker_arg, struct timeval *timeout, BOOL is_reading)
+{
+    struct _EventArg *arg = (struct _EventArg *)worker_arg;
+    struct _EventArg *first = arg->first_worker;
+
+    if (NULL == first) {
+        event_add(_event, timeout);
+        co_yield(arg->coroutine);
+        return;
+    }
+
+    // worker pool, socket event is dispatched to one of idle workers
+    if (is_reading) {
+        first->idle_workers.push_back(arg);
+        event_add(_event, NULL);
+    }
+    event_add(arg->worker_event, timeout);
+    co_yield(arg->coroutine);
+
+    if (is_reading) {
+        std::deque<struct _EventArg *>::iterator it = std::find(first->idle_workers.begin(), first->idle_workers.end(), arg);
+        if (it != first->idle_workers.end()) {
+            first->idle_workers.erase(it);
+        }
+    }
+    return;
+}
+
+
 int UDPServer::_fd()
 {
     if (_fd_ipv4) {
@@ -209,6 +390,11 @@ int UDPServer::_fd()
 
 struct sockaddr *UDPServer::_remote_sock_addr()
 {
+    struct _EventArg *arg = (struct _EventArg *)_worker_arg();
+    if (arg && arg != _event_arg) {
+        return (struct sockaddr *)(&(arg->remote_addr));
+    }
+
     if (_fd_ipv4) {
         return (struct sockaddr *)(&_remote_addr_ipv4);
     } else if (_fd_ipv6) {
@@ -225,6 +411,11 @@ struct sockaddr *UDPServer::_remote_sock_addr()
 
 socklen_t *UDPServer::_remote_sock_addr_len()
 {
+    struct _EventArg *arg = (struct _EventArg *)_worker_arg();
+    if (arg && arg != _event_arg) {
+        return &(arg->remote_addr_len);
+    }
+
     if (_fd_ipv4) {
         return &_remote_addr_ipv4_len;
     } else if (_fd_ipv6) {
@@ -260,6 +451,11 @@ struct Error UDPServer::init(Base *base, WorkerFunc func, const struct sockaddr
         _status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
         return _status;
     }
+    if (_is_dual_stack && AF_INET6 != addr->sa_family) {
+        ERROR("%s - dual-stack server should bind an IPv6 address", _identifier.c_str());
+        _status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
+        return _status;
+    }
 
     _clear();
 
@@ -270,7 +466,7 @@ struct Error UDPServer::init(Base *base, WorkerFunc func, const struct sockaddr
     arg->user_arg = user_arg;
     arg->worker_func = func;
     arg->libevent_what_ptr = _libevent_what_storage;
-    arg->session_collection = &_session_collection;
+    arg->session_table = (UDPPeerTable *)_session_table;
     DEBUG("arg->libevent_what_ptr = %p", arg->libevent_what_ptr);
     DEBUG("User arg: %08p", user_arg);
 
@@ -305,6 +501,16 @@ struct Error UDPServer::init(Base *base, WorkerFunc func, const struct sockaddr
             _status.set_sys_errno(errno);
             return _status;
         }
+
+        // explicitly, as default follows net.ipv6.bindv6only
+        if (_is_dual_stack) {
+            int v6only = 0;
+            if (0 != setsockopt(_fd_ipv6, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only))) {
+                _status.set_sys_errno(errno);
+                _clear();
+                return _status;
+            }
+        }
     }
     else
     {
@@ -317,8 +523,17 @@ struct Error UDPServer::init(Base *base, WorkerFunc func, const struct sockaddr
         }
     }
 
+    // SO_REUSEPORT should be set before binding
+    int fd = _fd_ipv4 ? _fd_ipv4 : (_fd_ipv6 ? _fd_ipv6 : _fd_unix);
+    if (_reuseport_group_size > 0 && AF_UNIX != addr->sa_family) {
+        _join_reuseport_group(fd);
+        if (_status.is_error()) {
+            _clear();
+            return _status;
+        }
+    }
+
     // try binding
-    int fd = _fd_ipv4 ? _fd_ipv4 : (_fd_ipv6 ? _fd_ipv4 : _fd_unix);
     int status = bind(fd, addr, addr_len);
     if (status < 0) {
         _clear();
@@ -326,23 +541,43 @@ struct Error UDPServer::init(Base *base, WorkerFunc func, const struct sockaddr
         return _status;
     }
 
+    // steering program is shared by the whole group, attached by every member in case any of them leaves
+    if (_reuseport_group_size > 0 && AF_UNIX != addr->sa_family && _reuseport_policy != ReusePortKernel) {
+        _attach_reuseport_program(fd);
+        if (_status.is_error()) {
+            _clear();
+            return _status;
+        }
+    }
+
     // non-block
     set_fd_nonblock(fd);
     arg->fd = fd;
 
     // create event
     _owner_base = base;
-    _event = event_new(base->event_base(), fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);     // should NOT use EV_ET or EV_PERSIST
-    if (NULL == _event) {
-        ERROR("Failed to new a UDP event");
-        _clear();
-        _status.set_app_errno(ERR_EVENT_EVENT_NEW);
-        return _status;
+    if (_worker_count > 1)
+    {
+        _start_workers(base, arg);
+        if (_status.is_error()) {
+            _clear();
+            return _status;
+        }
     }
-    else {
-        struct timeval sleep_time = {0, 0};
-        DEBUG("Add UDP event %s", _identifier.c_str());
-        event_add(_event, &sleep_time);
+    else
+    {
+        _event = event_new(base->event_base(), fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);     // should NOT use EV_ET or EV_PERSIST
+        if (NULL == _event) {
+            ERROR("Failed to new a UDP event");
+            _clear();
+            _status.set_app_errno(ERR_EVENT_EVENT_NEW);
+            return _status;
+        }
+        else {
+            struct timeval sleep_time = {0, 0};
+            DEBUG("Add UDP event %s", _identifier.c_str());
+            event_add(_event, &sleep_time);
+        }
     }
 
     // automatic free
@@ -426,6 +661,17 @@ void UDPServer::_init()
     _remote_addr_unix_len = sizeof(_remote_addr_unix);
     _libevent_what_storage = NULL;
     _event_arg = NULL;
+    _idle_timeout = 0;
+    _max_session_lifetime = 0;
+    _session_reaper = NULL;
+    _session_table = new UDPPeerTable;
+    _is_gro = FALSE;
+    _last_segment_size = 0;
+    _reuseport_group_size = 0;
+    _reuseport_policy = ReusePortKernel;
+    _is_dual_stack = FALSE;
+    _worker_count = 1;
+    _session_inbound_limit = _DEFAULT_SESSION_INBOUND_LIMIT;
 
     if (NULL == _libevent_what_storage) {
         _libevent_what_storage = (uint32_t *)malloc(sizeof(*_libevent_what_storage));
@@ -444,6 +690,8 @@ void UDPServer::_init()
 
 void UDPServer::_clear()
 {
+    _stop_workers();
+
     if (_event) {
         DEBUG("Delete io event");
         event_del(_event);
@@ -479,14 +727,24 @@ UDPServer::~UDPServer()
     DEBUG("Delete UDP server %s", _identifier.c_str());
     _clear();
 
-    for (std::map<std::string, UDPSession *>::iterator each_session = _session_collection.begin();
-        each_session != _session_collection.end();
-        each_session ++)
-    {
-        DEBUG("delete session %s", each_session->second->identifier().c_str());
-        delete each_session->second;
+    if (_session_table) {
+        UDPPeerTable *session_table = (UDPPeerTable *)_session_table;
+        std::vector<void *> sessions;
+        session_table->all_values(sessions);
+        for (std::vector<void *>::iterator each_session = sessions.begin(); each_session != sessions.end(); each_session ++)
+        {
+            UDPSession *session = (UDPSession *)(*each_session);
+            DEBUG("delete session %s", session->identifier().c_str());
+            delete session;
+        }
+        delete session_table;
+        _session_table = NULL;
+    }
+
+    if (_session_reaper) {
+        delete _session_reaper;
+        _session_reaper = NULL;
     }
-    _session_collection.clear();
 
     if (_event_arg) {
         struct _EventArg *arg = (struct _EventArg *)_event_arg;
@@ -530,6 +788,11 @@ struct Error UDPServer::init_session_mode(Base *base, WorkerFunc session_func, c
         _status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
         return _status;
     }
+    if (_worker_count > 1) {
+        ERROR("%s - session mode has only one worker", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
 
     init(base, _session_mode_worker, addr, addr_len, user_arg, auto_free);
     if (_status.is_ok()) {
@@ -554,6 +817,11 @@ struct Error UDPServer::init_session_mode(Base *base, WorkerFunc session_func, N
         _status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
         return _status;
     }
+    if (_worker_count > 1) {
+        ERROR("%s - session mode has only one worker", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
 
     init(base, _session_mode_worker, network_type, bind_port, user_arg, auto_free);
     if (_status.is_ok()) {
@@ -582,18 +850,17 @@ struct Error UDPServer::quit_session_mode_server()
 
 struct Error UDPServer::notify_session_ends(UDPSession *session)
 {
-    std::string remote_ip = session->remote_addr();
-    unsigned remote_port = session->remote_port();
-
-    char remote_key_buff[128];
-    snprintf(remote_key_buff, sizeof(remote_key_buff), "%s:%u", remote_ip.c_str(), remote_port);
-
-    std::map<std::string, UDPSession *>::iterator session_in_control = _session_collection.find(remote_key_buff);
-    
-    if (_session_collection.end() != session_in_control)
+    UDPPeerTable *session_table = (UDPPeerTable *)_session_table;
+    UDPPeerTable::Key remote_key;
+    struct sockaddr_storage remote_addr;
+    memset(&remote_addr, 0, sizeof(remote_addr));
+    session->copy_remote_addr((struct sockaddr *)&remote_addr, sizeof(remote_addr));
+    UDPPeerTable::make_key((struct sockaddr *)&remote_addr, &remote_key);
+
+    if (session == session_table->find(remote_key))
     {
-        DEBUG("dispatch session %s", session_in_control->second->identifier().c_str());
-        _session_collection.erase(session_in_control);
+        DEBUG("dispatch session %s", session->identifier().c_str());
+        session_table->erase(remote_key);
         _status.clear_err();
     }
     else {
@@ -607,6 +874,107 @@ struct Error UDPServer::notify_session_ends(UDPSession *session)
 #endif  // end of __INIT_SESSION_MODE
 
 
+// ==========
+#define __SESSION_REAPER_FUNCTIONS
+#ifdef __SESSION_REAPER_FUNCTIONS
+
+static void _reap_session(Event *session, void *arg)
+{
+    ((UDPItnlSession *)session)->reap();
+    return;
+}
+
+
+static time_t _reaper_seconds(double seconds)
+{
+    return (seconds > 0) ? (time_t)ceil(seconds) : 0;
+}
+
+
+SessionReaper *UDPServer::session_reaper()
+{
+    if (NULL == _session_reaper && _owner_base && (_idle_timeout > 0 || _max_session_lifetime > 0))
+    {
+        _session_reaper = new SessionReaper(_owner_base, _reap_session, this);
+        _session_reaper->set_idle_timeout(_reaper_seconds(_idle_timeout));
+        _session_reaper->set_max_lifetime(_reaper_seconds(_max_session_lifetime));
+
+        // sessions created before limits were set
+        std::vector<void *> sessions;
+        ((UDPPeerTable *)_session_table)->all_values(sessions);
+        for (size_t index = 0; index < sessions.size(); index ++) {
+            ((UDPItnlSession *)sessions[index])->attach_reaper(_session_reaper);
+        }
+    }
+    return _session_reaper;
+}
+
+
+void UDPServer::set_idle_timeout(double seconds)
+{
+    _idle_timeout = (seconds > 0) ? seconds : 0;
+    if (_session_reaper) {
+        _session_reaper->set_idle_timeout(_reaper_seconds(_idle_timeout));
+    } else {
+        session_reaper();
+    }
+    return;
+}
+
+
+double UDPServer::idle_timeout()
+{
+    return _idle_timeout;
+}
+
+
+void UDPServer::set_max_session_lifetime(double seconds)
+{
+    _max_session_lifetime = (seconds > 0) ? seconds : 0;
+    if (_session_reaper) {
+        _session_reaper->set_max_lifetime(_reaper_seconds(_max_session_lifetime));
+    } else {
+        session_reaper();
+    }
+    return;
+}
+
+
+double UDPServer::max_session_lifetime()
+{
+    return _max_session_lifetime;
+}
+
+
+uint64_t UDPServer::reaped_count()
+{
+    return _session_reaper ? _session_reaper->reaped_count() : 0;
+}
+
+
+void UDPServer::set_session_inbound_limit(size_t max_datagrams)
+{
+    _session_inbound_limit = max_datagrams;
+    return;
+}
+
+
+size_t UDPServer::session_inbound_limit()
+{
+    return _session_inbound_limit;
+}
+
+
+uint64_t UDPServer::inbound_drop_count()
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    return arg ? arg->inbound_drop_count : 0;
+}
+
+
+#endif  // end of __SESSION_REAPER_FUNCTIONS
+
+
 // ==========
 #define __PUBLIC_MISC_FUNCTIONS
 #ifdef __PUBLIC_MISC_FUNCTIONS
@@ -666,10 +1034,32 @@ int UDPServer::port()
 }
 
 
+void UDPServer::resume_coroutine(struct stCoRoutine_t *coroutine)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    if (NULL == arg) {
+        _super::resume_coroutine(coroutine);
+        return;
+    }
+
+    // resumed by clients, which know only the coroutine
+    if (arg->first_worker) {
+        for (size_t index = 0; index < arg->workers.size(); index ++) {
+            if (arg->workers[index]->coroutine == coroutine) {
+                arg = arg->workers[index];
+                break;
+            }
+        }
+    }
+    _resume_worker(arg);
+    return;
+}
+
+
 struct stCoRoutine_t *UDPServer::_coroutine()
 {
     if (_event_arg) {
-        struct _EventArg *arg = (struct _EventArg *)_event_arg;
+        struct _EventArg *arg = (struct _EventArg *)_worker_arg();
         return arg->coroutine;
     }
     else {
@@ -688,15 +1078,14 @@ struct stCoRoutine_t *UDPServer::_coroutine()
 
 struct Error UDPServer::sleep(struct timeval &sleep_time)
 {
-    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    struct _EventArg *arg = (struct _EventArg *)_worker_arg();
 
     _status.clear_err();
     if ((0 == sleep_time.tv_sec) && (0 == sleep_time.tv_usec)) {
         return _status;
     }
 
-    event_add(_event, &sleep_time);
-    co_yield(arg->coroutine);
+    _wait(arg, &sleep_time, FALSE);
 
     // determine libevent event masks
     uint32_t libevent_what = _libevent_what();
@@ -751,7 +1140,7 @@ struct Error UDPServer::recv_in_timeval(void *data_out, const size_t len_limit,
 {
     ssize_t recv_len = 0;
     volatile uint32_t libevent_what = 0;
-    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    struct _EventArg *arg = (struct _EventArg *)_worker_arg();
 
     // param check
     if (NULL == data_out) {
@@ -766,7 +1155,7 @@ struct Error UDPServer::recv_in_timeval(void *data_out, const size_t len_limit,
     if (event_readable(libevent_what))
     {
         // data readable
-        recv_len = recv_from(_fd(), data_out, len_limit, 0, _remote_sock_addr(), _remote_sock_addr_len());
+        recv_len = _recv_datagram(data_out, len_limit);
         if (recv_len < 0) {
             _status.set_sys_errno();
         }
@@ -774,57 +1163,81 @@ struct Error UDPServer::recv_in_timeval(void *data_out, const size_t len_limit,
         // EAGAIN
         if (0 == recv_len) {
             DEBUG("EAGAIN");
-            *_libevent_what_storage &= ~EV_READ;
+            *(arg->libevent_what_ptr) &= ~EV_READ;
             return recv_in_timeval(data_out, len_limit, len_out, timeout);
         }
     }
     else {
         // no data avaliable
-        struct timeval timeout_copy;
-        timeout_copy.tv_sec = timeout.tv_sec;
-        timeout_copy.tv_usec = timeout.tv_usec;
-
-        DEBUG("UDP libevent what flag: 0x%04x, now wait", (unsigned)libevent_what);
-        if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
-            timeout_copy.tv_sec = FOREVER_SECONDS;
-        }
-        event_add(_event, &timeout_copy);
-        co_yield(arg->coroutine);
-
-        // check if data read
-        libevent_what = _libevent_what();
-        if (event_got_signal(libevent_what))
-        {
-            // exit got
-            _status.set_app_errno(ERR_SIGNAL);
-        }
-        else if (event_readable(libevent_what))
-        {
-            recv_len = recv_from(_fd(), data_out, len_limit, 0, _remote_sock_addr(), _remote_sock_addr_len());
-            if (recv_len < 0) {
-                _status.set_sys_errno();
-            }
-            else if (0 == recv_len) {
-                *_libevent_what_storage &=~ (EV_READ);
-            }
-        }
-        else if (event_is_timeout(libevent_what))
-        {
-            recv_len = 0;
-            _status.set_app_errno(ERR_TIMEOUT);
+        struct timeval now_time = ::andrewmc::cpptools::sys_up_timeval();
+        struct timeval end_time;
+        struct timeval remain_time;
+        BOOL should_wait_forever = ((0 == timeout.tv_sec) && (0 == timeout.tv_usec));
+        BOOL should_continue_wait = TRUE;
+
+        if (should_wait_forever) {
+            remain_time.tv_sec = FOREVER_SECONDS;
+            remain_time.tv_usec = 0;
         }
         else {
-            ERROR("unrecognized event flag: 0x%04u", libevent_what);
-            _status.set_app_errno(ERR_UNKNOWN);
+            timeradd(&now_time, &timeout, &end_time);
+            remain_time.tv_sec = timeout.tv_sec;
+            remain_time.tv_usec = timeout.tv_usec;
         }
-    }
 
-    // write read data len and return
-    if (len_out) {
-        *len_out = (recv_len > 0) ? recv_len : 0;
-    }
-    return _status;
-}
+        DEBUG("UDP libevent what flag: 0x%04x, now wait", (unsigned)libevent_what);
+        do {
+            should_continue_wait = FALSE;
+            _wait(arg, &remain_time, TRUE);
+
+            // check if data read
+            libevent_what = _libevent_what();
+            if (event_got_signal(libevent_what))
+            {
+                // exit got
+                _status.set_app_errno(ERR_SIGNAL);
+            }
+            else if (event_readable(libevent_what))
+            {
+                recv_len = _recv_datagram(data_out, len_limit);
+                if (recv_len < 0) {
+                    _status.set_sys_errno();
+                }
+                else if (0 == recv_len) {
+                    // nothing read, e.g. taken by another worker, wait again for the rest of timeout
+                    should_continue_wait = TRUE;
+                }
+            }
+            else if (event_is_timeout(libevent_what))
+            {
+                recv_len = 0;
+                _status.set_app_errno(ERR_TIMEOUT);
+            }
+            else {
+                ERROR("unrecognized event flag: 0x%04u", libevent_what);
+                _status.set_app_errno(ERR_UNKNOWN);
+            }
+
+            if (should_continue_wait && FALSE == should_wait_forever)
+            {
+                now_time = ::andrewmc::cpptools::sys_up_timeval();
+                if (timercmp(&now_time, &end_time, <)) {
+                    timersub(&end_time, &now_time, &remain_time);
+                }
+                else {
+                    _status.set_app_errno(ERR_TIMEOUT);
+                    should_continue_wait = FALSE;
+                }
+            }
+        } while (should_continue_wait);
+    }
+
+    // write read data len and return
+    if (len_out) {
+        *len_out = (recv_len > 0) ? recv_len : 0;
+    }
+    return _status;
+}
 
 
 struct Error UDPServer::recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out, unsigned mili_secs)
@@ -849,16 +1262,18 @@ std::string UDPServer::client_addr()
 {
     if (_fd_ipv4)
     {
+        const struct sockaddr_in *addr4 = (const struct sockaddr_in *)_remote_sock_addr();
         char c_addr_str[INET_ADDRSTRLEN + 1];
         c_addr_str[INET_ADDRSTRLEN] = '\0';
-        inet_ntop(AF_INET, &(_remote_addr_ipv4.sin_addr), c_addr_str, sizeof(c_addr_str));
+        inet_ntop(AF_INET, &(addr4->sin_addr), c_addr_str, sizeof(c_addr_str));
         return std::string(c_addr_str);
     }
     else if (_fd_ipv6)
     {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)_remote_sock_addr();
         char c_addr_str[INET6_ADDRSTRLEN + 1];
         c_addr_str[INET6_ADDRSTRLEN] = '\0';
-        inet_ntop(AF_INET6, &(_remote_addr_ipv6.sin6_addr), c_addr_str, sizeof(c_addr_str));
+        inet_ntop(AF_INET6, &(addr6->sin6_addr), c_addr_str, sizeof(c_addr_str));
         return std::string(c_addr_str);
     }
     else {
@@ -870,10 +1285,10 @@ std::string UDPServer::client_addr()
 unsigned UDPServer::client_port()
 {
     if (_fd_ipv4) {
-        return (unsigned)ntohs(_remote_addr_ipv4.sin_port);
+        return (unsigned)ntohs(((const struct sockaddr_in *)_remote_sock_addr())->sin_port);
     }
     else if (_fd_ipv6) {
-        return (unsigned)ntohs(_remote_addr_ipv6.sin6_port);
+        return (unsigned)ntohs(((const struct sockaddr_in6 *)_remote_sock_addr())->sin6_port);
     }
     else {
         return 0;
@@ -906,21 +1321,23 @@ struct Error UDPServer::send(const void *data, const size_t data_len, size_t *se
     // prepare parameters
     ssize_t send_ret = 0;
     socklen_t addr_len;
+    struct sockaddr_in6 mapped_addr;
     int fd = _fd();
 
     if (NULL == addr) {
         addr = _remote_sock_addr();
+        addr_len = *_remote_sock_addr_len();
     }
-
-    if (_fd_ipv4) {
-        addr_len = _remote_addr_ipv4_len;
+    else if (_fd_ipv4) {
+        addr_len = sizeof(_remote_addr_ipv4);
     }
     else if (_fd_ipv6) {
-        addr_len = _remote_addr_ipv6_len;
+        addr_len = sizeof(_remote_addr_ipv6);
     }
-    else if (_fd_unix) {
-        addr_len = _remote_addr_unix_len;
+    else {
+        addr_len = *_remote_sock_addr_len();
     }
+    addr = _send_addr(addr, &addr_len, &mapped_addr);
 
     // sendto()
     if (fd > 0) 
@@ -954,7 +1371,12 @@ struct Error UDPServer::send(const void *data, const size_t data_len, size_t *se
             convert_str_to_sockaddr_in(target_address, port, &addr);
             return send(data, data_len, send_len_out,(struct sockaddr *)(&addr));
         }
-        else if (_fd_ipv4) {
+        else if (_fd_ipv6) {
+            struct sockaddr_in addr4;
+            if (_is_dual_stack && 1 == inet_pton(AF_INET, target_address.c_str(), &(addr4.sin_addr))) {
+                convert_str_to_sockaddr_in(target_address, port, &addr4);
+                return send(data, data_len, send_len_out, (struct sockaddr *)(&addr4));
+            }
             struct sockaddr_in6 addr;
             convert_str_to_sockaddr_in6(target_address, port, &addr);
             return send(data, data_len, send_len_out, (struct sockaddr *)(&addr));
@@ -976,3 +1398,596 @@ struct Error UDPServer::reply(const void *data, const size_t data_len, size_t *r
 }
 
 #endif
+
+
+// ==========
+#define __BATCH_IO_FUNCTIONS
+#ifdef __BATCH_IO_FUNCTIONS
+
+int UDPServer::_recv_batch_nonblock(struct UDPMessage *msgs, size_t msg_count)
+{
+    struct mmsghdr hdrs[_MAX_BATCH_SIZE];
+    struct iovec iovs[_MAX_BATCH_SIZE];
+    char controls[_MAX_BATCH_SIZE][CMSG_SPACE(sizeof(int))];   // UDP_GRO segment size of each message
+    int recv_count = 0;
+
+    if (msg_count > _MAX_BATCH_SIZE) {
+        msg_count = _MAX_BATCH_SIZE;
+    }
+    memset(hdrs, 0, sizeof(hdrs[0]) * msg_count);
+
+    for (size_t index = 0; index < msg_count; index ++) {
+        iovs[index].iov_base = msgs[index].data;
+        iovs[index].iov_len = msgs[index].data_len;
+        hdrs[index].msg_hdr.msg_iov = &(iovs[index]);
+        hdrs[index].msg_hdr.msg_iovlen = 1;
+        hdrs[index].msg_hdr.msg_name = &(msgs[index].addr);
+        hdrs[index].msg_hdr.msg_namelen = sizeof(msgs[index].addr);
+        if (_is_gro) {
+            hdrs[index].msg_hdr.msg_control = controls[index];
+            hdrs[index].msg_hdr.msg_controllen = sizeof(controls[index]);
+        }
+    }
+
+    do {
+        recv_count = recvmmsg(_fd(), hdrs, msg_count, MSG_DONTWAIT, NULL);
+    } while (recv_count < 0 && EINTR == errno);
+
+    if (recv_count < 0) {
+        return (EAGAIN == errno || EWOULDBLOCK == errno) ? 0 : -1;
+    }
+
+    for (int index = 0; index < recv_count; index ++) {
+        msgs[index].data_len = hdrs[index].msg_len;
+        msgs[index].addr_len = hdrs[index].msg_hdr.msg_namelen;
+        msgs[index].is_truncated = (hdrs[index].msg_hdr.msg_flags & MSG_TRUNC) ? TRUE : FALSE;
+        msgs[index].segment_size = gro_segment_size(&(hdrs[index].msg_hdr), hdrs[index].msg_len);
+    }
+
+    // client_addr() and reply() refer to the last datagram
+    if (recv_count > 0) {
+        const struct UDPMessage *last_msg = &(msgs[recv_count - 1]);
+        socklen_t addr_size = _fd_ipv4 ? sizeof(_remote_addr_ipv4) : (_fd_ipv6 ? sizeof(_remote_addr_ipv6) : sizeof(_remote_addr_unix));
+        socklen_t addr_len = (last_msg->addr_len <= addr_size) ? last_msg->addr_len : addr_size;
+        memcpy(_remote_sock_addr(), &(last_msg->addr), addr_len);
+        *_remote_sock_addr_len() = addr_len;
+    }
+    return recv_count;
+}
+
+
+struct Error UDPServer::recv_batch_in_timeval(struct UDPMessage *msgs, size_t msg_count, size_t *recv_count_out, const struct timeval &timeout)
+{
+    struct _EventArg *arg = (struct _EventArg *)_worker_arg();
+    BOOL is_waited = FALSE;
+
+    if (recv_count_out) {
+        *recv_count_out = 0;
+    }
+    if (!(msgs && msg_count)) {
+        ERROR("no recv message buffer specified");
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    _status.clear_err();
+
+    uint32_t libevent_what = _libevent_what();
+    while (TRUE)
+    {
+        if (event_got_signal(libevent_what))
+        {
+            // exit got
+            _status.set_app_errno(ERR_SIGNAL);
+            return _status;
+        }
+        else if (event_readable(libevent_what))
+        {
+            // drain as many datagrams as possible in one syscall
+            int recv_count = _recv_batch_nonblock(msgs, msg_count);
+            if (recv_count < 0) {
+                _status.set_sys_errno();
+                return _status;
+            }
+            else if (recv_count > 0) {
+                if (recv_count_out) {
+                    *recv_count_out = (size_t)recv_count;
+                }
+                return _status;
+            }
+            // EAGAIN, wait again
+        }
+        else if (is_waited && event_is_timeout(libevent_what))
+        {
+            _status.set_app_errno(ERR_TIMEOUT);
+            return _status;
+        }
+        else if (is_waited)
+        {
+            ERROR("unrecognized event flag: 0x%04u", libevent_what);
+            _status.set_app_errno(ERR_UNKNOWN);
+            return _status;
+        }
+
+        // no data available
+        struct timeval timeout_copy;
+        timeout_copy.tv_sec = timeout.tv_sec;
+        timeout_copy.tv_usec = timeout.tv_usec;
+        if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
+            timeout_copy.tv_sec = FOREVER_SECONDS;
+        }
+        _wait(arg, &timeout_copy, TRUE);
+
+        libevent_what = _libevent_what();
+        is_waited = TRUE;
+    }
+}
+
+
+struct Error UDPServer::recv_batch(struct UDPMessage *msgs, size_t msg_count, size_t *recv_count_out, double timeout_seconds)
+{
+    struct timeval timeout = {0, 0};
+    if (timeout_seconds > 0) {
+        timeout = to_timeval(timeout_seconds);
+    }
+
+    return recv_batch_in_timeval(msgs, msg_count, recv_count_out, timeout);
+}
+
+
+struct Error UDPServer::send_batch(const struct UDPMessage *msgs, size_t msg_count, size_t *send_count_out)
+{
+    struct mmsghdr hdrs[_MAX_BATCH_SIZE];
+    struct iovec iovs[_MAX_BATCH_SIZE];
+    struct sockaddr_in6 mapped_addrs[_MAX_BATCH_SIZE];
+    size_t send_count = 0;
+
+    _status.clear_err();
+    if (NULL == msgs || 0 == msg_count) {
+        ERROR("no message to send");
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+
+    int fd = _fd();
+    while (fd > 0 && send_count < msg_count)
+    {
+        size_t batch_count = msg_count - send_count;
+        if (batch_count > _MAX_BATCH_SIZE) {
+            batch_count = _MAX_BATCH_SIZE;
+        }
+        memset(hdrs, 0, sizeof(hdrs[0]) * batch_count);
+
+        for (size_t index = 0; index < batch_count; index ++)
+        {
+            const struct UDPMessage *msg = &(msgs[send_count + index]);
+            iovs[index].iov_base = msg->data;
+            iovs[index].iov_len = msg->data_len;
+            hdrs[index].msg_hdr.msg_iov = &(iovs[index]);
+            hdrs[index].msg_hdr.msg_iovlen = 1;
+            if (msg->addr_len > 0) {
+                socklen_t addr_len = msg->addr_len;
+                hdrs[index].msg_hdr.msg_name = (void *)_send_addr((const struct sockaddr *)&(msg->addr), &addr_len, &(mapped_addrs[index]));
+                hdrs[index].msg_hdr.msg_namelen = addr_len;
+            } else {
+                hdrs[index].msg_hdr.msg_name = _remote_sock_addr();
+                hdrs[index].msg_hdr.msg_namelen = *_remote_sock_addr_len();
+            }
+        }
+
+        int send_ret = sendmmsg(fd, hdrs, batch_count, 0);
+        if (send_ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            _status.set_sys_errno();
+            break;
+        }
+        send_count += send_ret;
+    }
+
+    if (send_count_out) {
+        *send_count_out = send_count;
+    }
+    return _status;
+}
+
+#endif  // end of __BATCH_IO_FUNCTIONS
+
+
+// ==========
+#define __SEGMENTATION_OFFLOAD_FUNCTIONS
+#ifdef __SEGMENTATION_OFFLOAD_FUNCTIONS
+
+ssize_t UDPServer::_recv_datagram(void *data_out, size_t len_limit)
+{
+    if (_is_gro) {
+        return ::andrewmc::libcoevent::recv_segmented(_fd(), data_out, len_limit, _remote_sock_addr(), _remote_sock_addr_len(), &_last_segment_size);
+    }
+
+    ssize_t recv_len = recv_from(_fd(), data_out, len_limit, 0, _remote_sock_addr(), _remote_sock_addr_len());
+    _last_segment_size = (recv_len > 0) ? recv_len : 0;
+    return recv_len;
+}
+
+
+struct Error UDPServer::send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out, const struct sockaddr *addr)
+{
+    ssize_t send_ret = 0;
+    socklen_t addr_len = *_remote_sock_addr_len();
+    struct sockaddr_in6 mapped_addr;
+    int fd = _fd();
+
+    _status.clear_err();
+    if (NULL == data || 0 == data_len || 0 == segment_size) {
+        ERROR("no data to send");
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+
+    if (NULL == addr) {
+        addr = _remote_sock_addr();
+    } else if (AF_INET == addr->sa_family) {
+        addr_len = sizeof(struct sockaddr_in);
+    } else if (AF_INET6 == addr->sa_family) {
+        addr_len = sizeof(struct sockaddr_in6);
+    }
+    addr = _send_addr(addr, &addr_len, &mapped_addr);
+
+    if (fd > 0)
+    {
+        send_ret = ::andrewmc::libcoevent::send_segmented(fd, data, data_len, segment_size, addr, addr_len);
+        if (send_ret < 0) {
+            _status.set_sys_errno();
+        }
+    }
+
+    if (send_len_out) {
+        *send_len_out = (send_ret > 0) ? send_ret : 0;
+    }
+    return _status;
+}
+
+
+struct Error UDPServer::set_gro(BOOL enable)
+{
+    struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    int fd = _fd();
+
+    _status.clear_err();
+    if (NULL == arg || fd <= 0) {
+        _status.set_app_errno(ERR_NOT_INITIALIZED);
+        return _status;
+    }
+    if (_session_mode_worker == arg->worker_func) {
+        ERROR("%s - GRO is not supported in session mode", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+
+    if (set_fd_udp_gro(fd, enable) < 0) {
+        _status.set_sys_errno();
+        return _status;
+    }
+    _is_gro = enable ? TRUE : FALSE;
+    return _status;
+}
+
+
+BOOL UDPServer::gro()
+{
+    return _is_gro;
+}
+
+
+struct Error UDPServer::recv_segmented(void *data_out, const size_t len_limit, size_t *len_out, size_t *segment_size_out, double timeout_seconds)
+{
+    size_t recv_len = 0;
+
+    _last_segment_size = 0;
+    recv(data_out, len_limit, &recv_len, timeout_seconds);
+
+    if (len_out) {
+        *len_out = recv_len;
+    }
+    if (segment_size_out) {
+        *segment_size_out = (recv_len > 0) ? _last_segment_size : 0;
+    }
+    return _status;
+}
+
+#endif  // end of __SEGMENTATION_OFFLOAD_FUNCTIONS
+
+
+// ==========
+#define __DUAL_STACK_FUNCTIONS
+#ifdef __DUAL_STACK_FUNCTIONS
+
+struct Error UDPServer::set_dual_stack(BOOL enable)
+{
+    _status.clear_err();
+    if (_event) {
+        ERROR("%s - dual-stack should be set before init()", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+
+    _is_dual_stack = enable ? TRUE : FALSE;
+    return _status;
+}
+
+
+BOOL UDPServer::dual_stack()
+{
+    return _is_dual_stack;
+}
+
+
+// IPv4 target is not accepted by IPv6 socket, map it to ::ffff:a.b.c.d in mapped_buff
+const struct sockaddr *UDPServer::_send_addr(const struct sockaddr *addr, socklen_t *addr_len, struct sockaddr_in6 *mapped_buff)
+{
+    if (_fd_ipv6 && addr && AF_INET == addr->sa_family) {
+        convert_sockaddr_in_to_v4mapped((const struct sockaddr_in *)addr, mapped_buff);
+        *addr_len = sizeof(*mapped_buff);
+        return (const struct sockaddr *)mapped_buff;
+    }
+    return addr;
+}
+
+#endif  // end of __DUAL_STACK_FUNCTIONS
+
+
+// ==========
+#define __WORKER_POOL_FUNCTIONS
+#ifdef __WORKER_POOL_FUNCTIONS
+
+struct Error UDPServer::set_worker_count(unsigned worker_count)
+{
+    _status.clear_err();
+    if (_event) {
+        ERROR("%s - worker count should be set before init()", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+
+    _worker_count = (worker_count > 0) ? worker_count : 1;
+    return _status;
+}
+
+
+unsigned UDPServer::worker_count()
+{
+    return _worker_count;
+}
+
+
+// first_arg is already created by init(), which is the first worker and holds the pool
+struct Error UDPServer::_start_workers(Base *base, void *first_arg)
+{
+    struct _EventArg *first = (struct _EventArg *)first_arg;
+    _status.clear_err();
+
+    _event = event_new(base->event_base(), first->fd, EV_READ, _dispatch_callback, first);
+    if (NULL == _event) {
+        ERROR("Failed to new a UDP event");
+        _status.set_app_errno(ERR_EVENT_EVENT_NEW);
+        return _status;
+    }
+    first->socket_event = _event;
+    first->first_worker = first;
+    first->workers.push_back(first);
+
+    for (unsigned index = 1; index < _worker_count; index ++)
+    {
+        struct _EventArg *worker = new _EventArg;
+        worker->event = this;
+        worker->fd = first->fd;
+        worker->libevent_what_ptr = &(worker->libevent_what);
+        worker->worker_func = first->worker_func;
+        worker->user_arg = first->user_arg;
+        worker->session_table = first->session_table;
+        worker->first_worker = first;
+        first->workers.push_back(worker);
+
+        if (0 != co_create(&(worker->coroutine), NULL, _libco_routine, worker)) {
+            _status.set_app_errno(ERR_LIBCO_CREATE);
+            return _status;
+        }
+    }
+
+    // each worker has its own timer, so that timeouts and sleeps of workers do not interfere
+    for (size_t index = 0; index < first->workers.size(); index ++)
+    {
+        struct _EventArg *worker = first->workers[index];
+        worker->worker_event = event_new(base->event_base(), -1, EV_TIMEOUT, _libevent_callback, worker);
+        if (NULL == worker->worker_event) {
+            ERROR("Failed to new a UDP worker event");
+            _status.set_app_errno(ERR_EVENT_EVENT_NEW);
+            return _status;
+        }
+    }
+
+    struct timeval sleep_time = {0, 0};
+    first->running_workers = (unsigned)first->workers.size();
+    for (size_t index = 0; index < first->workers.size(); index ++) {
+        event_add(first->workers[index]->worker_event, &sleep_time);
+    }
+    DEBUG("Add UDP event %s with %u workers", _identifier.c_str(), (unsigned)first->workers.size());
+    return _status;
+}
+
+
+void UDPServer::_stop_workers()
+{
+    struct _EventArg *first = (struct _EventArg *)_event_arg;
+    if (NULL == first || NULL == first->first_worker) {
+        return;
+    }
+
+    for (size_t index = 0; index < first->workers.size(); index ++)
+    {
+        struct _EventArg *worker = first->workers[index];
+        if (worker->worker_event) {
+            event_del(worker->worker_event);
+            event_free(worker->worker_event);
+            worker->worker_event = NULL;
+        }
+        if (worker != first) {
+            if (worker->coroutine) {
+                co_release(worker->coroutine);
+            }
+            delete worker;
+        }
+    }
+
+    first->workers.clear();
+    first->idle_workers.clear();
+    first->first_worker = NULL;
+    first->socket_event = NULL;
+    return;
+}
+
+#endif  // end of __WORKER_POOL_FUNCTIONS
+
+
+// ==========
+#define __REUSEPORT_FUNCTIONS
+#ifdef __REUSEPORT_FUNCTIONS
+
+struct Error UDPServer::set_reuseport_group(unsigned group_size, ReusePortPolicy_t policy)
+{
+    _status.clear_err();
+    if (_event) {
+        ERROR("%s - reuseport group should be set before init()", _identifier.c_str());
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+    if (policy != ReusePortKernel && policy != ReusePortFlowHash && policy != ReusePortCPU) {
+        _status.set_app_errno(ERR_PARA_ILLEGAL);
+        return _status;
+    }
+
+    _reuseport_group_size = group_size;
+    _reuseport_policy = policy;
+    return _status;
+}
+
+
+unsigned UDPServer::reuseport_group_size()
+{
+    return _reuseport_group_size;
+}
+
+
+ReusePortPolicy_t UDPServer::reuseport_policy()
+{
+    return _reuseport_policy;
+}
+
+
+struct Error UDPServer::_join_reuseport_group(int fd)
+{
+    int enable = 1;
+    _status.clear_err();
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        _status.set_sys_errno();
+    }
+    return _status;
+}
+
+
+// Classic BPF returns index of socket in reuseport group. The filter runs with packet data at UDP payload,
+// so headers are read with SKF_NET_OFF. IPv4 packets may also arrive at dual-stack IPv6 socket.
+static size_t _flow_hash_program(struct sock_filter *prog, unsigned group_size)
+{
+    size_t count = 0;
+
+    size_t ipv6_jump = 0;
+    size_t hash_jump = 0;
+
+#define _BPF_STMT(code, k)          do { struct sock_filter insn = BPF_STMT((code), (uint32_t)(k)); prog[count ++] = insn; } while(0)
+#define _BPF_JUMP(code, k, jt, jf)  do { struct sock_filter insn = BPF_JUMP((code), (uint32_t)(k), (jt), (jf)); prog[count ++] = insn; } while(0)
+
+    // IP version
+    _BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF);
+    _BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4);
+    ipv6_jump = count;
+    _BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 0);
+
+    // IPv4: M[0] = src ^ dst, then ports after header of variable length
+    _BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12);
+    _BPF_STMT(BPF_ST, 0);
+    _BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 16);
+    _BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 0);
+    _BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+    _BPF_STMT(BPF_ST, 0);
+    _BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF);
+    _BPF_STMT(BPF_LD | BPF_W | BPF_IND, SKF_NET_OFF);
+    hash_jump = count;
+    _BPF_JUMP(BPF_JMP | BPF_JA, 0, 0, 0);
+
+    // IPv6: M[0] = XOR of address words, then ports after fixed header
+    prog[ipv6_jump].jt = (uint8_t)(count - ipv6_jump - 1);
+    _BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8);
+    _BPF_STMT(BPF_ST, 0);
+    for (int offset = 12; offset < 40; offset += 4) {
+        _BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + offset);
+        _BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 0);
+        _BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+        _BPF_STMT(BPF_ST, 0);
+    }
+    _BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 40);
+
+    // A holds both ports, mix with addresses and take modulo
+    prog[hash_jump].k = (uint32_t)(count - hash_jump - 1);
+    _BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 0);
+    _BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+    _BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1);
+    _BPF_STMT(BPF_MISC | BPF_TAX, 0);
+    _BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16);
+    _BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0);
+    _BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, group_size);
+    _BPF_STMT(BPF_RET | BPF_A, 0);
+
+#undef _BPF_STMT
+#undef _BPF_JUMP
+    return count;
+}
+
+
+static size_t _cpu_program(struct sock_filter *prog, unsigned group_size)
+{
+    struct sock_filter insns[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, group_size),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    memcpy(prog, insns, sizeof(insns));
+    return sizeof(insns) / sizeof(insns[0]);
+}
+
+
+struct Error UDPServer::_attach_reuseport_program(int fd)
+{
+    struct sock_filter insns[64];
+    struct sock_fprog prog;
+
+    _status.clear_err();
+    if (ReusePortCPU == _reuseport_policy) {
+        prog.len = (unsigned short)_cpu_program(insns, _reuseport_group_size);
+    } else {
+        prog.len = (unsigned short)_flow_hash_program(insns, _reuseport_group_size);
+    }
+    prog.filter = insns;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        int err = errno;
+        ERROR("%s - failed to attach reuseport program: %s", _identifier.c_str(), strerror(err));
+        _status.set_sys_errno(err);
+    }
+    return _status;
+}
+
+#endif  // end of __REUSEPORT_FUNCTIONS
+
+
+// end of file
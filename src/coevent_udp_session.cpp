@@ -16,6 +16,8 @@ using namespace andrewmc::libcoevent;
 #define __CO_EVENT_UDP_DEFINITIONS
 #ifdef __CO_EVENT_UDP_DEFINITIONS
 
+namespace {
+
 struct _EventArg {
     UDPSession          *event;
     UDPServer           *server;
@@ -30,6 +32,8 @@ struct _EventArg {
     {}
 };
 
+}   // end of anonymous namespace
+
 #endif
 
 
@@ -94,14 +98,16 @@ UDPItnlSession::UDPItnlSession()
     _identifier = identifier;
 
     _event_arg = NULL;
-    _fd = 0;
     _remote_addr_len = 0;
     _port = 0;
+    _server_fd = 0;
     _remote_addr.ss_family = 0;
-    _self_addr.ss_family = 0;
-    _data_buff.clear();
-    _data_offset = 0;
-    _data_len_to_read = 0;
+    _is_recv_waiting = FALSE;
+    _pool = NULL;
+    _viewed = NULL;
+    _reaper = NULL;
+    _reaper_entry = NULL;
+    _is_reaped = FALSE;
 
     _libevent_what_storage = (uint32_t *)malloc(sizeof(*_libevent_what_storage));
     if (NULL == _libevent_what_storage) {
@@ -148,11 +154,20 @@ void UDPItnlSession::_clear()
         _event = NULL;
     }
 
-    if (_fd > 0) {
-        close(_fd);
-    }
-    _fd = 0;
     _server_fd = 0;
+    _release_viewed();
+    while (FALSE == _inbound.empty()) {
+        _pool->release(_inbound.front());
+        _inbound.pop_front();
+    }
+    _is_recv_waiting = FALSE;
+
+    if (_reaper_entry) {
+        _reaper->remove(_reaper_entry);
+        _reaper_entry = NULL;
+    }
+    _reaper = NULL;
+    _is_reaped = FALSE;
     return;
 }
 
@@ -178,6 +193,7 @@ struct Error UDPItnlSession::init(UDPServer *server, int server_fd, WorkerFunc f
     _clear();
     _server_fd = server_fd;
     _server = server;
+    _pool = (DatagramItnlPool *)(server->owner()->datagram_pool());
 
     // create arguments
     struct _EventArg *arg = (struct _EventArg *)malloc(sizeof(*arg));
@@ -214,86 +230,19 @@ struct Error UDPItnlSession::init(UDPServer *server, int server_fd, WorkerFunc f
         DEBUG("Init coroutine %p", arg->coroutine);
     }
 
-    // determine network type
-    struct sockaddr_storage sock_addr;
-    memcpy(&_remote_addr, remote_addr, addr_len);
-    if (AF_INET == remote_addr->sa_family)
-    {
-        struct sockaddr_in *addr = (struct sockaddr_in *)&sock_addr;
-        _remote_addr_len = sizeof(*addr);
-        addr->sin_family = AF_INET;
-        addr->sin_port = htons(((struct sockaddr_in *)remote_addr)->sin_port);
-        addr->sin_addr.s_addr = htonl(INADDR_ANY);
-
-        addr = (struct sockaddr_in *)&_self_addr;
-        addr->sin_family = AF_INET;
-        addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-
-        _fd = socket(AF_INET, SOCK_DGRAM, 0);
-    }
-    else if (AF_INET6 == remote_addr->sa_family)
-    {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&sock_addr;
-        _remote_addr_len = sizeof(*addr6);
-        addr6->sin6_family = AF_INET6;
-        addr6->sin6_port = htons(((struct sockaddr_in *)remote_addr)->sin_port);
-        addr6->sin6_addr = in6addr_any;
-
-        addr6 = (struct sockaddr_in6 *)&_self_addr;
-        addr6->sin6_family = AF_INET6;
-        addr6->sin6_addr = in6addr_loopback;
-
-        _fd = socket(AF_INET6, SOCK_DGRAM, 0);
-    }
-    else
-    {
-        ERROR("Invalid socket type %u", (unsigned)remote_addr->sa_family);
-        _clear();
-        _status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
-        return _status;
-    }
-
-    if (_fd < 0) {
-        _clear();
-        _status.set_sys_errno(errno);
-        return _status;
-    }
-
-    // try binding
-    int status = bind(_fd, (struct sockaddr *)&sock_addr, _remote_addr_len);
-    if (status < 0) {
-        _clear();
-        _status.set_sys_errno(errno);
-        return _status;
+    // session shares socket of server, datagrams are forwarded in memory
+    if (AF_INET == remote_addr->sa_family) {
+        _remote_addr_len = sizeof(struct sockaddr_in);
+    } else {
+        _remote_addr_len = sizeof(struct sockaddr_in6);
     }
+    memcpy(&_remote_addr, remote_addr, _remote_addr_len);
+    _port = (unsigned)server->port();
+    arg->fd = _server_fd;
 
-    // get local port
-    if (AF_INET == _remote_addr.ss_family)
-    {
-        DEBUG("read sock info by getsockname()");
-        struct sockaddr_in addr = {0};
-        socklen_t socklen = sizeof(addr);
-        getsockname(_fd, (struct sockaddr *)(&addr), &socklen);
-        ((struct sockaddr_in *)&_self_addr)->sin_port = addr.sin_port;
-        _port = ntohs(addr.sin_port);
-    }
-    else // if (AF_INET6 == _remote_addr.ss_family)
-    {
-        DEBUG("read sock info by getsockname()");
-        struct sockaddr_in6 addr = {0};
-        socklen_t socklen = sizeof(addr);
-        getsockname(_fd, (struct sockaddr *)(&addr), &socklen);
-        ((struct sockaddr_in6 *)&_self_addr)->sin6_port = addr.sin6_port;
-        _port = ntohs(addr.sin6_port);
-    }
-
-    // non-block
-    set_fd_nonblock(_fd);
-    arg->fd = _fd;
-
-    // create event
+    // create a pure timer event, which is activated manually when datagram arrives
     _owner_base = server->owner();
-    _event = event_new(_owner_base->event_base(), _fd, EV_TIMEOUT | EV_READ, _libevent_callback, arg);     // should NOT use EV_ET or EV_PERSIST
+    _event = event_new(_owner_base->event_base(), -1, EV_TIMEOUT, _libevent_callback, arg);
     if (NULL == _event) {
         ERROR("Failed to new a UDP session");
         _clear();
@@ -306,6 +255,9 @@ struct Error UDPItnlSession::init(UDPServer *server, int server_fd, WorkerFunc f
         event_add(_event, &sleep_time);
     }
 
+    // idle and lifetime limit
+    attach_reaper(server->session_reaper());
+
     // automatic free
     if (auto_free) {
         _owner_base->put_event_under_control(this);
@@ -379,8 +331,10 @@ struct Error UDPItnlSession::sleep(struct timeval &sleep_time)
         return _status;
     }
 
+    _is_recv_waiting = TRUE;
     event_add(_event, &sleep_time);
     co_yield(arg->coroutine);
+    _is_recv_waiting = FALSE;
 
     // determine libevent event masks
     uint32_t libevent_what = (_libevent_what_storage) ? *_libevent_what_storage : 0;
@@ -431,145 +385,148 @@ struct Error UDPItnlSession::sleep(double seconds)
 #define __RECV_FUNCTIONS
 #ifdef __RECV_FUNCTIONS
 
-struct Error UDPItnlSession::recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout)
+void UDPItnlSession::_wait_inbound(const struct timeval &timeout)
 {
-    ssize_t recv_len = 0;
-    uint32_t libevent_what = (_libevent_what_storage) ? *_libevent_what_storage : 0;
     struct _EventArg *arg = (struct _EventArg *)_event_arg;
+    struct timeval timeout_copy;
+    timeout_copy.tv_sec = timeout.tv_sec;
+    timeout_copy.tv_usec = timeout.tv_usec;
 
-    if (NULL == data_out) {
-        ERROR("no recv data buffer spectied");
-        _status.set_app_errno(ERR_PARA_NULL);
-        return _status;
+    if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
+        timeout_copy.tv_sec = FOREVER_SECONDS;
     }
 
+    *_libevent_what_storage = 0;
+    _is_recv_waiting = TRUE;
+    event_add(_event, &timeout_copy);
+    co_yield(arg->coroutine);
+    _is_recv_waiting = FALSE;
+    return;
+}
+
+
+void UDPItnlSession::_wake_receiver()
+{
+    if (_is_recv_waiting && _event) {
+        _is_recv_waiting = FALSE;
+        event_active(_event, EV_READ, 1);
+    }
+    return;
+}
+
+
+void UDPItnlSession::_release_viewed()
+{
+    if (_viewed) {
+        _pool->release(_viewed);
+        _viewed = NULL;
+    }
+    return;
+}
+
+
+// take next datagram out of queue, wait if necessary. Returns NULL with _status set on failure
+struct DatagramBuffer *UDPItnlSession::_pop_inbound(const struct timeval &timeout)
+{
     _status.clear_err();
 
-    // ----------
-    // recvfrom and get data
-    // is there any data to be read?
-    if (_data_len_to_read > 0)
+    // no data available, now wait
+    if (_inbound.empty() && FALSE == _is_reaped)
     {
-        if (len_limit < _data_len_to_read) {
-            recv_len = len_limit;
-        }
-        else {
-            recv_len = _data_len_to_read;
-        }
-        memcpy(data_out, (uint8_t *)_data_buff.c_data() + _data_offset, recv_len);
-        _data_offset += recv_len;
-        _data_len_to_read -= recv_len;
-
-        // if all data read?
-        if (_data_offset >= _data_buff.length()) {
-            _data_buff.clear();
-            _data_offset = 0;
-            _data_len_to_read = 0;
-        }
+        DEBUG("%s has no datagram, now wait", _identifier.c_str());
+        _wait_inbound(timeout);
     }
-    // recv from socket
-    else if (event_readable(libevent_what))
-    {
-        // data incoming
-        struct sockaddr_storage addr;
-        socklen_t sock_len = _remote_addr_len;
-        size_t data_len = 0;
-        ssize_t recv_stat = recv_from(_fd, (void *)&data_len, sizeof(data_len), 0, (struct sockaddr *)&addr, &sock_len);
-        if (recv_stat < 0) {
-            _status.set_sys_errno();
-        }
-        else if (0 == recv_stat) {
-            DEBUG("EAGAIN");
-            *_libevent_what_storage &= ~EV_READ;
-            return recv_in_timeval(data_out, len_limit, len_out, timeout);
-        }
-        else {
-            // read data length and then fetch data
-            if (len_limit < _data_len_to_read) {
-                _data_len_to_read = data_len - len_limit;
-                recv_len = len_limit;
-            }
-            else {
-                _data_len_to_read = 0;
-                recv_len = data_len;
-            }
-            memcpy(data_out, (uint8_t *)_data_buff.c_data() + _data_offset, recv_len);
-            _data_offset += recv_len;
-
-            // if all data read?
-            if (_data_offset >= _data_buff.length()) {
-                _data_buff.clear();
-                _data_offset = 0;
-                _data_len_to_read = 0;
-            }
-        }
+
+    if (_is_reaped) {
+        _status.set_app_errno(ERR_SESSION_REAPED);
+        return NULL;
     }
-    // no data available, now wait
-    else {
-        // no data avaliable
-        struct timeval timeout_copy;
-        timeout_copy.tv_sec = timeout.tv_sec;
-        timeout_copy.tv_usec = timeout.tv_usec;
-
-        DEBUG("UDP libevent what flag: 0x%04x, now wait", (unsigned)libevent_what);
-        if ((0 == timeout_copy.tv_sec) && (0 == timeout_copy.tv_usec)) {
-            timeout_copy.tv_sec = FOREVER_SECONDS;
-        }
-        event_add(_event, &timeout_copy);
-        co_yield(arg->coroutine);
-
-        // check if data read
-        libevent_what = (_libevent_what_storage) ? *_libevent_what_storage : 0;
-        if (event_readable(libevent_what))
-        {
-            // data incoming
-            struct sockaddr_storage addr;
-            socklen_t sock_len = _remote_addr_len;
-            size_t data_len = 0;
-            ssize_t recv_stat = recv_from(_fd, (void *)&data_len, sizeof(data_len), 0, (struct sockaddr *)&addr, &sock_len);
-            if (recv_stat < 0) {
-                _status.set_sys_errno();
-            }
-            else {
-                // read data length and then fetch data
-                if (len_limit < _data_len_to_read) {
-                    _data_len_to_read = data_len - len_limit;
-                    recv_len = len_limit;
-                }
-                else {
-                    _data_len_to_read = 0;
-                    recv_len = data_len;
-                }
-                memcpy(data_out, (uint8_t *)_data_buff.c_data() + _data_offset, recv_len);
-                _data_offset += recv_len;
-
-                // if all data read?
-                if (_data_offset >= _data_buff.length()) {
-                    _data_buff.clear();
-                    _data_offset = 0;
-                    _data_len_to_read = 0;
-                }
-            }
-        }
-        else if (event_is_timeout(libevent_what))
-        {
-            recv_len = 0;
+    if (_inbound.empty())
+    {
+        uint32_t libevent_what = *_libevent_what_storage;
+        if (event_is_timeout(libevent_what)) {
             _status.set_app_errno(ERR_TIMEOUT);
-        }
-        else {
+        } else {
             ERROR("unrecognized event flag: 0x%04u", libevent_what);
             _status.set_app_errno(ERR_UNKNOWN);
         }
+        return NULL;
+    }
+
+    struct DatagramBuffer *datagram = _inbound.front();
+    _inbound.pop_front();
+
+    if (_reaper_entry) {
+        _reaper->touch(_reaper_entry);
     }
+    return datagram;
+}
+
+
+struct Error UDPItnlSession::recv_in_timeval(void *data_out, const size_t len_limit, size_t *len_out, const struct timeval &timeout)
+{
+    size_t recv_len = 0;
 
-    // write read data len and return
     if (len_out) {
-        *len_out = (recv_len > 0) ? recv_len : 0;
+        *len_out = 0;
+    }
+    if (NULL == data_out) {
+        ERROR("no recv data buffer spectied");
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    _release_viewed();
+
+    struct DatagramBuffer *datagram = _pop_inbound(timeout);
+    if (NULL == datagram) {
+        return _status;
+    }
+
+    // one datagram each time, exceeding part is discarded like recvfrom()
+    recv_len = (datagram->length <= len_limit) ? datagram->length : len_limit;
+    memcpy(data_out, datagram->data, recv_len);
+    _pool->release(datagram);
+
+    if (len_out) {
+        *len_out = recv_len;
     }
     return _status;
 }
 
 
+struct Error UDPItnlSession::recv_view_in_timeval(const void **data_out, size_t *len_out, const struct timeval &timeout)
+{
+    if (!(data_out && len_out)) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    *data_out = NULL;
+    *len_out = 0;
+    _release_viewed();
+
+    // buffer is kept by session until next recv, so that caller may parse it in place
+    _viewed = _pop_inbound(timeout);
+    if (NULL == _viewed) {
+        return _status;
+    }
+
+    *data_out = _viewed->data;
+    *len_out = _viewed->length;
+    return _status;
+}
+
+
+struct Error UDPItnlSession::recv_view(const void **data_out, size_t *len_out, double timeout_seconds)
+{
+    struct timeval timeout = {0, 0};
+    if (timeout_seconds > 0) {
+        timeout = to_timeval(timeout_seconds);
+    }
+
+    return recv_view_in_timeval(data_out, len_out, timeout);
+}
+
+
 struct Error UDPItnlSession::recv_in_mimlisecs(void *data_out, const size_t len_limit, size_t *len_out, unsigned mili_secs)
 {
     struct timeval timeout = to_timeval_from_milisecs(mili_secs);
@@ -595,17 +552,67 @@ struct Error UDPItnlSession::forward_incoming_data(const void *c_data, size_t da
         return _status;
     }
 
-    _status.clear_err();
-    ssize_t send_ret = sendto(_fd, (void *)&data_len, sizeof(data_len), 0, (struct sockaddr *)&_self_addr, _remote_addr_len);
-    if (send_ret < 0) {
-        _status.set_sys_errno();
+    struct DatagramBuffer *buffer = (data_len <= _pool->small_datagram_size()) ? _pool->acquire_small() : _pool->acquire();
+    if (NULL == buffer) {
+        _status.set_sys_errno(ENOMEM);
+        return _status;
+    }
+
+    buffer->length = (data_len <= buffer->capacity) ? data_len : buffer->capacity;
+    memcpy(buffer->data, c_data, buffer->length);
+    _status = forward_incoming_buffer(buffer);
+    if (_status.is_error()) {
+        _pool->release(buffer);
+    }
+    return _status;
+}
+
+
+struct Error UDPItnlSession::forward_incoming_buffer(struct DatagramBuffer *buffer)
+{
+    if (NULL == buffer) {
+        _status.set_app_errno(ERR_PARA_NULL);
         return _status;
     }
 
-    _data_buff.append(c_data, data_len);
+    // a session slow to read should not pin unlimited buffers
+    size_t inbound_limit = _server->session_inbound_limit();
+    if (inbound_limit > 0 && _inbound.size() >= inbound_limit) {
+        _status.set_app_errno(ERR_INBOUND_FULL);
+        return _status;
+    }
+
+    _status.clear_err();
+    _inbound.push_back(buffer);
+
+    if (_reaper_entry) {
+        _reaper->touch(_reaper_entry);
+    }
+    _wake_receiver();
     return _status;
 }
 
+
+void UDPItnlSession::reap()
+{
+    // entry is already released by reaper. Wake up pending recv()
+    _reaper_entry = NULL;
+    _is_reaped = TRUE;
+    _wake_receiver();
+    return;
+}
+
+
+void UDPItnlSession::attach_reaper(SessionReaper *reaper)
+{
+    if (NULL == reaper || _reaper_entry || _is_reaped) {
+        return;
+    }
+    _reaper = reaper;
+    _reaper_entry = _reaper->add(this);
+    return;
+}
+
 #endif  // end of __RECV_FUNCTIONS
 
 
@@ -625,6 +632,33 @@ struct Error UDPItnlSession::reply(const void *data, const size_t data_len, size
     }
     else {
         _status.clear_err();
+        if (_reaper_entry) {
+            _reaper->touch(_reaper_entry);
+        }
+    }
+
+    if (send_len_out) {
+        *send_len_out = send_stat > 0 ? send_stat : 0;
+    }
+    return _status;
+}
+
+
+struct Error UDPItnlSession::send_segmented(const void *data, const size_t data_len, size_t segment_size, size_t *send_len_out)
+{
+    if (!(data && data_len && segment_size)) {
+        _status.set_app_errno(ERR_PARA_NULL);
+        return _status;
+    }
+    ssize_t send_stat = ::andrewmc::libcoevent::send_segmented(_server_fd, data, data_len, segment_size, (struct sockaddr *)&_remote_addr, _remote_addr_len);
+    if (send_stat < 0) {
+        _status.set_sys_errno();
+    }
+    else {
+        _status.clear_err();
+        if (_reaper_entry) {
+            _reaper->touch(_reaper_entry);
+        }
     }
 
     if (send_len_out) {
@@ -0,0 +1,462 @@
+#include "coevent.h"
+#include "coevent_itnl.h"
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <vector>
+
+using namespace andrewmc::libcoevent;
+
+#define _DEFAULT_INITIAL_RTO        (0.5)
+#define _DEFAULT_MAX_RTO            (4.0)
+#define _DEFAULT_MAX_RETRANSMITS    (5)
+#define _MAX_READS_PER_EVENT        (64)        // do not starve other events when replies keep coming
+
+// ==========
+#define __LIBEVENT_CALLBACK
+#ifdef __LIBEVENT_CALLBACK
+
+static void _read_callback(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    UDPItnlTransactor *transactor = (UDPItnlTransactor *)libevent_arg;
+    transactor->handle_readable();
+    return;
+}
+
+
+// timeout of a transaction, or reply arrived
+void UDPItnlTransactor::handle_timer(evutil_socket_t fd, short what, void *libevent_arg)
+{
+    struct _Transaction *transaction = (struct _Transaction *)libevent_arg;
+    Procedure *procedure = transaction->procedure;      // transaction is on coroutine stack, gone after resume
+    struct stCoRoutine_t *coroutine = transaction->coroutine;
+
+    if (0 == transaction->libevent_what) {
+        transaction->libevent_what = (uint32_t)what;
+    }
+    procedure->resume_coroutine(coroutine);
+    return;
+}
+
+#endif  // end of __LIBEVENT_CALLBACK
+
+
+// ==========
+#define __CONSTRUCT_AND_DESTRUCT
+#ifdef __CONSTRUCT_AND_DESTRUCT
+
+UDPItnlTransactor::UDPItnlTransactor(Base *base, NetType_t network_type)
+{
+    _owner_base = base;
+    _network_type = network_type;
+    _fd = 0;
+    _event = NULL;
+    _id_func = NULL;
+    _id_func_arg = NULL;
+    _initial_rto = _DEFAULT_INITIAL_RTO;
+    _max_rto = _DEFAULT_MAX_RTO;
+    _max_retransmits = _DEFAULT_MAX_RETRANSMITS;
+    _retransmit_count = 0;
+    _unmatched_count = 0;
+    return;
+}
+
+
+UDPItnlTransactor::~UDPItnlTransactor()
+{
+    // coroutines still waiting will never be resumed
+    std::vector<void *> transactions;
+    _pending.all_values(transactions);
+    for (size_t index = 0; index < transactions.size(); index ++) {
+        _release_timer(((struct _Transaction *)transactions[index])->timer);
+    }
+    _pending.clear();
+
+    for (size_t index = 0; index < _idle_timers.size(); index ++) {
+        event_free(_idle_timers[index]);
+    }
+    _idle_timers.clear();
+
+    if (_event) {
+        event_del(_event);
+        event_free(_event);
+        _event = NULL;
+    }
+    if (_fd > 0) {
+        close(_fd);
+        _fd = 0;
+    }
+    return;
+}
+
+
+#endif  // end of __CONSTRUCT_AND_DESTRUCT
+
+
+// ==========
+#define __SETTINGS
+#ifdef __SETTINGS
+
+void UDPItnlTransactor::set_transaction_id_func(UDPTransactionIdFunc func, void *user_arg)
+{
+    _id_func = func;
+    _id_func_arg = user_arg;
+    return;
+}
+
+
+void UDPItnlTransactor::set_retransmission(double initial_rto, double max_rto, unsigned max_retransmits)
+{
+    _initial_rto = (initial_rto > 0) ? initial_rto : _DEFAULT_INITIAL_RTO;
+    _max_rto = (max_rto > _initial_rto) ? max_rto : _initial_rto;
+    _max_retransmits = max_retransmits;
+    return;
+}
+
+
+double UDPItnlTransactor::initial_rto()
+{
+    return _initial_rto;
+}
+
+
+double UDPItnlTransactor::max_rto()
+{
+    return _max_rto;
+}
+
+
+unsigned UDPItnlTransactor::max_retransmits()
+{
+    return _max_retransmits;
+}
+
+
+size_t UDPItnlTransactor::pending_count()
+{
+    return _pending.size();
+}
+
+
+uint64_t UDPItnlTransactor::retransmit_count()
+{
+    return _retransmit_count;
+}
+
+
+uint64_t UDPItnlTransactor::unmatched_count()
+{
+    return _unmatched_count;
+}
+
+
+#endif  // end of __SETTINGS
+
+
+// ==========
+#define __INTERNAL_FUNCTIONS
+#ifdef __INTERNAL_FUNCTIONS
+
+// socket is opened on first transaction
+struct Error UDPItnlTransactor::_open()
+{
+    struct Error status;
+    if (_fd > 0) {
+        return status;
+    }
+
+    _fd = socket((NetIPv6 == _network_type) ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+    if (_fd < 0) {
+        _fd = 0;
+        status.set_sys_errno();
+        return status;
+    }
+    set_fd_nonblock(_fd);
+
+    _event = event_new(_owner_base->event_base(), _fd, EV_READ | EV_PERSIST, _read_callback, this);
+    if (NULL == _event) {
+        ERROR("Failed to new a UDP transactor event");
+        close(_fd);
+        _fd = 0;
+        status.set_app_errno(ERR_EVENT_EVENT_NEW);
+        return status;
+    }
+    return status;
+}
+
+
+// socket is watched only while transactions are pending, so that Base::run() can end
+void UDPItnlTransactor::_update_event()
+{
+    if (0 == _pending.size()) {
+        event_del(_event);
+    } else {
+        event_add(_event, NULL);
+    }
+    return;
+}
+
+
+struct Error UDPItnlTransactor::_make_key(const struct sockaddr *addr, const void *data, size_t data_len, UDPPeerTable::Key *key_out)
+{
+    struct Error status;
+    uint64_t transaction_id = 0;
+
+    if (NULL == _id_func) {
+        ERROR("transaction id function of UDP transactor is not set");
+        status.set_app_errno(ERR_NOT_INITIALIZED);
+        return status;
+    }
+    if (FALSE == (_id_func)(data, data_len, &transaction_id, _id_func_arg)) {
+        status.set_app_errno(ERR_PARA_ILLEGAL, "no transaction id in datagram");
+        return status;
+    }
+
+    UDPPeerTable::make_key(addr, key_out, transaction_id);
+    return status;
+}
+
+
+// timers are reused, as a transaction may end inside callback of its own timer
+struct event *UDPItnlTransactor::_acquire_timer(struct _Transaction *transaction)
+{
+    if (_idle_timers.empty()) {
+        return event_new(_owner_base->event_base(), -1, EV_TIMEOUT, handle_timer, transaction);
+    }
+
+    struct event *timer = _idle_timers.back();
+    _idle_timers.pop_back();
+    event_assign(timer, _owner_base->event_base(), -1, EV_TIMEOUT, handle_timer, transaction);
+    return timer;
+}
+
+
+void UDPItnlTransactor::_release_timer(struct event *timer)
+{
+    if (timer) {
+        event_del(timer);
+        _idle_timers.push_back(timer);
+    }
+    return;
+}
+
+
+void UDPItnlTransactor::handle_readable()
+{
+    DatagramItnlPool *pool = (DatagramItnlPool *)(_owner_base->datagram_pool());
+    struct DatagramBuffer *buffer = pool->acquire();
+    struct sockaddr_storage remote_addr;
+    UDPPeerTable::Key key;
+
+    if (NULL == buffer) {
+        ERROR("No memory for UDP transactor reply buffer");
+        return;
+    }
+
+    for (unsigned count = 0; count < _MAX_READS_PER_EVENT; count ++)
+    {
+        socklen_t addr_len = sizeof(remote_addr);
+        ssize_t recv_len = recvfrom(_fd, buffer->data, buffer->capacity, MSG_DONTWAIT, (struct sockaddr *)&remote_addr, &addr_len);
+        if (recv_len < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EAGAIN != errno && EWOULDBLOCK != errno) {
+                DEBUG("UDP transactor recv error: %s", strerror(errno));
+            }
+            break;
+        }
+
+        struct _Transaction *transaction = NULL;
+        if (_make_key((struct sockaddr *)&remote_addr, buffer->data, recv_len, &key).is_ok()) {
+            transaction = (struct _Transaction *)_pending.find(key);
+        }
+        if (NULL == transaction) {
+            _unmatched_count ++;
+            continue;
+        }
+
+        // copy reply to waiting coroutine, which is woken up after this callback
+        _pending.erase(key);
+        transaction->reply_len = ((size_t)recv_len <= transaction->reply_limit) ? recv_len : transaction->reply_limit;
+        memcpy(transaction->reply_out, buffer->data, transaction->reply_len);
+        transaction->libevent_what = EV_READ;
+        event_active(transaction->timer, EV_READ, 1);
+    }
+
+    _update_event();
+    pool->release(buffer);
+    return;
+}
+
+
+#endif  // end of __INTERNAL_FUNCTIONS
+
+
+// ==========
+#define __TRANSACTION_FUNCTIONS
+#ifdef __TRANSACTION_FUNCTIONS
+
+static double _now()
+{
+    struct timeval now = ::andrewmc::cpptools::sys_up_timeval();
+    return to_double(now);
+}
+
+
+struct Error UDPItnlTransactor::transact(Procedure *procedure, const struct sockaddr *addr, socklen_t addr_len,
+                                        const void *request, size_t request_len,
+                                        void *reply_out, size_t reply_limit, size_t *reply_len_out, double timeout_seconds)
+{
+    struct Error status;
+    struct _Transaction transaction;
+    UDPPeerTable::Key key;
+
+    if (reply_len_out) {
+        *reply_len_out = 0;
+    }
+    if (!(procedure && addr && request && request_len && reply_out && reply_limit)) {
+        status.set_app_errno(ERR_PARA_NULL);
+        return status;
+    }
+    if (addr->sa_family != ((NetIPv6 == _network_type) ? AF_INET6 : AF_INET)) {
+        status.set_app_errno(ERR_NETWORK_TYPE_ILLEGAL);
+        return status;
+    }
+
+    // reply resumes coroutine of procedure, which is also where procedure ends
+    struct stCoRoutine_t *coroutine = procedure->coroutine();
+    if (NULL == coroutine || coroutine != co_self()) {
+        status.set_app_errno(ERR_PARA_ILLEGAL, "should be called inside coroutine of procedure");
+        return status;
+    }
+
+    status = _open();
+    if (status.is_error()) {
+        return status;
+    }
+    status = _make_key(addr, request, request_len, &key);
+    if (status.is_error()) {
+        return status;
+    }
+    if (_pending.find(key)) {
+        status.set_app_errno(ERR_PARA_ILLEGAL, "transaction id already in use");
+        return status;
+    }
+
+    // send first request
+    if (sendto(_fd, request, request_len, 0, addr, addr_len) < 0) {
+        status.set_sys_errno();
+        return status;
+    }
+
+    transaction.transactor = this;
+    transaction.procedure = procedure;
+    transaction.coroutine = coroutine;
+    transaction.libevent_what = 0;
+    transaction.reply_out = reply_out;
+    transaction.reply_limit = reply_limit;
+    transaction.reply_len = 0;
+    transaction.timer = _acquire_timer(&transaction);
+    if (NULL == transaction.timer) {
+        status.set_app_errno(ERR_EVENT_EVENT_NEW);
+        return status;
+    }
+    status = _pending.insert(key, &transaction);
+    if (status.is_error()) {
+        _release_timer(transaction.timer);
+        return status;
+    }
+    _update_event();
+
+    // wait for reply, retransmit when rto expires
+    double now = _now();
+    double deadline = now + ((timeout_seconds > 0) ? timeout_seconds : (double)FOREVER_SECONDS);
+    double rto = _initial_rto;
+    unsigned retransmits = 0;
+
+    while (TRUE)
+    {
+        double wait_time = deadline - now;
+        if (retransmits < _max_retransmits && rto < wait_time) {
+            wait_time = rto;
+        }
+        struct timeval timeout = to_timeval(wait_time);
+
+        transaction.libevent_what = 0;
+        event_add(transaction.timer, &timeout);
+        co_yield(transaction.coroutine);
+
+        if (event_readable(transaction.libevent_what)) {
+            break;
+        }
+
+        now = _now();
+        if (now >= deadline) {
+            _pending.erase(key);
+            _update_event();
+            status.set_app_errno(ERR_TIMEOUT);
+            break;
+        }
+        if (retransmits >= _max_retransmits) {
+            continue;
+        }
+
+        // lost, send again. A send error is left to timeout as the next one may succeed
+        retransmits ++;
+        _retransmit_count ++;
+        rto = (rto * 2 < _max_rto) ? rto * 2 : _max_rto;
+        DEBUG("UDP transactor retransmits %u time(s), next rto %.3fs", retransmits, rto);
+        sendto(_fd, request, request_len, 0, addr, addr_len);
+    }
+
+    _release_timer(transaction.timer);
+    if (reply_len_out) {
+        *reply_len_out = transaction.reply_len;
+    }
+    return status;
+}
+
+
+struct Error UDPItnlTransactor::transact(Procedure *procedure, const std::string &target_address, unsigned target_port,
+                                        const void *request, size_t request_len,
+                                        void *reply_out, size_t reply_limit, size_t *reply_len_out, double timeout_seconds)
+{
+    struct Error status;
+
+    if (FALSE == is_IP_address(target_address))
+    {
+        std::vector<std::string> ip_list;
+        DNSItnlCache *cache = (DNSItnlCache *)(_owner_base->dns_cache());
+        status = cache->lookup(procedure, target_address, _network_type, DNS_LOOKUP_TIMEOUT, ip_list);
+        if (status.is_error()) {
+            if (reply_len_out) {
+                *reply_len_out = 0;
+            }
+            return status;
+        }
+        return transact(procedure, ip_list[0], target_port, request, request_len, reply_out, reply_limit, reply_len_out, timeout_seconds);
+    }
+
+    if (NetIPv6 == _network_type) {
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        convert_str_to_sockaddr_in6(target_address, target_port, &addr);
+        return transact(procedure, (struct sockaddr *)(&addr), sizeof(addr), request, request_len, reply_out, reply_limit, reply_len_out, timeout_seconds);
+    }
+    else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        convert_str_to_sockaddr_in(target_address, target_port, &addr);
+        return transact(procedure, (struct sockaddr *)(&addr), sizeof(addr), request, request_len, reply_out, reply_limit, reply_len_out, timeout_seconds);
+    }
+}
+
+
+#endif  // end of __TRANSACTION_FUNCTIONS
+
+
+// end of file
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/sysinfo.h>
+#include <time.h>
 
 using namespace andrewmc::cpptools;
 
@@ -200,6 +201,15 @@ time_t andrewmc::cpptools::sys_up_time()
 struct timeval andrewmc::cpptools::sys_up_timeval()
 {
     struct timeval ret = {0, 0};
+
+    // clock_gettime() is served by vDSO, much cheaper than reading /proc/uptime
+    struct timespec spec;
+    if (0 == clock_gettime(CLOCK_BOOTTIME, &spec)) {
+        ret.tv_sec = spec.tv_sec;
+        ret.tv_usec = spec.tv_nsec / 1000;
+        return ret;
+    }
+
     const char *file_path = "/proc/uptime";
     char read_buff[128] = "";
 
@@ -0,0 +1,83 @@
+#include "coevent.h"
+#include "coevent_http.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace andrewmc::libcoevent;
+
+// benchmark with a local load generator, for example:
+//     wrk -t2 -c100 -d10s http://127.0.0.1:8080/hello
+#define _HTTP_PORT      (8080)
+
+// ==========
+#define __REQUEST_HANDLERS
+#ifdef __REQUEST_HANDLERS
+
+static void _hello(HTTPRequest &request, HTTPResponse &response, void *arg)
+{
+    response.add_header("Content-Type", "text/plain");
+    response.set_body("Hello, libcoevent!\n");
+    return;
+}
+
+
+static void _echo(HTTPRequest &request, HTTPResponse &response, void *arg)
+{
+    const HTTPStringView *content_type = request.header("Content-Type");
+    if (content_type) {
+        response.add_header("Content-Type", content_type->str());
+    }
+    response.set_body(request.body(), request.body_length());
+    return;
+}
+
+
+static void _stream(HTTPRequest &request, HTTPResponse &response, void *arg)
+{
+    response.add_header("Content-Type", "text/plain");
+    for (int index = 0; index < 10; index ++)
+    {
+        char line[64];
+        int line_len = sprintf(line, "line %d\n", index);
+        if (response.write_chunk(line, line_len).is_error()) {
+            break;
+        }
+    }
+    return;
+}
+
+#endif  // end of __REQUEST_HANDLERS
+
+
+// ==========
+#define __MAIN
+#ifdef __MAIN
+
+int main(int argc, char *argv[])
+{
+    int port = (argc > 1) ? atoi(argv[1]) : _HTTP_PORT;
+    Base *base = new Base;
+    HTTPServer *server = new HTTPServer;
+
+    server->add_route("GET", "/hello", _hello);
+    server->add_route("POST", "/echo", _echo);
+    server->add_route("GET", "/stream", _stream);
+
+    struct Error status = server->init(base, NetIPv4, port);
+    if (status.is_error()) {
+        printf("Failed to init HTTP server: %s\n", status.c_err_msg());
+        return -1;
+    }
+
+    printf("HTTP server listening on port %d\n", server->port());
+    base->run();
+
+    printf("%llu requests served\n", (unsigned long long)server->request_count());
+    delete base;
+    return 0;
+}
+
+#endif  // end of __MAIN
+
+// end of file
@@ -0,0 +1,23 @@
+// file encoding: UTF-8
+
+#ifndef __CO_EVENT_TEST_CHECK_H__
+#define __CO_EVENT_TEST_CHECK_H__
+
+#include <stdio.h>
+
+// checks of demo programs under test/, which exit with check_summary() so that failures make non-zero exit code
+static int g_failures = 0;
+
+#define CHECK(cond, fmt, args...)   do { \
+        if (cond) { printf("PASS: " fmt "\n", ##args); } \
+        else { printf("FAIL: " fmt "\n", ##args); g_failures ++; } \
+    } while(0)
+
+
+static int check_summary()
+{
+    printf("%s, %d failure(s)\n", g_failures ? "FAILED" : "PASSED", g_failures);
+    return g_failures ? 1 : 0;
+}
+
+#endif  // EOF
@@ -0,0 +1,151 @@
+#include "coevent.h"
+#include "coevent_tls.h"
+#include "../test_check.h"
+#include <openssl/ssl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using namespace andrewmc::libcoevent;
+
+// TLS echo over loopback with a self-signed certificate ("make" generates cert.pem and key.pem):
+//     ./tls-loopback [cert.pem] [key.pem] [nokTLS]
+// The client checks handshake, echo of a large payload and session resumption, then quits the server.
+// Process exits with non-zero if any check fails.
+#define _TLS_PORT           (18443)
+#define _ROUNDS             (3)
+#define _PAYLOAD_SIZE       (1024 * 1024)
+
+static TLSContext g_server_context;
+static TLSContext g_client_context;
+static TCPServer *g_server = NULL;
+
+
+// ==========
+#define __TLS_SERVER
+#ifdef __TLS_SERVER
+
+static void _echo_session_routine(evutil_socket_t fd, Event *abs_session, void *arg)
+{
+    TCPSession *session = (TCPSession *)abs_session;
+    static char buff[64 * 1024];
+    size_t recv_len = 0;
+
+    CHECK(session->is_tls(), "server session is TLS, kTLS %s", session->is_ktls() ? "on" : "off");
+    while (session->recv(buff, sizeof(buff), &recv_len, 5.0).is_ok() && recv_len > 0)
+    {
+        if (session->reply(buff, recv_len).is_error()) {
+            break;
+        }
+    }
+    return;
+}
+
+#endif  // end of __TLS_SERVER
+
+
+// ==========
+#define __TLS_CLIENT
+#ifdef __TLS_CLIENT
+
+static void _client_routine(evutil_socket_t fd, Event *abs_routine, void *arg)
+{
+    SubRoutine *routine = (SubRoutine *)abs_routine;
+    std::string payload(_PAYLOAD_SIZE, '\0');
+    static char buff[64 * 1024];
+
+    for (int round = 0; round < _ROUNDS; round ++)
+    {
+        TCPClient *client = routine->new_TCP_client(NetIPv4);
+        struct Error status = client->connect_to_server("127.0.0.1", _TLS_PORT, 2.0);
+        if (status.is_ok()) {
+            status = client->start_tls(&g_client_context, "localhost", 2.0);
+        }
+        CHECK(status.is_ok() && client->is_tls(), "round %d handshake: %s, kTLS %s",
+                round, status.c_err_msg(), client->is_ktls() ? "on" : "off");
+        if (status.is_error()) {
+            routine->delete_client(client);
+            continue;
+        }
+
+        for (size_t index = 0; index < payload.size(); index ++) {
+            payload[index] = (char)(index * 7 + round);
+        }
+
+        std::string echo;
+        size_t send_len = 0;
+        size_t recv_len = 0;
+        status = client->send(payload.data(), payload.size(), &send_len);
+        while (status.is_ok() && echo.size() < payload.size())
+        {
+            status = client->recv(buff, sizeof(buff), &recv_len, 2.0);
+            if (status.is_error() || 0 == recv_len) {
+                break;
+            }
+            echo.append(buff, recv_len);
+        }
+        CHECK(echo == payload, "round %d echo of %u bytes: %s", round, (unsigned)payload.size(), status.c_err_msg());
+        routine->delete_client(client);
+    }
+
+    // tickets issued in round 0 should be accepted in later rounds
+    long hits = SSL_CTX_sess_hits((SSL_CTX *)g_server_context.native_handle());
+    CHECK(hits > 0, "session resumption, %ld hits", hits);
+
+    // let the last session see EOF and end before quitting its server
+    routine->sleep(0.2);
+    g_server->quit_session_mode_server();
+    return;
+}
+
+#endif  // end of __TLS_CLIENT
+
+
+// ==========
+#define __MAIN
+#ifdef __MAIN
+
+int main(int argc, char *argv[])
+{
+    const char *cert_file = (argc > 1) ? argv[1] : "cert.pem";
+    const char *key_file = (argc > 2) ? argv[2] : "key.pem";
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    if (argc > 3) {
+        g_server_context.set_ktls(FALSE);
+        g_client_context.set_ktls(FALSE);
+    }
+
+    struct Error status = g_server_context.init_server(cert_file, key_file);
+    if (status.is_ok()) {
+        status = g_client_context.init_client(cert_file);
+    }
+    if (status.is_error()) {
+        printf("Failed to init TLS context: %s\n", status.c_err_msg());
+        return -1;
+    }
+
+    Base *base = new Base;
+    g_server = new TCPServer;
+    SubRoutine *routine = new SubRoutine;
+
+    g_server->set_tls_context(&g_server_context, 2.0);
+    status = g_server->init_session_mode(base, _echo_session_routine, NetIPv4, _TLS_PORT);
+    if (status.is_ok()) {
+        status = routine->init(base, _client_routine);
+    }
+    if (status.is_error()) {
+        printf("Failed to init: %s\n", status.c_err_msg());
+        return -1;
+    }
+
+    base->run();
+    delete base;
+
+    return check_summary();
+}
+
+#endif  // end of __MAIN
+
+// end of file
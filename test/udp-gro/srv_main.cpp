@@ -0,0 +1,194 @@
+#include "coevent.h"
+#include "../test_check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+using namespace andrewmc::libcoevent;
+
+// UDP GSO to GRO over loopback:
+//     ./udp-gro
+// A client sends runs of equal-sized segments with send_segmented(). A GRO enabled server reads the first run
+// with recv_segmented() and the second with recv_batch(), then splits each read by its segment size and checks
+// that every datagram arrives whole and in order. Process exits with non-zero if any check fails.
+#define _UDP_PORT           (18404)
+#define _SEGMENT_SIZE       (1000)
+#define _SEGMENTS_PER_RUN   (100)
+#define _BATCH_SIZE         (8)
+
+
+// ==========
+#define __SEGMENT_CHECK
+#ifdef __SEGMENT_CHECK
+
+struct _RunStat {
+    uint32_t    next_seq;
+    unsigned    reads;
+    unsigned    coalesced_reads;
+    BOOL        is_broken;
+};
+
+
+// each segment starts with its sequence number, followed by bytes derived from it
+static void _fill_segment(uint8_t *segment, uint32_t seq)
+{
+    uint32_t seq_be = htonl(seq);
+    memcpy(segment, &seq_be, sizeof(seq_be));
+    for (size_t index = sizeof(seq_be); index < _SEGMENT_SIZE; index ++) {
+        segment[index] = (uint8_t)(seq + index);
+    }
+    return;
+}
+
+
+static void _check_read(struct _RunStat *stat, const uint8_t *data, size_t data_len, size_t segment_size)
+{
+    stat->reads ++;
+    if (data_len > segment_size) {
+        stat->coalesced_reads ++;
+    }
+    if (segment_size != _SEGMENT_SIZE || 0 != data_len % segment_size) {
+        printf("read of %u bytes has segment size %u\n", (unsigned)data_len, (unsigned)segment_size);
+        stat->is_broken = TRUE;
+        return;
+    }
+
+    uint8_t expected[_SEGMENT_SIZE];
+    for (size_t offset = 0; offset < data_len; offset += segment_size)
+    {
+        _fill_segment(expected, stat->next_seq);
+        if (0 != memcmp(data + offset, expected, segment_size)) {
+            printf("segment %u is damaged or out of order\n", (unsigned)stat->next_seq);
+            stat->is_broken = TRUE;
+        }
+        stat->next_seq ++;
+    }
+    return;
+}
+
+#endif  // end of __SEGMENT_CHECK
+
+
+// ==========
+#define __GRO_SERVER
+#ifdef __GRO_SERVER
+
+static void _gro_server_routine(evutil_socket_t fd, Event *abs_server, void *arg)
+{
+    UDPServer *server = (UDPServer *)abs_server;
+    static uint8_t buffs[_BATCH_SIZE][64 * 1024];
+    struct _RunStat stat;
+    struct Error status;
+
+    // first run by recv_segmented()
+    memset(&stat, 0, sizeof(stat));
+    while (FALSE == stat.is_broken && stat.next_seq < _SEGMENTS_PER_RUN)
+    {
+        size_t recv_len = 0;
+        size_t segment_size = 0;
+        status = server->recv_segmented(buffs[0], sizeof(buffs[0]), &recv_len, &segment_size, 2.0);
+        if (status.is_error()) {
+            break;
+        }
+        _check_read(&stat, buffs[0], recv_len, segment_size);
+    }
+    CHECK(FALSE == stat.is_broken && _SEGMENTS_PER_RUN == stat.next_seq, "recv_segmented() got %u of %u segments in %u reads, %u coalesced: %s",
+            (unsigned)stat.next_seq, _SEGMENTS_PER_RUN, stat.reads, stat.coalesced_reads, status.c_err_msg());
+
+    // second run by recv_batch()
+    memset(&stat, 0, sizeof(stat));
+    while (FALSE == stat.is_broken && stat.next_seq < _SEGMENTS_PER_RUN)
+    {
+        struct UDPMessage msgs[_BATCH_SIZE];
+        size_t recv_count = 0;
+        for (size_t index = 0; index < _BATCH_SIZE; index ++) {
+            msgs[index].data = buffs[index];
+            msgs[index].data_len = sizeof(buffs[index]);
+        }
+
+        status = server->recv_batch(msgs, _BATCH_SIZE, &recv_count, 2.0);
+        if (status.is_error()) {
+            break;
+        }
+        for (size_t index = 0; index < recv_count; index ++) {
+            _check_read(&stat, (const uint8_t *)msgs[index].data, msgs[index].data_len, msgs[index].segment_size);
+        }
+    }
+    CHECK(FALSE == stat.is_broken && _SEGMENTS_PER_RUN == stat.next_seq, "recv_batch() got %u of %u segments in %u messages, %u coalesced: %s",
+            (unsigned)stat.next_seq, _SEGMENTS_PER_RUN, stat.reads, stat.coalesced_reads, status.c_err_msg());
+
+    // server ends with this routine
+    return;
+}
+
+#endif  // end of __GRO_SERVER
+
+
+// ==========
+#define __GSO_CLIENT
+#ifdef __GSO_CLIENT
+
+static void _gso_client_routine(evutil_socket_t fd, Event *abs_routine, void *arg)
+{
+    SubRoutine *routine = (SubRoutine *)abs_routine;
+    static uint8_t data[_SEGMENTS_PER_RUN * _SEGMENT_SIZE];
+
+    for (uint32_t seq = 0; seq < _SEGMENTS_PER_RUN; seq ++) {
+        _fill_segment(data + seq * _SEGMENT_SIZE, seq);
+    }
+
+    UDPClient *client = routine->new_UDP_client(NetIPv4);
+    struct Error status = client->connect("127.0.0.1", _UDP_PORT);
+
+    for (int run = 0; run < 2 && status.is_ok(); run ++)
+    {
+        size_t send_len = 0;
+        status = client->send_segmented(data, sizeof(data), _SEGMENT_SIZE, &send_len);
+        CHECK(status.is_ok() && sizeof(data) == send_len, "run %d send_segmented() sent %u bytes: %s", run, (unsigned)send_len, status.c_err_msg());
+
+        // let server drain this run with its own read function
+        routine->sleep(0.2);
+    }
+
+    routine->delete_client(client);
+    return;
+}
+
+#endif  // end of __GSO_CLIENT
+
+
+// ==========
+#define __MAIN
+#ifdef __MAIN
+
+int main(int argc, char *argv[])
+{
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    Base *base = new Base;
+    UDPServer *server = new UDPServer;
+    SubRoutine *routine = new SubRoutine;
+
+    struct Error status = server->init(base, _gro_server_routine, NetIPv4, _UDP_PORT);
+    if (status.is_ok()) {
+        status = server->set_gro(TRUE);
+    }
+    if (status.is_ok()) {
+        status = routine->init(base, _gso_client_routine);
+    }
+    if (status.is_error()) {
+        printf("Failed to init: %s\n", status.c_err_msg());
+        return -1;
+    }
+
+    base->run();
+    delete base;
+
+    return check_summary();
+}
+
+#endif  // end of __MAIN
+
+// end of file
@@ -0,0 +1,209 @@
+#include "coevent.h"
+#include "../test_check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <set>
+
+using namespace andrewmc::libcoevent;
+
+// UDPTransactor over loopback:
+//     ./udp-transactor
+// Several routines share the transactor of Base with concurrent requests to one backend. The backend drops the first
+// copy of some requests to force retransmission, and answers some others with a wrong transaction id before the right
+// one. Each reply should reach the routine that sent the request. Process exits with non-zero if any check fails.
+#define _UDP_PORT           (18410)
+#define _ROUTINES           (4)
+#define _REQUESTS           (8)         // per routine
+#define _TIMEOUT_ID         (0xFFFF0000)    // never answered
+#define _STOP_ID            (0xFFFFFFFF)    // ends backend
+
+static UDPServer *g_backend = NULL;
+static int g_done_routines = 0;
+
+
+// ==========
+#define __MESSAGE
+#ifdef __MESSAGE
+
+// each message starts with transaction id in network byte order, followed by text
+static size_t _make_message(uint8_t *buff, uint32_t id, const char *text)
+{
+    uint32_t id_be = htonl(id);
+    memcpy(buff, &id_be, sizeof(id_be));
+    strcpy((char *)buff + sizeof(id_be), text);
+    return sizeof(id_be) + strlen(text);
+}
+
+
+static BOOL _transaction_id(const void *data, size_t data_len, uint64_t *id_out, void *user_arg)
+{
+    uint32_t id_be = 0;
+    if (data_len < sizeof(id_be)) {
+        return FALSE;
+    }
+    memcpy(&id_be, data, sizeof(id_be));
+    *id_out = ntohl(id_be);
+    return TRUE;
+}
+
+#endif  // end of __MESSAGE
+
+
+// ==========
+#define __BACKEND
+#ifdef __BACKEND
+
+// id % 4 == 1: first request dropped; id % 4 == 2: answered with a wrong id first. Reply text is "re:" + request text
+static void _backend_routine(evutil_socket_t fd, Event *abs_server, void *arg)
+{
+    UDPServer *server = (UDPServer *)abs_server;
+    std::set<uint64_t> dropped_ids;
+    uint8_t request[256];
+    uint8_t reply[256];
+    size_t recv_len = 0;
+
+    while (server->recv(request, sizeof(request) - 1, &recv_len).is_ok())
+    {
+        uint64_t id = 0;
+        if (FALSE == _transaction_id(request, recv_len, &id, NULL)) {
+            continue;
+        }
+        if (_STOP_ID == id) {
+            break;
+        }
+        if (_TIMEOUT_ID == id) {
+            continue;
+        }
+        if (1 == id % 4 && dropped_ids.insert(id).second) {
+            continue;
+        }
+
+        request[recv_len] = '\0';
+        std::string text = "re:";
+        text.append((const char *)request + sizeof(uint32_t));
+
+        if (2 == id % 4) {
+            size_t reply_len = _make_message(reply, (uint32_t)(id + 1000000), text.c_str());
+            server->reply(reply, reply_len);
+        }
+        size_t reply_len = _make_message(reply, (uint32_t)id, text.c_str());
+        server->reply(reply, reply_len);
+    }
+
+    // server ends with this routine
+    return;
+}
+
+#endif  // end of __BACKEND
+
+
+// ==========
+#define __REQUESTERS
+#ifdef __REQUESTERS
+
+static void _final_checks(SubRoutine *routine, UDPTransactor *transactor)
+{
+    uint8_t request[64];
+    uint8_t reply[64];
+    size_t reply_len = 0;
+
+    // unanswered request is retransmitted until timeout
+    uint64_t retransmits_before = transactor->retransmit_count();
+    size_t request_len = _make_message(request, _TIMEOUT_ID, "lost");
+    struct Error status = transactor->transact(routine, "127.0.0.1", _UDP_PORT, request, request_len, reply, sizeof(reply), &reply_len, 0.5);
+    CHECK(ERR_TIMEOUT == status.app_err_code() && 0 == reply_len, "unanswered request: %s, %u retransmits",
+            status.c_err_msg(), (unsigned)(transactor->retransmit_count() - retransmits_before));
+
+    // only the running procedure may wait for replies
+    request_len = _make_message(request, 1, "wrong coroutine");
+    status = transactor->transact(g_backend, "127.0.0.1", _UDP_PORT, request, request_len, reply, sizeof(reply), &reply_len, 0.5);
+    CHECK(ERR_PARA_ILLEGAL == status.app_err_code(), "request outside coroutine of procedure: %s", status.c_err_msg());
+
+    CHECK(0 == transactor->pending_count(), "no pending transaction");
+    CHECK(transactor->retransmit_count() >= _ROUTINES * _REQUESTS / 4, "%u retransmits in total", (unsigned)transactor->retransmit_count());
+    CHECK(transactor->unmatched_count() >= _ROUTINES * _REQUESTS / 4, "%u unmatched replies", (unsigned)transactor->unmatched_count());
+
+    UDPClient *client = routine->new_UDP_client(NetIPv4);
+    request_len = _make_message(request, _STOP_ID, "stop");
+    client->send(request, request_len, NULL, "127.0.0.1", _UDP_PORT);
+    routine->delete_client(client);
+    return;
+}
+
+
+static void _requester_routine(evutil_socket_t fd, Event *abs_routine, void *arg)
+{
+    SubRoutine *routine = (SubRoutine *)abs_routine;
+    UDPTransactor *transactor = routine->owner()->udp_transactor(NetIPv4);
+    unsigned routine_index = (unsigned)(long)arg;
+    unsigned replied = 0;
+
+    for (unsigned index = 0; index < _REQUESTS; index ++)
+    {
+        uint32_t id = routine_index * 100 + index;
+        char text[64];
+        uint8_t request[64];
+        uint8_t reply[64];
+        size_t reply_len = 0;
+
+        sprintf(text, "routine %u request %u", routine_index, index);
+        size_t request_len = _make_message(request, id, text);
+        struct Error status = transactor->transact(routine, "127.0.0.1", _UDP_PORT, request, request_len, reply, sizeof(reply) - 1, &reply_len, 2.0);
+
+        uint8_t expected[64];
+        std::string expected_text = std::string("re:") + text;
+        size_t expected_len = _make_message(expected, id, expected_text.c_str());
+        if (status.is_ok() && reply_len == expected_len && 0 == memcmp(reply, expected, expected_len)) {
+            replied ++;
+        } else {
+            printf("routine %u request %u: %s, %u bytes\n", routine_index, index, status.c_err_msg(), (unsigned)reply_len);
+        }
+    }
+    CHECK(_REQUESTS == replied, "routine %u got %u of %u replies", routine_index, replied, _REQUESTS);
+
+    g_done_routines ++;
+    if (_ROUTINES == g_done_routines) {
+        _final_checks(routine, transactor);
+    }
+    return;
+}
+
+#endif  // end of __REQUESTERS
+
+
+// ==========
+#define __MAIN
+#ifdef __MAIN
+
+int main(int argc, char *argv[])
+{
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    Base *base = new Base;
+    UDPTransactor *transactor = base->udp_transactor(NetIPv4);
+    transactor->set_transaction_id_func(_transaction_id);
+    transactor->set_retransmission(0.05, 0.2, 4);
+
+    g_backend = new UDPServer;
+    struct Error status = g_backend->init(base, _backend_routine, NetIPv4, _UDP_PORT);
+    for (long index = 0; index < _ROUTINES && status.is_ok(); index ++) {
+        SubRoutine *routine = new SubRoutine;
+        status = routine->init(base, _requester_routine, (void *)index);
+    }
+    if (status.is_error()) {
+        printf("Failed to init: %s\n", status.c_err_msg());
+        return -1;
+    }
+
+    base->run();
+    delete base;
+
+    return check_summary();
+}
+
+#endif  // end of __MAIN
+
+// end of file